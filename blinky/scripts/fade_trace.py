@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+
+"""Turn a CTF capture of the fade engine into timelines, idle and lateness stats.
+
+Build with CONFIG_TRACING=y, CONFIG_TRACING_CTF=y and a tracing backend
+(on native_sim, CONFIG_TRACING_BACKEND_POSIX=y writes the capture to the
+file "channel0_0"). Copy the Zephyr CTF metadata file next to the capture,
+as for Zephyr's own scripts/tracing/parse_ctf.py, and run:
+
+    fade_trace.py <capture directory> [--timeline-dir DIR]
+
+The fade engine events are named events (see src/led_trace.h); the other
+kernel events of the capture are ignored. The script prints scheduler
+wakeup, idle time and lateness statistics and PWM driver call statistics
+and, with --timeline-dir, writes one CSV timeline per LED plus one with
+every wakeup.
+
+Reading CTF needs the babeltrace2 Python bindings (bt2).
+"""
+
+import argparse
+import collections
+import os
+import sys
+
+
+def read_ctf(path):
+    """Yield (time_ns, name, arg0, arg1) for every named event of a capture."""
+    try:
+        import bt2
+    except ImportError:
+        sys.exit("the babeltrace2 Python bindings (bt2) are required")
+
+    for msg in bt2.TraceCollectionMessageIterator(path):
+        if type(msg) is not bt2._EventMessageConst:
+            continue
+        event = msg.event
+        if event.name != "named_event":
+            continue
+        name = str(event.payload_field["name"]).rstrip("\0")
+        yield (msg.default_clock_snapshot.ns_from_origin, name,
+               int(event.payload_field["arg0"]), int(event.payload_field["arg1"]))
+
+
+def unpack(word):
+    """Split an "led << 16 | value" word."""
+    return word >> 16, word & 0xffff
+
+
+def signed(word):
+    """Driver return values travel as 32-bit words."""
+    return word - (1 << 32) if word & (1 << 31) else word
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0
+    index = max(0, (len(sorted_values) * pct + 99) // 100 - 1)
+    return sorted_values[min(index, len(sorted_values) - 1)]
+
+
+class Trace:
+    """Fade engine events of one capture, grouped for analysis."""
+
+    def __init__(self):
+        self.wakeups = []                       # (time_us, served, late_us)
+        self.steps = collections.defaultdict(list)  # led -> [(time_us, step, pulse)]
+        self.sequences = collections.defaultdict(list)  # led -> [(time_us, frames)]
+        self.done = collections.defaultdict(list)   # led -> [(time_us, error)]
+        self.pwm_calls = collections.defaultdict(list)  # led -> [duration_us]
+        self.pwm_errors = 0
+        self._pwm_open = {}
+
+    def add(self, time_ns, name, arg0, arg1):
+        time_us = time_ns / 1000.0
+        if name == "sched_wakeup":
+            self.wakeups.append((time_us, arg0, arg1))
+        elif name == "fade_step":
+            led, step = unpack(arg0)
+            self.steps[led].append((time_us, step, arg1))
+        elif name == "fade_seq":
+            led, frames = unpack(arg0)
+            self.sequences[led].append((time_us, frames))
+        elif name == "fade_done":
+            self.done[arg0].append((time_us, signed(arg1)))
+        elif name == "pwm_enter":
+            self._pwm_open[arg0] = time_us
+        elif name == "pwm_exit":
+            start = self._pwm_open.pop(arg0, None)
+            if start is not None:
+                self.pwm_calls[unpack(arg0)[0]].append(time_us - start)
+            if signed(arg1) < 0:
+                self.pwm_errors += 1
+
+    def idle_gaps(self):
+        """Time between consecutive wakeups, in us."""
+        return [b[0] - a[0] for a, b in zip(self.wakeups, self.wakeups[1:])]
+
+    def print_summary(self, out):
+        late = sorted(late_us for _, _, late_us in self.wakeups)
+        served = sum(n for _, n, _ in self.wakeups)
+        out.write(f"wakeups: {len(self.wakeups)} entries_served={served}\n")
+        if late:
+            out.write("lateness_us: mean={:.1f} p50={} p99={} max={}\n".format(
+                sum(late) / len(late), percentile(late, 50), percentile(late, 99),
+                late[-1]))
+        gaps = sorted(self.idle_gaps())
+        if gaps:
+            span = self.wakeups[-1][0] - self.wakeups[0][0]
+            out.write("idle_us: min={:.1f} p50={:.1f} mean={:.1f} wakeups_per_sec={:.1f}\n".format(
+                gaps[0], percentile(gaps, 50), sum(gaps) / len(gaps),
+                len(gaps) * 1e6 / span if span else 0.0))
+
+        for led in sorted(set(self.steps) | set(self.sequences) | set(self.done)):
+            steps = self.steps.get(led, [])
+            gaps = [b[0] - a[0] for a, b in zip(steps, steps[1:])]
+            line = f"led {led}: steps={len(steps)}"
+            if gaps:
+                line += " step_interval_us: mean={:.1f} max={:.1f}".format(
+                    sum(gaps) / len(gaps), max(gaps))
+            line += f" sequences={len(self.sequences.get(led, []))}"
+            errors = [e for _, e in self.done.get(led, []) if e < 0]
+            line += f" fades={len(self.done.get(led, []))} errors={len(errors)}"
+            out.write(line + "\n")
+
+        for led in sorted(self.pwm_calls):
+            calls = sorted(self.pwm_calls[led])
+            out.write("pwm from led {}: calls={} duration_us: mean={:.1f} p99={:.1f} "
+                      "max={:.1f}\n".format(led, len(calls), sum(calls) / len(calls),
+                                            percentile(calls, 99), calls[-1]))
+        out.write(f"pwm errors: {self.pwm_errors}\n")
+
+    def write_timelines(self, directory):
+        os.makedirs(directory, exist_ok=True)
+        with open(os.path.join(directory, "wakeups.csv"), "w", encoding="utf-8") as f:
+            f.write("time_us,served,deadline_us,late_us,idle_us\n")
+            previous = None
+            for time_us, served, late_us in self.wakeups:
+                idle = f"{time_us - previous:.1f}" if previous is not None else ""
+                f.write(f"{time_us:.1f},{served},{time_us - late_us:.1f},{late_us},{idle}\n")
+                previous = time_us
+        for led, steps in sorted(self.steps.items()):
+            path = os.path.join(directory, f"led{led}.csv")
+            with open(path, "w", encoding="utf-8") as f:
+                f.write("time_us,step,pulse_cycles\n")
+                for time_us, step, pulse in steps:
+                    f.write(f"{time_us:.1f},{step},{pulse}\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", help="directory holding the CTF capture and metadata")
+    parser.add_argument("--timeline-dir", help="write per-LED CSV timelines here")
+    args = parser.parse_args()
+
+    trace = Trace()
+    for event in read_ctf(args.capture):
+        trace.add(*event)
+
+    trace.print_summary(sys.stdout)
+    if args.timeline_dir:
+        trace.write_timelines(args.timeline_dir)
+
+
+if __name__ == "__main__":
+    main()
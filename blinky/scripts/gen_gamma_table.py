@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+
+"""Generate the perceptually corrected LED duty table.
+
+The fade engine works in linear brightness steps, 0 to FADE_STEPS. The eye
+does not see PWM duty linearly, so each step is mapped to a duty cycle with
+the CIE 1931 lightness curve (L*): equal steps in L* look like equal steps
+in brightness. The result is written as a C header holding a const table,
+so it lives in flash and the fade hot path is a single table load.
+
+Duty cycles are stored as Q16 fractions of the period (65536 = 100%). The
+engine scales them to each channel's period in hardware cycles with one
+multiply and shift, so the table does not depend on the PWM clock and keeps
+full counter resolution at the dim end.
+"""
+
+import argparse
+import sys
+
+
+def cie_lightness_to_luminance(lightness):
+    """Relative luminance (0..1) for a CIE L* lightness (0..100)."""
+    if lightness > 8.0:
+        return ((lightness + 16.0) / 116.0) ** 3
+    return lightness / 903.3
+
+
+FULL_SCALE = 1 << 16
+
+
+def build_table(steps):
+    """Q16 duty fraction for every step from 0 to steps."""
+    table = []
+    for step in range(steps + 1):
+        luminance = cie_lightness_to_luminance(100.0 * step / steps)
+        table.append(min(FULL_SCALE, round(luminance * FULL_SCALE)))
+    # The end points must be exactly off and exactly full on
+    table[0] = 0
+    table[-1] = FULL_SCALE
+    return table
+
+
+def write_header(out, table, steps):
+    out.write("/*\n")
+    out.write(" * Generated by scripts/gen_gamma_table.py, do not edit.\n")
+    out.write(" *\n")
+    out.write(f" * CIE L* corrected duty cycles for {steps} fade steps, as Q16\n")
+    out.write(" * fractions of the PWM period (LED_GAMMA_TABLE_FULL = 100%).\n")
+    out.write(" */\n\n")
+    out.write("#ifndef LED_GAMMA_TABLE_H_\n")
+    out.write("#define LED_GAMMA_TABLE_H_\n\n")
+    out.write("#include <stdint.h>\n\n")
+    out.write(f"#define LED_GAMMA_TABLE_STEPS {steps}\n")
+    out.write(f"#define LED_GAMMA_TABLE_FULL {FULL_SCALE}\n\n")
+    out.write(f"static const uint32_t led_gamma_table[{steps + 1}] = {{\n")
+    for i in range(0, len(table), 10):
+        row = ", ".join(str(v) for v in table[i:i + 10])
+        out.write(f"    {row},\n")
+    out.write("};\n\n")
+    out.write("#endif /* LED_GAMMA_TABLE_H_ */\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--steps", type=int, required=True,
+                        help="number of fade steps (FADE_STEPS)")
+    parser.add_argument("--output", required=True, help="header to write")
+    args = parser.parse_args()
+
+    if args.steps < 1:
+        sys.exit("steps must be positive")
+
+    table = build_table(args.steps)
+    with open(args.output, "w", encoding="utf-8") as out:
+        write_header(out, table, args.steps)
+
+
+if __name__ == "__main__":
+    main()
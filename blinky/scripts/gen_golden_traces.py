@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+
+"""Turn the golden PWM traces into a C header for the self-checks.
+
+Each golden/<name>.csv file holds the waveform one demo helper produces on
+the emulated PWM controller: rows of "time_ms,channel,duty_ppm", with time
+relative to the start of the capture and duty in parts per million of the
+period. The waveform is a step function: each row gives the duty of the
+channel from that time on. Comment lines start with '#'; one of them must
+be "# config: key=value ..." with the Kconfig values the trace was recorded
+with, which are emitted as GOLDEN_* macros so the checks can skip traces
+that do not apply to the current configuration.
+
+Every trace becomes a "static const struct golden_trace golden_<name>".
+"""
+
+import argparse
+import os
+import sys
+
+CONFIG_KEYS = ("pwm_period_us", "fade_step_ms", "fade_steps")
+
+
+def parse_trace(path):
+    """Return (config dict, list of (time_ms, channel, duty_ppm))."""
+    config = None
+    points = []
+    with open(path, encoding="utf-8") as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.strip()
+            if not line:
+                continue
+            if line.startswith("#"):
+                text = line[1:].strip()
+                if text.startswith("config:"):
+                    config = dict(item.split("=", 1)
+                                  for item in text[len("config:"):].split())
+                continue
+            fields = line.split(",")
+            if len(fields) != 3:
+                sys.exit(f"{path}:{lineno}: expected time_ms,channel,duty_ppm")
+            time_ms, channel, duty_ppm = (int(v) for v in fields)
+            if duty_ppm > 1000000:
+                sys.exit(f"{path}:{lineno}: duty above 100%")
+            if points and time_ms < points[-1][0]:
+                sys.exit(f"{path}:{lineno}: time goes backwards")
+            points.append((time_ms, channel, duty_ppm))
+
+    if config is None or any(key not in config for key in CONFIG_KEYS):
+        sys.exit(f"{path}: missing '# config: {'=... '.join(CONFIG_KEYS)}=...' line")
+    if not points:
+        sys.exit(f"{path}: empty trace")
+    return config, points
+
+
+def write_header(out, traces, config):
+    out.write("/*\n")
+    out.write(" * Generated by scripts/gen_golden_traces.py from the golden trace\n")
+    out.write(" * files, do not edit.\n")
+    out.write(" */\n\n")
+    out.write("#ifndef GOLDEN_TRACES_H_\n")
+    out.write("#define GOLDEN_TRACES_H_\n\n")
+    out.write("#include <stddef.h>\n")
+    out.write("#include <stdint.h>\n\n")
+    out.write("/* Configuration the traces were recorded with */\n")
+    for key in CONFIG_KEYS:
+        out.write(f"#define GOLDEN_{key.upper()} {config[key]}\n")
+    out.write("\n")
+    out.write("struct golden_point {\n")
+    out.write("    uint32_t time_ms;   /* Since the start of the capture */\n")
+    out.write("    uint32_t channel;   /* Channel of the controller */\n")
+    out.write("    uint32_t duty_ppm;  /* Duty from then on, parts per million */\n")
+    out.write("};\n\n")
+    out.write("struct golden_trace {\n")
+    out.write("    const char *name;\n")
+    out.write("    const struct golden_point *points;\n")
+    out.write("    size_t count;\n")
+    out.write("};\n")
+    for name, points in traces:
+        out.write(f"\nstatic const struct golden_point golden_{name}_points[] = {{\n")
+        for time_ms, channel, duty_ppm in points:
+            out.write(f"    {{ {time_ms}, {channel}, {duty_ppm} }},\n")
+        out.write("};\n\n")
+        out.write(f"static const struct golden_trace golden_{name} = {{\n")
+        out.write(f"    \"{name}\", golden_{name}_points, {len(points)},\n")
+        out.write("};\n")
+    out.write("\n#endif /* GOLDEN_TRACES_H_ */\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--output", required=True, help="header to write")
+    parser.add_argument("traces", nargs="+", help="golden trace files (.csv)")
+    args = parser.parse_args()
+
+    config = None
+    traces = []
+    for path in sorted(args.traces):
+        name = os.path.splitext(os.path.basename(path))[0]
+        if not name.isidentifier():
+            sys.exit(f"{path}: file name is not a C identifier")
+        trace_config, points = parse_trace(path)
+        if config is not None and trace_config != config:
+            sys.exit(f"{path}: recorded with a different configuration")
+        config = trace_config
+        traces.append((name, points))
+
+    with open(args.output, "w", encoding="utf-8") as out:
+        write_header(out, traces, config)
+
+
+if __name__ == "__main__":
+    main()
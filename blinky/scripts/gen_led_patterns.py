@@ -0,0 +1,364 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+
+"""Compile the LED pattern files into animation bytecode.
+
+Each patterns/<name>.yaml (or .yml, .json) file describes one effect, which
+becomes a program of the animation interpreter (src/led_anim.h) named after
+the file. The output is a C header holding the bytecode as const arrays, so
+it stays in flash, and an LED_PATTERN_EFFECTS list that src/led_effects.c
+adds to its table of built-in effects.
+
+A pattern is a mapping with an optional "description" and a "program" list.
+Levels are 0..255 or a percentage string such as "40%"; durations are in
+milliseconds:
+
+    description: Three quick flashes, then a slow fade out
+    program:
+      - loop:
+          count: 3              # 0 or "forever" for no end
+          program:
+            - set: 255
+            - hold: 80
+            - set: 0
+            - hold: 120
+      - set: 255
+      - ramp: {to: 0, ms: 1500, curve: ease_in}
+      - sync: 1
+      - label: top
+      - jump: top
+
+An END is appended unless the program ends with a jump.
+
+Curves are computed here rather than by the interpreter: a curved ramp
+(ease_in, ease_out, ease_in_out, sine) is split into linear ramps whose
+ends fall on whole fade frames, at most "segments" of them (8 by default),
+each ending exactly on the curve. The interpreter then only steps linear
+ramps, as for a plain one.
+
+Timings are checked against the build configuration: a ramp must last a
+whole number of fade frames (FADE_STEP_MS), which the fade engine would
+otherwise cut short, and a hold at least one PWM period (PWM_PERIOD_US),
+or it could never be seen.
+
+Programs with the same bytecode, or whose bytecode is the tail of another
+one, such as effects ending on the same fade out, share their bytes: the
+interpreter reads programs in place, so one may start inside another.
+"""
+
+import argparse
+import json
+import math
+import os
+import sys
+
+# Opcodes and their size in bytes, as in src/led_anim.h
+OP_END, OP_SET, OP_RAMP, OP_HOLD, OP_LOOP, OP_END_LOOP, OP_SYNC, OP_JUMP = range(8)
+OP_SIZES = {OP_END: 1, OP_SET: 2, OP_RAMP: 5, OP_HOLD: 3, OP_LOOP: 2,
+            OP_END_LOOP: 1, OP_SYNC: 2, OP_JUMP: 3}
+
+LEVEL_MAX = 255
+DURATION_MAX = 0xffff
+LOOP_DEPTH = 4           # LED_ANIM_LOOP_DEPTH
+DEFAULT_SEGMENTS = 8
+
+CURVES = {
+    "ease_in": lambda t: t * t,
+    "ease_out": lambda t: 1 - (1 - t) * (1 - t),
+    "ease_in_out": lambda t: t * t * (3 - 2 * t),
+    "sine": lambda t: (1 - math.cos(math.pi * t)) / 2,
+}
+
+
+class PatternError(Exception):
+    pass
+
+
+class Compiler:
+    """Compile the program of one pattern into a list of instructions.
+
+    Each instruction is (opcode, operands), operands being ints; jumps keep
+    the label name until offsets are known.
+    """
+
+    def __init__(self, config):
+        self.step_ms = config["fade_step_ms"]
+        self.period_us = config["pwm_period_us"]
+        self.code = []
+        self.labels = {}
+        self.jumps = []
+        self.depth = 0
+        self.level = 0  # Level of the LED, None when not known here
+
+    def level_of(self, value, where):
+        if isinstance(value, str) and value.endswith("%"):
+            try:
+                percent = float(value[:-1])
+            except ValueError:
+                raise PatternError(f"{where}: bad level '{value}'") from None
+            value = round(percent * LEVEL_MAX / 100)
+        if not isinstance(value, int) or not 0 <= value <= LEVEL_MAX:
+            raise PatternError(f"{where}: level must be 0..{LEVEL_MAX} or a percentage")
+        return value
+
+    def duration_of(self, value, where):
+        if not isinstance(value, int) or not 0 <= value <= DURATION_MAX:
+            raise PatternError(f"{where}: duration must be 0..{DURATION_MAX} ms")
+        return value
+
+    def emit(self, op, *operands):
+        self.code.append((op, list(operands)))
+
+    def ramp(self, args, where):
+        if not isinstance(args, dict) or "to" not in args or "ms" not in args:
+            raise PatternError(f"{where}: ramp needs 'to' and 'ms'")
+        to = self.level_of(args["to"], where)
+        ms = self.duration_of(args["ms"], where)
+        curve = args.get("curve", "linear")
+        segments = args.get("segments", DEFAULT_SEGMENTS)
+
+        if ms % self.step_ms:
+            raise PatternError(f"{where}: {ms} ms is not a whole number of "
+                               f"{self.step_ms} ms frames, the fade engine would "
+                               f"end it after {ms - ms % self.step_ms} ms")
+        if ms and self.step_ms * 1000 < self.period_us:
+            raise PatternError(f"{where}: frames of {self.step_ms} ms are shorter "
+                               f"than the {self.period_us} us PWM period")
+
+        if curve != "linear" and curve not in CURVES:
+            raise PatternError(f"{where}: unknown curve '{curve}', expected linear "
+                               f"or {', '.join(sorted(CURVES))}")
+
+        frames = ms // self.step_ms
+        if curve == "linear" or frames <= 1:
+            self.emit(OP_RAMP, to, ms, 0)
+            self.level = to
+            return
+        if not isinstance(segments, int) or segments < 1:
+            raise PatternError(f"{where}: segments must be a positive integer")
+        if self.level is None:
+            raise PatternError(f"{where}: the level before a curved ramp must be "
+                               f"known here, set it first")
+
+        # Segment ends on whole frames, each level exactly on the curve
+        start = self.level
+        count = min(segments, frames)
+        done = 0
+        for k in range(1, count + 1):
+            end_frame = round(frames * k / count)
+            level = round(start + (to - start) * CURVES[curve](end_frame / frames))
+            self.emit(OP_RAMP, level, (end_frame - done) * self.step_ms, 0)
+            done = end_frame
+        self.level = to
+
+    def compile(self, program, where):
+        if not isinstance(program, list) or not program:
+            raise PatternError(f"{where}: program must be a non-empty list")
+
+        for index, step in enumerate(program):
+            at = f"{where}[{index}]"
+            if not isinstance(step, dict) or len(step) != 1:
+                raise PatternError(f"{at}: each step must be a single-key mapping")
+            (kind, args), = step.items()
+
+            if kind == "set":
+                self.level = self.level_of(args, at)
+                self.emit(OP_SET, self.level)
+            elif kind == "ramp":
+                self.ramp(args, at)
+            elif kind == "hold":
+                ms = self.duration_of(args, at)
+                if ms * 1000 < self.period_us:
+                    raise PatternError(f"{at}: hold of {ms} ms is shorter than the "
+                                       f"{self.period_us} us PWM period")
+                self.emit(OP_HOLD, ms)
+            elif kind == "loop":
+                self.loop(args, at)
+            elif kind == "sync":
+                if not isinstance(args, int) or not 0 <= args <= 255:
+                    raise PatternError(f"{at}: sync id must be 0..255")
+                self.emit(OP_SYNC, args)
+            elif kind == "label":
+                if args in self.labels:
+                    raise PatternError(f"{at}: label '{args}' defined twice")
+                self.labels[args] = (len(self.code), self.depth)
+                self.level = None  # Reached from jumps as well
+            elif kind == "jump":
+                self.jumps.append((len(self.code), args, self.depth, at))
+                self.emit(OP_JUMP, args)
+            else:
+                raise PatternError(f"{at}: unknown step '{kind}'")
+
+    def loop(self, args, where):
+        if not isinstance(args, dict) or "program" not in args:
+            raise PatternError(f"{where}: loop needs a 'program'")
+        count = args.get("count", 0)
+        if count == "forever":
+            count = 0
+        if not isinstance(count, int) or not 0 <= count <= 255:
+            raise PatternError(f"{where}: loop count must be 0..255 or 'forever'")
+        if self.depth == LOOP_DEPTH:
+            raise PatternError(f"{where}: loops nest more than {LOOP_DEPTH} deep")
+
+        entry = self.level
+        self.emit(OP_LOOP, count)
+        self.depth += 1
+        self.compile(args["program"], f"{where}.program")
+        self.depth -= 1
+        self.emit(OP_END_LOOP)
+        if count != 1 and self.level != entry:
+            self.level = None  # Later iterations start where the body ended
+
+    def finish(self):
+        """Resolve the jumps and return the bytecode."""
+        if not self.code or self.code[-1][0] != OP_JUMP:
+            self.emit(OP_END)
+
+        offsets = []
+        offset = 0
+        for op, _ in self.code:
+            offsets.append(offset)
+            offset += OP_SIZES[op]
+        if offset > DURATION_MAX:
+            raise PatternError("program larger than 64 KiB")
+
+        for index, label, depth, at in self.jumps:
+            if label not in self.labels:
+                raise PatternError(f"{at}: no label '{label}'")
+            target, label_depth = self.labels[label]
+            if label_depth != depth:
+                raise PatternError(f"{at}: jump to '{label}' leaves or enters a loop")
+            self.code[index] = (OP_JUMP, [offsets[target]])
+
+        return self.code
+
+
+def encode(code):
+    """Bytes of a list of instructions."""
+    out = bytearray()
+    for op, operands in code:
+        out.append(op)
+        if op in (OP_HOLD, OP_JUMP):
+            out += operands[0].to_bytes(2, "little")
+        elif op == OP_RAMP:
+            out.append(operands[0])
+            out += operands[1].to_bytes(2, "little")
+            out.append(operands[2])
+        else:
+            out += bytes(operands)
+    return bytes(out)
+
+
+def macro(op, operands):
+    """The LED_ANIM_*() builder writing an instruction."""
+    if op == OP_RAMP:
+        return f"LED_ANIM_RAMP({operands[0]}, {operands[1]}, LED_ANIM_CURVE_LINEAR)"
+    names = {OP_END: "END", OP_SET: "SET", OP_HOLD: "HOLD", OP_LOOP: "LOOP",
+             OP_END_LOOP: "END_LOOP", OP_SYNC: "SYNC", OP_JUMP: "JUMP"}
+    return f"LED_ANIM_{names[op]}({', '.join(str(v) for v in operands)})"
+
+
+def load(path):
+    with open(path, encoding="utf-8") as f:
+        if path.endswith(".json"):
+            return json.load(f)
+        try:
+            import yaml
+        except ImportError:
+            sys.exit(f"{path}: PyYAML is needed for YAML patterns")
+        return yaml.safe_load(f)
+
+
+def share(patterns):
+    """Place every program in a blob, reusing the tail of a longer one.
+
+    Returns the blobs, as lists of (name, code) laid out back to back, and
+    for every pattern the (blob, offset) it starts at.
+    """
+    blobs = []
+    placed = {}
+    for name, code in sorted(patterns, key=lambda p: -len(encode(p[1]))):
+        data = encode(code)
+        for b, blob in enumerate(blobs):
+            whole = b"".join(encode(c) for _, c in blob)
+            if whole.endswith(data):
+                placed[name] = (b, len(whole) - len(data))
+                break
+        else:
+            blobs.append([(name, code)])
+            placed[name] = (len(blobs) - 1, 0)
+    return blobs, placed
+
+
+def write_header(out, patterns, descriptions, config):
+    blobs, placed = share(patterns)
+    total = sum(len(encode(code)) for _, code in patterns)
+    stored = sum(len(encode(code)) for blob in blobs for _, code in blob)
+
+    out.write("/*\n")
+    out.write(" * Generated by scripts/gen_led_patterns.py from the pattern files,\n")
+    out.write(" * do not edit.\n")
+    out.write(" *\n")
+    out.write(f" * Checked for FADE_STEP_MS={config['fade_step_ms']} and "
+              f"PWM_PERIOD_US={config['pwm_period_us']}.\n")
+    out.write(f" * {len(patterns)} programs, {total} bytes of bytecode stored in "
+              f"{stored} bytes.\n")
+    out.write(" */\n\n")
+    out.write("#ifndef LED_PATTERNS_H_\n")
+    out.write("#define LED_PATTERNS_H_\n\n")
+    out.write("#include \"led_anim.h\"\n")
+
+    for b, blob in enumerate(blobs):
+        out.write(f"\nstatic const uint8_t led_patterns_{b}[] = {{\n")
+        for name, code in blob:
+            out.write(f"    /* {name}: {descriptions[name]} */\n")
+            depth = 0
+            for op, operands in code:
+                depth -= op == OP_END_LOOP
+                out.write(f"    {'    ' * depth}{macro(op, operands)},\n")
+                depth += op == OP_LOOP
+        out.write("};\n")
+
+    out.write("\n/* Entries of the effect table, as struct led_effect initializers */\n")
+    out.write("#define LED_PATTERN_EFFECTS")
+    for name, code in sorted(patterns):
+        b, offset = placed[name]
+        out.write(f" \\\n    {{ \"{name}\", &led_patterns_{b}[{offset}], "
+                  f"{len(encode(code))} }},")
+    out.write("\n\n#endif /* LED_PATTERNS_H_ */\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--pwm-period-us", type=int, required=True,
+                        help="PWM period (PWM_PERIOD_US)")
+    parser.add_argument("--fade-step-ms", type=int, required=True,
+                        help="fade frame duration (FADE_STEP_MS)")
+    parser.add_argument("--output", required=True, help="header to write")
+    parser.add_argument("patterns", nargs="*", help="pattern files (.yaml, .yml, .json)")
+    args = parser.parse_args()
+
+    config = {"pwm_period_us": args.pwm_period_us, "fade_step_ms": args.fade_step_ms}
+    patterns = []
+    descriptions = {}
+    for path in sorted(args.patterns):
+        name = os.path.splitext(os.path.basename(path))[0]
+        if not name.isidentifier():
+            sys.exit(f"{path}: file name is not a C identifier")
+        pattern = load(path)
+        if not isinstance(pattern, dict) or "program" not in pattern:
+            sys.exit(f"{path}: expected a mapping with a 'program' list")
+        try:
+            compiler = Compiler(config)
+            compiler.compile(pattern["program"], "program")
+            patterns.append((name, compiler.finish()))
+        except PatternError as e:
+            sys.exit(f"{path}: {e}")
+        descriptions[name] = str(pattern.get("description", name)).replace("*/", "* /")
+
+    with open(args.output, "w", encoding="utf-8") as out:
+        write_header(out, patterns, descriptions, config)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+
+"""Stream LED frames to the board over a serial port.
+
+Generates a wave running across the LEDs and sends it with the frame format
+of src/led_stream.h, as fast as the line allows or at a fixed frame rate:
+
+    0xA5, sequence, count, count little endian 16-bit levels, CRC-8
+
+The CRC is CRC-8/CCITT (polynomial 0x07, initial value 0xff) over every
+byte after the sync byte, as computed by Zephyr's crc8_ccitt().
+
+With native_sim, the stream UART is a pseudo terminal whose name the board
+prints at startup ("uart_1 connected to pseudotty: /dev/pts/N"). Only the
+standard library is used: the port is set up with termios, and the line rate
+is paced here, since a pseudo terminal has no baud rate of its own.
+"""
+
+import argparse
+import math
+import os
+import sys
+import termios
+import time
+import tty
+
+SYNC = 0xA5
+MAX_LEVEL = 0xFFFF
+BITS_PER_BYTE = 10  # 8N1
+
+
+def crc8_ccitt(data, crc=0xFF):
+    """CRC-8 with polynomial 0x07, MSB first, no final XOR."""
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def build_frame(seq, levels):
+    """One frame carrying a level (0..MAX_LEVEL) per LED."""
+    body = bytearray([seq & 0xFF, len(levels)])
+    for level in levels:
+        body += level.to_bytes(2, "little")
+    return bytes([SYNC]) + bytes(body) + bytes([crc8_ccitt(body)])
+
+
+def wave(frame, leds, period_frames):
+    """Sine wave levels, shifted by a fraction of a period from one LED to the next."""
+    levels = []
+    for led in range(leds):
+        phase = 2 * math.pi * (frame / period_frames + led / leds)
+        levels.append(round((0.5 - 0.5 * math.cos(phase)) * MAX_LEVEL))
+    return levels
+
+
+def open_port(path):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(fd)
+    attrs = termios.tcgetattr(fd)
+    attrs[3] &= ~termios.ECHO
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    return fd
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", required=True, help="serial port or pseudo terminal")
+    parser.add_argument("--baud", type=int, default=1000000,
+                        help="line rate to pace the frames at (default: %(default)s)")
+    parser.add_argument("--leds", type=int, default=16,
+                        help="LEDs per frame (default: %(default)s)")
+    parser.add_argument("--rate", type=float, default=0,
+                        help="frames per second, 0 for as fast as the line allows")
+    parser.add_argument("--period", type=float, default=2.0,
+                        help="period of the wave in seconds (default: %(default)s)")
+    parser.add_argument("--duration", type=float, default=10.0,
+                        help="seconds to stream, 0 for forever (default: %(default)s)")
+    args = parser.parse_args()
+
+    if not 1 <= args.leds <= 255:
+        sys.exit("--leds must be between 1 and 255")
+
+    frame_bytes = len(build_frame(0, [0] * args.leds))
+    line_rate = args.baud / (BITS_PER_BYTE * frame_bytes)
+    rate = min(args.rate, line_rate) if args.rate > 0 else line_rate
+
+    fd = open_port(args.port)
+    start = time.monotonic()
+    frames = 0
+    sent = 0
+    try:
+        while args.duration == 0 or time.monotonic() - start < args.duration:
+            # Pace on absolute deadlines so the average rate holds
+            delay = start + frames / rate - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            data = build_frame(frames, wave(frames, args.leds, rate * args.period))
+            sent += os.write(fd, data)
+            frames += 1
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.close(fd)
+
+    elapsed = time.monotonic() - start
+    print(f"{frames} frames of {args.leds} LEDs in {elapsed:.1f} s: "
+          f"{frames / elapsed:.0f} frames/s, {sent / elapsed:.0f} bytes/s, "
+          f"{100 * sent * BITS_PER_BYTE / elapsed / args.baud:.1f}% of {args.baud} baud")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,999 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Fade engine benchmarks
+ *
+ * Run against the emulated PWM controller on native_sim, qemu_cortex_m3
+ * and qemu_x86_64 (SMP). Every result is one console line made of a "bench:"
+ * prefix, a metric name and space-separated key=value pairs with integer
+ * values, so runs can be compared with a simple parser:
+ *
+ *   bench: latency op=<call> calls=<n> min_cyc=<c> avg_cyc=<c> max_cyc=<c>
+ *   bench: jitter frames=<n> p50_us=<us> p99_us=<us> max_us=<us>
+ *   bench: jitter_hist lo_us=<us> hi_us=<us> count=<n>
+ *   bench: cpu leds=<n> busy_pct_x100=<p>
+ *   bench: wakeups leds=<n> per_sec=<r> staggered_per_sec=<r>
+ *   bench: idle_trace window_us=<us> n=<k> t_us=<us> served=<n>
+ *   bench: idle window_us=<us> leds=<n> wakeups=<k> per_sec=<r> min_gap_us=<us> residency_pct_x100=<p>
+ *   bench: seq_build frames=<n> steps=<n> min_cyc=<c> avg_cyc=<c> max_cyc=<c> cyc_per_frame=<c>
+ *   bench: peak_on duty_pct=<p> leds=<n> aligned=<k> staggered=<k>
+ *   bench: anim programs=<n> runs=<n> instructions=<n> avg_cyc=<c> max_cyc=<c> cyc_per_frame=<c>
+ *   bench: retarget samples=<n> light_p50_us=<us> light_max_us=<us> frame_us=<us>
+ *   bench: comp channels=<n> frames=<n> all_cyc=<c> one_cyc=<c> hidden_cyc=<c> cyc_per_channel=<c> pushed=<n>
+ *   bench: cmdq producers=<n> cpus=<n> commands=<n> elapsed_us=<us> per_sec=<r> full=<n> out_of_order=<n>
+ *   bench: stream frames=<n> leds=<n> per_sec=<r> bytes_per_sec=<b> line_pct_x100=<p> crc_errors=<n> rejected=<n> lost=<n>
+ *   bench: stream_latency samples=<n> p50_us=<us> p99_us=<us> max_us=<us>
+ *
+ * Latency: cycles spent in one call, read with k_cycle_get_32() around
+ * it. The "none" op is an empty measurement, the cost of the cycle reads
+ * themselves.
+ *
+ * Jitter: while every LED fades, each commit to the controller of LED 0 is
+ * timestamped and compared with its ideal time on the FADE_STEP_MS grid.
+ * The histogram has power-of-two buckets of absolute jitter.
+ *
+ * CPU: share of non-idle cycles while the fade runs, from the kernel's
+ * thread runtime statistics.
+ *
+ * Wakeups: 1..N LEDs fade, each on its own curve, and the number of LED
+ * scheduler wakeups per second is measured while they all run. Every fade
+ * steps on the same frame grid, so LEDs due on the same frame share one
+ * wakeup and frames that change no LED are slept through: the rate never
+ * goes above 1000 / FADE_STEP_MS whatever the LED count. per_sec is for
+ * fades started back to back, staggered_per_sec for fades started more
+ * than the coalescing window apart, which must be bounded all the same.
+ * The scheduler is what is measured here, so
+ * sample.yaml builds the benchmarks with CONFIG_APP_FADE_HW_SEQ=n:
+ * sequenced fades do not use it at all.
+ *
+ * Idle: a few LEDs fade on their own curves, started a fraction of a frame
+ * apart. Every scheduler wakeup is recorded, and the first ones are
+ * printed as a per-wakeup trace. Residency is the share of the
+ * measurement window spent in idle periods of at least BENCH_MIN_IDLE_US,
+ * long enough for a low power state; it is measured without coalescing
+ * (window_us=0) and with CONFIG_APP_LED_SCHED_WINDOW_US. On the shared
+ * grid, both take at most one wakeup per frame. Wakeups take no simulated time on
+ * native_sim, so there the gaps between them are the idle time.
+ *
+ * Sequence build (CONFIG_APP_FADE_HW_SEQ only): cycles spent in
+ * led_fade_ramp() for a full fade that the controller plays, which is
+ * where every frame of the ramp is computed. Built with and without
+ * CONFIG_APP_FADE_DITHER, it gives the per-frame cost of dithering against
+ * the plain path; steps is the number of sequence entries, one per frame
+ * or one per PWM period when dithering.
+ *
+ * Peak on: every LED is set to the same duty and the emulated controllers
+ * report which part of the period each one is lit (pwm_emul_peak_on()).
+ * "staggered" is the peak number of LEDs lit at once as programmed,
+ * "aligned" the peak for the same duties with every rising edge at the
+ * start of the period, as without CONFIG_APP_PWM_STAGGER.
+ *
+ * Animation: looping effects of led_effects.c run on as many LEDs as there
+ * are program slots, for the measurement window. A run is one wakeup of
+ * the interpreter for one program, executing opcodes until the program
+ * waits again; its cycles are read with k_cycle_get_32() around it, and
+ * exclude the fade engine. cyc_per_frame spreads the interpreter cycles of
+ * all programs over the FADE_STEP_MS frames of the window.
+ *
+ * Retarget: a fade running on LED 0 is turned around BENCH_RETARGETS
+ * times, a few frames apart, with led_fade_retarget(). The cycles of the
+ * call itself are reported as a latency op; the light latency runs from
+ * the call to the first commit of its controller, which must come within a
+ * frame ("within_frame").
+ *
+ * Compositor: compositors of 4, 64 and 256 channels, outputting nowhere,
+ * carry an ambient level on the base layer, an added effect on every other
+ * channel and a half transparent alert on every fourth. Each frame then
+ * rewrites layers and commits: all_cyc is a frame where the base layer of
+ * every channel moved, one_cyc one where a single alert changed, and
+ * hidden_cyc one where a single channel was written without any visible
+ * change. Frame costs are averages over BENCH_COMP_FRAMES frames, and
+ * exclude the writes. pushed counts the channels passed on over all
+ * frames, which dirty tracking keeps to the ones that changed.
+ *
+ * Command queue: BENCH_CMDQ_PRODUCERS threads put BENCH_CMDQ_COMMANDS
+ * commands each into a queue of their own, as fast as they can, while one
+ * consumer thread takes them in batches. per_sec is the rate at which they
+ * went through, from the start of the threads to the last command taken;
+ * full counts the puts refused, and retried, because the consumer was
+ * behind. Each producer numbers its commands, and the consumer checks that
+ * it sees them in that order ("ordered"). The uncontended cost of a put is
+ * reported as a latency op. Spread over several CPUs on qemu_x86_64 with
+ * CONFIG_SMP, which is what sample.yaml runs it on.
+ *
+ * Stream (CONFIG_APP_LED_STREAM only): runs first, and waits for frames
+ * from scripts/led_stream_gen.py on the host, which paces them at the baud
+ * rate of the stream UART. Throughput is counted over BENCH_STREAM_MS
+ * from the first frame; line_pct_x100 is the share of the line rate used,
+ * at 10 bits per byte. Latency runs from the decoding of the last byte of
+ * a frame to the commit that shows it on the controller of LED 0.
+ *
+ * native_sim does not model CPU time, only simulated time, so the cycle,
+ * busy and rate figures are only meaningful on qemu and hardware.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/sys/printk.h>
+
+#include "bench.h"
+#include "led_anim.h"
+#include "led_cmd.h"
+#include "led_comp.h"
+#include "led_effects.h"
+#include "led_fade.h"
+#include "led_sched.h"
+#include "led_stream.h"
+#include "pwm_emul.h"
+
+#define BENCH_FADE_MS       (2 * FADE_STEPS * FADE_STEP_MS)  /* Longer than the window */
+#define BENCH_WINDOW_MS     1000                             /* Measurement window */
+#define BENCH_CALLS         1000                             /* Calls per latency op */
+#define BENCH_HIST_BUCKETS  16                               /* Jitter histogram size */
+#define BENCH_MAX_LEDS      64                               /* LEDs of the peak analysis */
+#define BENCH_IDLE_LEDS     4                                /* LEDs of the idle run */
+#define BENCH_IDLE_SPREAD_US 750                             /* Their start offsets span this */
+#define BENCH_MIN_IDLE_US   1000                             /* Idle period worth counting */
+#define BENCH_MAX_WAKEUPS   512                              /* Wakeups recorded per run */
+#define BENCH_TRACE_WAKEUPS 16                               /* Wakeups printed per run */
+#define BENCH_RETARGETS     32                               /* Retargets of the latency run */
+#define BENCH_COMP_FRAMES   64                               /* Frames per compositor case */
+#define BENCH_CMDQ_PRODUCERS 8                               /* Threads putting commands */
+#define BENCH_CMDQ_COMMANDS 10000                            /* Commands per producer */
+#define BENCH_CMDQ_BATCH    16                               /* Commands taken at a time */
+#define BENCH_CMDQ_STACK_SIZE 1024                           /* Stack of each thread */
+#define BENCH_STREAM_WAIT_MS 30000                           /* Wait for the host this long */
+#define BENCH_STREAM_MS     5000                             /* Stream measurement window */
+#define BENCH_STREAM_SAMPLES 1024                            /* Latencies recorded */
+
+/**
+ * @brief Cycle count statistics of one measured call
+ */
+struct bench_latency {
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t calls;
+};
+
+/* Commit timestamps, in cycles, of the controller under test */
+static uint32_t commit_stamps[FADE_STEPS + 1];
+static atomic_t commit_count;
+
+/* Absolute jitter of every frame, in microseconds */
+static uint32_t jitter_us[FADE_STEPS + 1];
+
+/* Time, in microseconds of uptime, and entries served of every wakeup */
+static uint32_t wakeup_stamps[BENCH_MAX_WAKEUPS];
+static uint16_t wakeup_served[BENCH_MAX_WAKEUPS];
+static atomic_t wakeup_count;
+
+static void bench_latency_add(struct bench_latency *lat, uint32_t cycles)
+{
+    lat->min = MIN(lat->min, cycles);
+    lat->max = MAX(lat->max, cycles);
+    lat->sum += cycles;
+    lat->calls++;
+}
+
+static void bench_latency_print(const char *op, const struct bench_latency *lat)
+{
+    printk("bench: latency op=%s calls=%u min_cyc=%u avg_cyc=%u max_cyc=%u\n",
+           op, lat->calls, lat->min, (uint32_t)(lat->sum / MAX(lat->calls, 1)),
+           lat->max);
+}
+
+/**
+ * @brief Cycles per call of the PWM API and of the fade engine write path
+ *
+ * Pulse widths alternate between two values so no call is a no-op.
+ */
+static void bench_latency(void)
+{
+    const struct pwm_dt_spec *spec = led_fade_spec(0);
+    struct bench_latency none = { .min = UINT32_MAX };
+    struct bench_latency set_dt = { .min = UINT32_MAX };
+    struct bench_latency set_cycles = { .min = UINT32_MAX };
+    struct bench_latency set_pulse = { .min = UINT32_MAX };
+    uint64_t cycles_per_sec;
+    uint32_t period_cycles;
+    uint32_t start;
+
+    (void)pwm_get_cycles_per_sec(spec->dev, spec->channel, &cycles_per_sec);
+    period_cycles = (uint32_t)((cycles_per_sec * PWM_PERIOD_US) / USEC_PER_SEC);
+
+    /* Direct driver calls below: keep the controller out of suspend */
+    (void)pm_device_runtime_get(spec->dev);
+
+    for (int i = 0; i < BENCH_CALLS; i++) {
+        uint32_t pulse_us = (i % 2) ? PWM_PERIOD_US / 4 : PWM_PERIOD_US / 2;
+
+        start = k_cycle_get_32();
+        bench_latency_add(&none, k_cycle_get_32() - start);
+
+        /* Time units: converted to cycles by the PWM API on every call */
+        start = k_cycle_get_32();
+        (void)pwm_set_dt(spec, PWM_USEC(PWM_PERIOD_US), PWM_USEC(pulse_us));
+        bench_latency_add(&set_dt, k_cycle_get_32() - start);
+
+        /* Cycles: what the fade engine uses */
+        start = k_cycle_get_32();
+        (void)pwm_set_cycles(spec->dev, spec->channel, period_cycles,
+                             (period_cycles / PWM_PERIOD_US) * pulse_us, spec->flags);
+        bench_latency_add(&set_cycles, k_cycle_get_32() - start);
+
+        /* Engine path: bounds checks, shadow copy and driver call */
+        start = k_cycle_get_32();
+        (void)led_fade_set_pulse(0, PWM_PERIOD_US - pulse_us);
+        bench_latency_add(&set_pulse, k_cycle_get_32() - start);
+    }
+    (void)led_fade_set_pulse(0, 0);
+    (void)pm_device_runtime_put(spec->dev);
+
+    bench_latency_print("none", &none);
+    bench_latency_print("pwm_set_dt", &set_dt);
+    bench_latency_print("pwm_set_cycles", &set_cycles);
+    bench_latency_print("led_fade_set_pulse", &set_pulse);
+}
+
+static void bench_commit_stamp(const struct device *dev, uint32_t commit, void *user_data)
+{
+    uint32_t now = k_cycle_get_32();
+    atomic_val_t n = atomic_inc(&commit_count);
+
+    ARG_UNUSED(dev);
+    ARG_UNUSED(commit);
+    ARG_UNUSED(user_data);
+
+    if (n < (atomic_val_t)ARRAY_SIZE(commit_stamps)) {
+        commit_stamps[n] = now;
+    }
+}
+
+static void bench_wakeup_stamp(uint32_t served, uint32_t late_us, void *user_data)
+{
+    uint32_t now = (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+    atomic_val_t n = atomic_inc(&wakeup_count);
+
+    ARG_UNUSED(late_us);
+    ARG_UNUSED(user_data);
+
+    if (n < (atomic_val_t)ARRAY_SIZE(wakeup_stamps)) {
+        wakeup_stamps[n] = now;
+        wakeup_served[n] = (uint16_t)MIN(served, UINT16_MAX);
+    }
+}
+
+/**
+ * @brief Sort a small array in place (insertion sort, no allocation)
+ */
+static void bench_sort(uint32_t *values, size_t count)
+{
+    for (size_t i = 1; i < count; i++) {
+        uint32_t v = values[i];
+        size_t j = i;
+
+        while (j > 0 && values[j - 1] > v) {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = v;
+    }
+}
+
+/**
+ * @brief Histogram bucket of a jitter value: 0, then [2^(k-1), 2^k) us
+ */
+static size_t bench_hist_bucket(uint32_t us)
+{
+    size_t bucket = 0;
+
+    while (us != 0 && bucket < BENCH_HIST_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+/**
+ * @brief Frame timing jitter and CPU load during a fade of every LED
+ */
+static void bench_jitter_and_cpu(void)
+{
+    const struct device *dev = led_fade_spec(0)->dev;
+    uint64_t frame_ns = (uint64_t)FADE_STEP_MS * NSEC_PER_MSEC;
+    uint32_t hist[BENCH_HIST_BUCKETS] = {0};
+    k_thread_runtime_stats_t before;
+    k_thread_runtime_stats_t after;
+    size_t leds = led_fade_count();
+    size_t frames;
+
+    atomic_set(&commit_count, 0);
+    pwm_emul_set_commit_callback(dev, bench_commit_stamp, NULL);
+    (void)k_thread_runtime_stats_all_get(&before);
+
+    for (size_t i = 0; i < leds; i++) {
+        (void)led_fade_ramp(i, 0, FADE_STEPS, FADE_STEPS * FADE_STEP_MS);
+    }
+    for (size_t i = 0; i < leds; i++) {
+        (void)led_fade_wait(i, K_FOREVER);
+    }
+
+    (void)k_thread_runtime_stats_all_get(&after);
+    pwm_emul_set_commit_callback(dev, NULL, NULL);
+
+    /* Non-idle share of all cycles, in hundredths of a percent */
+    uint64_t busy = after.total_cycles - before.total_cycles;
+    uint64_t all = after.execution_cycles - before.execution_cycles;
+
+    printk("bench: cpu leds=%u busy_pct_x100=%u\n", (unsigned int)leds,
+           (uint32_t)((busy * 10000U) / MAX(all, 1)));
+
+    frames = MIN((size_t)atomic_get(&commit_count), ARRAY_SIZE(commit_stamps));
+    for (size_t n = 0; n < frames; n++) {
+        uint64_t offset_ns = k_cyc_to_ns_floor64(commit_stamps[n] - commit_stamps[0]);
+        /* Nearest frame of the grid, in case a late frame was skipped */
+        uint64_t ideal_ns = ((offset_ns + frame_ns / 2) / frame_ns) * frame_ns;
+        uint64_t error_ns = (offset_ns > ideal_ns) ? offset_ns - ideal_ns
+                                                   : ideal_ns - offset_ns;
+
+        jitter_us[n] = (uint32_t)(error_ns / NSEC_PER_USEC);
+        hist[bench_hist_bucket(jitter_us[n])]++;
+    }
+    bench_sort(jitter_us, frames);
+
+    if (frames == 0) {
+        printk("bench: jitter frames=0\n");
+        return;
+    }
+    printk("bench: jitter frames=%u p50_us=%u p99_us=%u max_us=%u\n",
+           (unsigned int)frames, jitter_us[(frames - 1) / 2],
+           jitter_us[(frames * 99 + 99) / 100 - 1], jitter_us[frames - 1]);
+
+    for (size_t b = 0; b < BENCH_HIST_BUCKETS; b++) {
+        if (hist[b] != 0) {
+            printk("bench: jitter_hist lo_us=%u hi_us=%u count=%u\n",
+                   b ? 1U << (b - 1) : 0U, b ? (1U << b) - 1 : 0U, hist[b]);
+        }
+    }
+
+    for (size_t i = 0; i < leds; i++) {
+        (void)led_fade_ramp(i, 0, 0, 0);
+        (void)led_fade_wait(i, K_FOREVER);
+    }
+}
+
+/**
+ * @brief Measure scheduler wakeups per second with @p leds LEDs fading
+ *
+ * @param leds Number of LEDs
+ * @param spacing Kernel ticks between the starts of two fades, 0 to start
+ *                them back to back
+ */
+static uint32_t bench_wakeups_per_sec(size_t leds, k_ticks_t spacing)
+{
+    uint32_t wakeups;
+    int64_t start;
+    int64_t elapsed;
+
+    /* Independent curves: alternate direction, different end levels */
+    for (size_t i = 0; i < leds; i++) {
+        uint16_t level = FADE_STEPS - (i * FADE_STEPS) / (2 * leds);
+
+        if (i != 0 && spacing != 0) {
+            (void)k_sleep(K_TICKS(spacing));
+        }
+        if (i % 2) {
+            (void)led_fade_ramp(i, level, 0, BENCH_FADE_MS);
+        } else {
+            (void)led_fade_ramp(i, 0, level, BENCH_FADE_MS);
+        }
+    }
+
+    /* Let the first frame go out, then count over a fixed window */
+    k_msleep(FADE_STEP_MS);
+    wakeups = led_fade_wakeups();
+    start = k_uptime_get();
+    k_msleep(BENCH_WINDOW_MS);
+    elapsed = k_uptime_get() - start;
+    wakeups = led_fade_wakeups() - wakeups;
+
+    for (size_t i = 0; i < leds; i++) {
+        (void)led_fade_wait(i, K_FOREVER);
+    }
+
+    return (uint32_t)((wakeups * 1000LL) / elapsed);
+}
+
+static void bench_wakeups(void)
+{
+    /* Just past the window, so only the shared grid lets them share wakeups */
+    k_ticks_t spacing = led_sched_window_ticks() + 1;
+    uint32_t frame_rate = 1000 / FADE_STEP_MS;
+    uint32_t min_rate = UINT32_MAX;
+    uint32_t max_rate = 0;
+    uint32_t max_staggered = 0;
+
+    for (size_t leds = 1; leds <= led_fade_count(); leds++) {
+        uint32_t rate = bench_wakeups_per_sec(leds, 0);
+        uint32_t staggered = bench_wakeups_per_sec(leds, spacing);
+
+        printk("bench: wakeups leds=%u per_sec=%u staggered_per_sec=%u\n",
+               (unsigned int)leds, rate, staggered);
+        min_rate = MIN(min_rate, rate);
+        max_rate = MAX(max_rate, rate);
+        max_staggered = MAX(max_staggered, staggered);
+    }
+
+    /* Bounded means never more than one wakeup per frame, whatever the LED count */
+    printk("bench: wakeups %s (min=%u max=%u frame_rate=%u staggered_max=%u)\n",
+           MAX(max_rate, max_staggered) <= frame_rate + 1 ? "bounded" : "NOT bounded",
+           min_rate, max_rate, frame_rate, max_staggered);
+}
+
+/**
+ * @brief Record the wakeups of independent fades with a coalescing window
+ *
+ * @return Number of wakeups during the measurement window
+ */
+static uint32_t bench_idle_run(uint32_t window_us)
+{
+    size_t leds = MIN(led_fade_count(), BENCH_IDLE_LEDS);
+    uint32_t idle_us = 0;
+    uint32_t min_gap_us = UINT32_MAX;
+    uint32_t start_us;
+    uint32_t end_us;
+    uint32_t prev_us;
+    size_t count;
+
+    led_sched_set_window_us(window_us);
+
+    /* Own start time and slope for each, a fraction of a frame apart */
+    for (size_t i = 0; i < leds; i++) {
+        (void)led_fade_ramp(i, 0, FADE_STEPS - (i * FADE_STEPS) / (2 * leds), BENCH_FADE_MS);
+        k_busy_wait(BENCH_IDLE_SPREAD_US / leds);
+    }
+
+    /* Let the first frames go out, then record over a fixed window */
+    k_msleep(FADE_STEP_MS);
+    atomic_set(&wakeup_count, 0);
+    start_us = (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+    led_sched_set_wakeup_callback(bench_wakeup_stamp, NULL);
+    k_msleep(BENCH_WINDOW_MS);
+    led_sched_set_wakeup_callback(NULL, NULL);
+    end_us = (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+
+    count = MIN((size_t)atomic_get(&wakeup_count), ARRAY_SIZE(wakeup_stamps));
+    prev_us = start_us;
+    for (size_t n = 0; n <= count; n++) {
+        uint32_t at_us = (n < count) ? wakeup_stamps[n] : end_us;
+        uint32_t gap_us = at_us - prev_us;
+
+        if (n < count) {
+            min_gap_us = MIN(min_gap_us, gap_us);
+        }
+        if (n < BENCH_TRACE_WAKEUPS && n < count) {
+            printk("bench: idle_trace window_us=%u n=%u t_us=%u served=%u\n", window_us,
+                   (unsigned int)n, at_us - start_us, wakeup_served[n]);
+        }
+        if (gap_us >= BENCH_MIN_IDLE_US) {
+            idle_us += gap_us;
+        }
+        prev_us = at_us;
+    }
+
+    printk("bench: idle window_us=%u leds=%u wakeups=%u per_sec=%u min_gap_us=%u "
+           "residency_pct_x100=%u\n", window_us, (unsigned int)leds, (unsigned int)count,
+           (uint32_t)(((uint64_t)count * USEC_PER_SEC) / MAX(end_us - start_us, 1)),
+           count ? min_gap_us : 0,
+           (uint32_t)(((uint64_t)idle_us * 10000U) / MAX(end_us - start_us, 1)));
+
+    for (size_t i = 0; i < leds; i++) {
+        (void)led_fade_wait(i, K_FOREVER);
+        (void)led_fade_set_pulse(i, 0);
+    }
+    led_sched_set_window_us(CONFIG_APP_LED_SCHED_WINDOW_US);
+
+    return (uint32_t)count;
+}
+
+static void bench_idle(void)
+{
+    uint32_t frames = BENCH_WINDOW_MS / FADE_STEP_MS;
+    uint32_t separate = bench_idle_run(0);
+    uint32_t coalesced = bench_idle_run(CONFIG_APP_LED_SCHED_WINDOW_US);
+
+    printk("bench: idle fades %s (wakeups %u -> %u, frames %u)\n",
+           MAX(separate, coalesced) <= frames + 1 ? "share wakeups" : "share NO wakeups",
+           separate, coalesced, frames);
+}
+
+#ifdef CONFIG_APP_FADE_HW_SEQ
+/**
+ * @brief Cycles to compute and start a sequenced fade of FADE_STEPS frames
+ *
+ * One fade per LED, all started back to back, so the whole measurement
+ * takes the time of a single fade.
+ */
+static void bench_seq_build(void)
+{
+    const struct pwm_dt_spec *spec = led_fade_spec(0);
+    struct bench_latency build = { .min = UINT32_MAX };
+    struct pwm_emul_channel_state before;
+    struct pwm_emul_channel_state after;
+    size_t leds = led_fade_count();
+    uint32_t start;
+    int ret;
+
+    (void)pwm_emul_get_channel(spec->dev, spec->channel, &before);
+
+    for (size_t i = 0; i < leds; i++) {
+        start = k_cycle_get_32();
+        ret = led_fade_ramp(i, 0, FADE_STEPS, FADE_STEPS * FADE_STEP_MS);
+        bench_latency_add(&build, k_cycle_get_32() - start);
+        if (ret < 0) {
+            printk("bench: seq_build failed: %d\n", ret);
+            break;
+        }
+    }
+    for (size_t i = 0; i < leds; i++) {
+        (void)led_fade_wait(i, K_FOREVER);
+    }
+
+    (void)pwm_emul_get_channel(spec->dev, spec->channel, &after);
+
+    printk("bench: seq_build frames=%u steps=%u min_cyc=%u avg_cyc=%u max_cyc=%u "
+           "cyc_per_frame=%u\n", FADE_STEPS, after.seq_steps - before.seq_steps,
+           build.min, (uint32_t)(build.sum / build.calls), build.max,
+           (uint32_t)(build.sum / build.calls / FADE_STEPS));
+
+    for (size_t i = 0; i < leds; i++) {
+        (void)led_fade_ramp(i, 0, 0, 0);
+        (void)led_fade_wait(i, K_FOREVER);
+    }
+}
+#endif /* CONFIG_APP_FADE_HW_SEQ */
+
+/**
+ * @brief Peak number of LEDs lit at once, with all LEDs at @p duty_pct
+ */
+static void bench_peak_on_at(uint32_t duty_pct, uint32_t *peak_aligned, uint32_t *peak)
+{
+    static struct pwm_emul_window windows[BENCH_MAX_LEDS];
+    static struct pwm_emul_window aligned[BENCH_MAX_LEDS];
+    size_t leds = MIN(led_fade_count(), BENCH_MAX_LEDS);
+
+    for (size_t i = 0; i < leds; i++) {
+        const struct pwm_dt_spec *spec = led_fade_spec(i);
+
+        (void)led_fade_set_pulse(i, (PWM_PERIOD_US * duty_pct) / 100);
+        (void)pwm_emul_get_on_window(spec->dev, spec->channel, spec->flags, &windows[i]);
+        aligned[i] = (struct pwm_emul_window){ .len_ppm = windows[i].len_ppm };
+    }
+
+    *peak = pwm_emul_peak_on(windows, leds);
+    *peak_aligned = pwm_emul_peak_on(aligned, leds);
+    printk("bench: peak_on duty_pct=%u leds=%u aligned=%u staggered=%u\n", duty_pct,
+           (unsigned int)leds, *peak_aligned, *peak);
+}
+
+static void bench_peak_on(void)
+{
+    static const uint32_t duties[] = { 25, 50, 75 };
+    uint32_t peak_aligned;
+    uint32_t peak;
+    bool reduced = true;
+
+    for (size_t d = 0; d < ARRAY_SIZE(duties); d++) {
+        bench_peak_on_at(duties[d], &peak_aligned, &peak);
+        /*
+         * Never worse at any duty. At 50% even two phases (alternate
+         * alignment) halve the peak; above it they cannot help.
+         */
+        reduced = reduced && peak <= peak_aligned;
+        if (duties[d] == 50) {
+            reduced = reduced && (peak < peak_aligned || peak_aligned <= 1);
+        }
+    }
+    for (size_t i = 0; i < led_fade_count(); i++) {
+        (void)led_fade_set_pulse(i, 0);
+    }
+
+    if (IS_ENABLED(CONFIG_APP_PWM_STAGGER)) {
+        printk("bench: peak_on %s\n", reduced ? "reduced" : "NOT reduced");
+    }
+}
+
+static void bench_anim(void)
+{
+    static const char *const names[] = { "breathe", "blink", "heartbeat" };
+    size_t programs = MIN(led_fade_count(), CONFIG_APP_ANIM_MAX_PROGRAMS);
+    struct led_anim_stats before;
+    struct led_anim_stats after;
+
+    led_anim_get_stats(&before);
+    for (size_t i = 0; i < programs; i++) {
+        const struct led_effect *effect = led_effect_find(names[i % ARRAY_SIZE(names)]);
+
+        (void)led_anim_start(i, effect->program, effect->len);
+    }
+    k_msleep(BENCH_WINDOW_MS);
+    led_anim_get_stats(&after);
+
+    for (size_t i = 0; i < programs; i++) {
+        (void)led_anim_stop(i);
+        (void)led_fade_wait(i, K_FOREVER);
+        (void)led_fade_set_pulse(i, 0);
+    }
+
+    uint32_t runs = after.runs - before.runs;
+    uint64_t cycles = after.cycles - before.cycles;
+
+    printk("bench: anim programs=%u runs=%u instructions=%u avg_cyc=%u max_cyc=%u "
+           "cyc_per_frame=%u\n", (unsigned int)programs, runs,
+           after.instructions - before.instructions,
+           (uint32_t)(cycles / MAX(runs, 1)), after.max_cycles,
+           (uint32_t)(cycles / (BENCH_WINDOW_MS / FADE_STEP_MS)));
+}
+
+#ifdef CONFIG_APP_LED_STREAM
+/* Latency of every streamed frame shown on the controller of LED 0 */
+static uint32_t stream_latency_us[BENCH_STREAM_SAMPLES];
+static atomic_t stream_count;
+static uint32_t stream_seen;  /* Frames counted when the last one was shown */
+
+static void bench_stream_commit(const struct device *dev, uint32_t commit, void *user_data)
+{
+    uint32_t now = k_cycle_get_32();
+    struct led_stream_stats stats;
+
+    ARG_UNUSED(dev);
+    ARG_UNUSED(commit);
+    ARG_UNUSED(user_data);
+
+    led_stream_get_stats(&stats);
+    if (stats.frames == stream_seen) {
+        return;  /* Not a new frame */
+    }
+    stream_seen = stats.frames;
+
+    atomic_val_t n = atomic_inc(&stream_count);
+
+    if (n < (atomic_val_t)ARRAY_SIZE(stream_latency_us)) {
+        stream_latency_us[n] = k_cyc_to_us_floor32(now - stats.frame_cycles);
+    }
+}
+
+static void bench_stream(void)
+{
+    const struct device *dev = led_fade_spec(0)->dev;
+    uint32_t baud = DT_PROP_OR(DT_CHOSEN(app_led_stream_uart), current_speed, 0);
+    struct led_stream_stats before;
+    struct led_stream_stats after;
+    int64_t deadline = k_uptime_get() + BENCH_STREAM_WAIT_MS;
+    size_t samples;
+    int ret;
+
+    ret = led_stream_start();
+    if (ret < 0) {
+        printk("bench: stream start failed (%d)\n", ret);
+        return;
+    }
+    printk("bench: stream waiting for scripts/led_stream_gen.py\n");
+
+    do {
+        k_msleep(10);
+        led_stream_get_stats(&before);
+    } while (before.frames == 0 && k_uptime_get() < deadline);
+    if (before.frames == 0) {
+        printk("bench: stream frames=0 (no host)\n");
+        return;
+    }
+
+    stream_seen = before.frames;
+    atomic_set(&stream_count, 0);
+    pwm_emul_set_commit_callback(dev, bench_stream_commit, NULL);
+    k_msleep(BENCH_STREAM_MS);
+    pwm_emul_set_commit_callback(dev, NULL, NULL);
+    led_stream_get_stats(&after);
+
+    uint32_t frames = after.frames - before.frames;
+    uint32_t bytes = after.bytes - before.bytes;
+
+    printk("bench: stream frames=%u leds=%u per_sec=%u bytes_per_sec=%u line_pct_x100=%u "
+           "crc_errors=%u rejected=%u lost=%u\n", frames, (unsigned int)led_fade_count(),
+           (frames * 1000U) / BENCH_STREAM_MS, (uint32_t)((bytes * 1000ULL) / BENCH_STREAM_MS),
+           (uint32_t)(((uint64_t)bytes * 10U * 10000U * 1000U) /
+                      ((uint64_t)MAX(baud, 1) * BENCH_STREAM_MS)),
+           after.crc_errors - before.crc_errors, after.rejected - before.rejected,
+           after.lost - before.lost);
+
+    samples = MIN((size_t)atomic_get(&stream_count), ARRAY_SIZE(stream_latency_us));
+    if (samples == 0) {
+        return;
+    }
+    bench_sort(stream_latency_us, samples);
+    printk("bench: stream_latency samples=%u p50_us=%u p99_us=%u max_us=%u\n",
+           (unsigned int)samples, stream_latency_us[(samples - 1) / 2],
+           stream_latency_us[(samples * 99 + 99) / 100 - 1], stream_latency_us[samples - 1]);
+}
+#endif /* CONFIG_APP_LED_STREAM */
+
+/* Time from each retarget to the first commit that shows it */
+static uint32_t retarget_light_us[BENCH_RETARGETS];
+static uint32_t retarget_stamp;   /* k_cycle_get_32() when it was called */
+static atomic_t retarget_index;   /* Retarget being measured */
+
+static void bench_retarget_commit(const struct device *dev, uint32_t commit, void *user_data)
+{
+    atomic_val_t n = atomic_get(&retarget_index);
+
+    ARG_UNUSED(dev);
+    ARG_UNUSED(commit);
+    ARG_UNUSED(user_data);
+
+    if (n < BENCH_RETARGETS && retarget_light_us[n] == UINT32_MAX) {
+        retarget_light_us[n] = k_cyc_to_us_floor32(k_cycle_get_32() - retarget_stamp);
+    }
+}
+
+static void bench_retarget(void)
+{
+    const struct device *dev = led_fade_spec(0)->dev;
+    struct bench_latency call = { .min = UINT32_MAX };
+    uint32_t frame_us = FADE_STEP_MS * USEC_PER_MSEC;
+    /* At least a step per frame, so every new ramp moves on its first frame */
+    uint32_t ramp_ms = (FADE_STEPS / 4) * FADE_STEP_MS;
+    size_t samples = 0;
+
+    (void)led_fade_retarget(0, FADE_STEPS / 2, 0);
+    (void)led_fade_wait(0, K_FOREVER);
+
+    atomic_set(&retarget_index, BENCH_RETARGETS);
+    pwm_emul_set_commit_callback(dev, bench_retarget_commit, NULL);
+    for (int i = 0; i < BENCH_RETARGETS; i++) {
+        uint32_t start;
+
+        retarget_light_us[i] = UINT32_MAX;
+        atomic_set(&retarget_index, i);
+        start = k_cycle_get_32();
+        retarget_stamp = start;
+        (void)led_fade_retarget(0, (i % 2) ? 0 : FADE_STEPS, ramp_ms);
+        bench_latency_add(&call, k_cycle_get_32() - start);
+        k_msleep(4 * FADE_STEP_MS);
+    }
+    atomic_set(&retarget_index, BENCH_RETARGETS);
+    pwm_emul_set_commit_callback(dev, NULL, NULL);
+    (void)led_fade_retarget(0, 0, 0);
+    (void)led_fade_wait(0, K_FOREVER);
+
+    for (size_t i = 0; i < BENCH_RETARGETS; i++) {
+        if (retarget_light_us[i] != UINT32_MAX) {
+            retarget_light_us[samples++] = retarget_light_us[i];
+        }
+    }
+
+    bench_latency_print("led_fade_retarget", &call);
+    if (samples == 0) {
+        printk("bench: retarget samples=0\n");
+        return;
+    }
+    bench_sort(retarget_light_us, samples);
+    printk("bench: retarget samples=%u light_p50_us=%u light_max_us=%u frame_us=%u\n",
+           (unsigned int)samples, retarget_light_us[(samples - 1) / 2],
+           retarget_light_us[samples - 1], frame_us);
+    printk("bench: retarget %s\n",
+           samples == BENCH_RETARGETS && retarget_light_us[samples - 1] <= frame_us ?
+           "within_frame" : "NOT within_frame");
+}
+
+/* Channels passed on by the benchmarked compositors */
+static size_t comp_pushed;
+
+static int bench_comp_sink(size_t first, const uint16_t *levels, size_t count,
+                           void *user_data)
+{
+    ARG_UNUSED(first);
+    ARG_UNUSED(levels);
+    ARG_UNUSED(user_data);
+
+    comp_pushed += count;
+
+    return 0;
+}
+
+LED_COMP_DEFINE(bench_comp_4, 4, bench_comp_sink, NULL);
+LED_COMP_DEFINE(bench_comp_64, 64, bench_comp_sink, NULL);
+LED_COMP_DEFINE(bench_comp_256, 256, bench_comp_sink, NULL);
+
+/**
+ * @brief Commit @p comp, adding the cycles it took to @p cycles
+ */
+static void bench_comp_commit(struct led_comp *comp, uint64_t *cycles)
+{
+    uint32_t start = k_cycle_get_32();
+
+    (void)led_comp_commit(comp);
+    *cycles += k_cycle_get_32() - start;
+}
+
+static void bench_comp_run(struct led_comp *comp)
+{
+    size_t n = comp->channels;
+    uint64_t all = 0;
+    uint64_t one = 0;
+    uint64_t hidden = 0;
+
+    comp_pushed = 0;
+    for (size_t i = 0; i < n; i++) {
+        (void)led_comp_set(comp, LED_COMP_LAYER_BASE, i, FADE_STEPS / 4,
+                           LED_COMP_BLEND_MAX, 0);
+        if (i % 2 == 0) {
+            (void)led_comp_set(comp, LED_COMP_LAYER_EFFECT, i, FADE_STEPS / 8,
+                               LED_COMP_BLEND_ADD, 0);
+        }
+        if (i % 4 == 0) {
+            (void)led_comp_set(comp, LED_COMP_LAYER_ALERT, i, FADE_STEPS,
+                               LED_COMP_BLEND_ALPHA, 128);
+        }
+    }
+    (void)led_comp_commit(comp);
+
+    for (uint32_t f = 0; f < BENCH_COMP_FRAMES; f++) {
+        /* Ambient wave: every channel moves every frame */
+        for (size_t i = 0; i < n; i++) {
+            (void)led_comp_set(comp, LED_COMP_LAYER_BASE, i,
+                               (uint16_t)((f + i) % (FADE_STEPS / 2)), LED_COMP_BLEND_MAX, 0);
+        }
+        bench_comp_commit(comp, &all);
+
+        (void)led_comp_set(comp, LED_COMP_LAYER_ALERT, f % n, (uint16_t)(f % FADE_STEPS),
+                           LED_COMP_BLEND_ALPHA, 255);
+        bench_comp_commit(comp, &one);
+
+        /* Under the opaque alert: written, composited, not passed on */
+        (void)led_comp_set(comp, LED_COMP_LAYER_EFFECT, f % n, (uint16_t)(f % FADE_STEPS),
+                           LED_COMP_BLEND_ADD, 0);
+        bench_comp_commit(comp, &hidden);
+    }
+
+    printk("bench: comp channels=%u frames=%u all_cyc=%u one_cyc=%u hidden_cyc=%u "
+           "cyc_per_channel=%u pushed=%u\n", (unsigned int)n, BENCH_COMP_FRAMES,
+           (uint32_t)(all / BENCH_COMP_FRAMES), (uint32_t)(one / BENCH_COMP_FRAMES),
+           (uint32_t)(hidden / BENCH_COMP_FRAMES),
+           (uint32_t)(all / (BENCH_COMP_FRAMES * n)), (unsigned int)comp_pushed);
+}
+
+static void bench_comp(void)
+{
+    bench_comp_run(&bench_comp_4);
+    bench_comp_run(&bench_comp_64);
+    bench_comp_run(&bench_comp_256);
+}
+
+LED_CMD_QUEUE_DEFINE(cmdq_queue, CONFIG_APP_LED_CMD_QUEUE_SIZE);
+
+K_THREAD_STACK_ARRAY_DEFINE(cmdq_stacks, BENCH_CMDQ_PRODUCERS + 1, BENCH_CMDQ_STACK_SIZE);
+static struct k_thread cmdq_threads[BENCH_CMDQ_PRODUCERS + 1];
+static uint32_t cmdq_out_of_order;  /* Commands a consumer saw out of their producer's order */
+
+static void bench_cmdq_producer(void *p1, void *p2, void *p3)
+{
+    struct led_cmd cmd = {
+        .op = LED_CMD_SET,
+        .led = (uint16_t)(uintptr_t)p1,
+    };
+
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    /* The sequence number rides in the duration */
+    for (uint32_t i = 0; i < BENCH_CMDQ_COMMANDS; i++) {
+        cmd.duration_ms = i;
+        while (led_cmd_put(&cmdq_queue, &cmd) < 0) {
+            k_yield();
+        }
+    }
+}
+
+static void bench_cmdq_consumer(void *p1, void *p2, void *p3)
+{
+    uint32_t next[BENCH_CMDQ_PRODUCERS] = {0};
+    struct led_cmd batch[BENCH_CMDQ_BATCH];
+    uint32_t taken = 0;
+
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (taken < BENCH_CMDQ_PRODUCERS * BENCH_CMDQ_COMMANDS) {
+        size_t n = led_cmd_get(&cmdq_queue, batch, ARRAY_SIZE(batch));
+
+        if (n == 0) {
+            k_yield();
+            continue;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (batch[i].led >= BENCH_CMDQ_PRODUCERS ||
+                batch[i].duration_ms != next[batch[i].led]) {
+                cmdq_out_of_order++;
+                continue;
+            }
+            next[batch[i].led]++;
+        }
+        taken += n;
+    }
+}
+
+static void bench_cmdq(void)
+{
+    struct bench_latency put = { .min = UINT32_MAX };
+    struct led_cmd cmd = { .op = LED_CMD_SET };
+    uint32_t commands = BENCH_CMDQ_PRODUCERS * BENCH_CMDQ_COMMANDS;
+    uint64_t elapsed_us;
+    int64_t start;
+
+    /* Uncontended: every put finds the queue empty */
+    for (int i = 0; i < BENCH_CALLS; i++) {
+        uint32_t cycles = k_cycle_get_32();
+
+        (void)led_cmd_put(&cmdq_queue, &cmd);
+        bench_latency_add(&put, k_cycle_get_32() - cycles);
+        (void)led_cmd_get(&cmdq_queue, &cmd, 1);
+    }
+    bench_latency_print("led_cmd_put", &put);
+
+    atomic_clear(&cmdq_queue.dropped);
+    cmdq_out_of_order = 0;
+    start = k_uptime_ticks();
+    /* Below this thread, so they all start before any of them runs here */
+    for (size_t i = 0; i <= BENCH_CMDQ_PRODUCERS; i++) {
+        k_thread_entry_t entry = (i < BENCH_CMDQ_PRODUCERS) ? bench_cmdq_producer :
+                                 bench_cmdq_consumer;
+
+        (void)k_thread_create(&cmdq_threads[i], cmdq_stacks[i],
+                              K_THREAD_STACK_SIZEOF(cmdq_stacks[i]), entry,
+                              (void *)(uintptr_t)i, NULL, NULL,
+                              K_LOWEST_APPLICATION_THREAD_PRIO, 0, K_NO_WAIT);
+    }
+    for (size_t i = 0; i <= BENCH_CMDQ_PRODUCERS; i++) {
+        (void)k_thread_join(&cmdq_threads[i], K_FOREVER);
+    }
+    elapsed_us = MAX(k_ticks_to_us_floor64(k_uptime_ticks() - start), 1);
+
+    printk("bench: cmdq producers=%u cpus=%u commands=%u elapsed_us=%u per_sec=%u full=%u "
+           "out_of_order=%u\n", BENCH_CMDQ_PRODUCERS, arch_num_cpus(), commands,
+           (uint32_t)elapsed_us, (uint32_t)((uint64_t)commands * USEC_PER_SEC / elapsed_us),
+           (uint32_t)atomic_get(&cmdq_queue.dropped), cmdq_out_of_order);
+    printk("bench: cmdq %s\n", cmdq_out_of_order == 0 ? "ordered" : "NOT ordered");
+}
+
+int app_bench(void)
+{
+    printk("bench: start\n");
+
+#ifdef CONFIG_APP_LED_STREAM
+    /* First, so the host generator can be started right away */
+    bench_stream();
+#endif
+
+    bench_latency();
+    bench_jitter_and_cpu();
+    bench_wakeups();
+    bench_idle();
+    bench_peak_on();
+    bench_anim();
+    bench_retarget();
+    bench_comp();
+    bench_cmdq();
+#ifdef CONFIG_APP_FADE_HW_SEQ
+    bench_seq_build();
+#endif
+
+    printk("bench: done\n");
+
+    return 0;
+}
@@ -0,0 +1,20 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Benchmarks run instead of the demo loop when CONFIG_APP_BENCH is set.
+ * Results are printed on the console as "bench:" lines.
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+/**
+ * @brief Run all benchmarks
+ *
+ * @return 0 if every benchmark ran, negative error code otherwise
+ */
+int app_bench(void);
+
+#endif /* BENCH_H_ */
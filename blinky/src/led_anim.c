@@ -0,0 +1,678 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Keyframe animation interpreter
+ *
+ * Each running program owns a slot holding its program counter, loop
+ * stack and clock, and an entry of the LED scheduler. The interpreter only
+ * runs when a program has something to do: it executes opcodes until the
+ * program has to wait, hands a ramp to the fade engine or queues the end of
+ * a hold, and returns. Between those points a program costs no CPU at all,
+ * and the fade engine steps its ramps along with every other fade.
+ *
+ * A program waits on one of three things:
+ *   - a ramp (SET and every RAMP segment): the done callback of the fade
+ *     engine queues the slot again when the ramp ends;
+ *   - a hold: the slot is queued for the end of the hold on the program
+ *     clock, which moves by the hold duration, not by when the interpreter
+ *     ran, so holds do not accumulate scheduling delays;
+ *   - a SYNC barrier: the last program to reach it queues all of them.
+ *
+ * led_anim_crossfade() replaces a program without a jump: the first ramp
+ * of the new one redirects whatever fade the LED is in with
+ * led_fade_retarget(), instead of starting a ramp of its own. A program
+ * started on an LED still finishing the ramp of a stopped one takes it
+ * over the same way.
+ *
+ * The handle of a program started with led_anim_submit() is completed
+ * once the lock is released: led_anim_end() hands it back to its caller,
+ * which completes it last, so the callback of the handle may start the
+ * next program right away.
+ *
+ * The bytecode is checked by led_anim_start(), so the interpreter decodes
+ * it without bounds checks. Only the loop stack is guarded at run time,
+ * against jumps in or out of loops, which the check does not follow.
+ */
+
+#include <zephyr/spinlock.h>
+
+#include "led_anim.h"
+#include "led_fade.h"
+#include "led_sched.h"
+
+/* Opcodes executed by one run before the program is considered stuck */
+#define LED_ANIM_MAX_OPS_PER_RUN 64
+
+/* Size in bytes of each opcode with its operands, 0 for unknown opcodes */
+static const uint8_t op_sizes[] = {
+    [LED_ANIM_OP_END] = 1,
+    [LED_ANIM_OP_SET] = 2,
+    [LED_ANIM_OP_RAMP] = 5,
+    [LED_ANIM_OP_HOLD] = 3,
+    [LED_ANIM_OP_LOOP] = 2,
+    [LED_ANIM_OP_END_LOOP] = 1,
+    [LED_ANIM_OP_SYNC] = 2,
+    [LED_ANIM_OP_JUMP] = 3,
+};
+
+/*
+ * Curve tables
+ * Progress of a curved ramp at the end of each of its segments, in 1/256
+ * of the level change. Quadratic for ease-in and ease-out, smoothstep for
+ * ease-in-out.
+ */
+static const uint16_t curve_q8[][LED_ANIM_CURVE_SEGMENTS] = {
+    [LED_ANIM_CURVE_LINEAR] = { 64, 128, 192, 256 },
+    [LED_ANIM_CURVE_EASE_IN] = { 16, 64, 144, 256 },
+    [LED_ANIM_CURVE_EASE_OUT] = { 112, 192, 240, 256 },
+    [LED_ANIM_CURVE_EASE_IN_OUT] = { 40, 128, 216, 256 },
+};
+
+struct led_anim_loop {
+    uint16_t start;  /* Offset of the first opcode of the body */
+    uint8_t left;    /* Iterations left, 0 for a loop without end */
+};
+
+struct led_anim_program {
+    struct led_sched_entry entry;  /* Queued to resume the program */
+    struct k_sem done;             /* Given when the program has ended */
+    const uint8_t *code;           /* Bytecode, read in place */
+    uint16_t len;                  /* Size of the bytecode */
+    uint16_t pc;                   /* Offset of the opcode to execute */
+    uint16_t led;                  /* LED the program drives */
+    bool bound;                    /* led is set: the slot ran a program on it */
+    bool running;                  /* The program has not ended yet */
+    bool fading;                   /* Waiting for a ramp of the fade engine */
+    bool holding;                  /* Waiting for the end of a HOLD */
+    bool syncing;                  /* Waiting at a SYNC */
+    bool crossfading;              /* The next ramp starts from where the LED is */
+    uint32_t crossfade_ms;         /* Shortest duration of that ramp */
+    uint8_t sync_id;               /* Id of that SYNC */
+    uint8_t level;                 /* Level of the LED, 0..LED_ANIM_LEVEL_MAX */
+    uint8_t ramp_from;             /* Level the current RAMP started from */
+    uint8_t segment;               /* Segments of the current RAMP handed out */
+    uint8_t depth;                 /* Open loops */
+    struct led_anim_loop loops[LED_ANIM_LOOP_DEPTH];
+    int64_t time;                  /* Program clock, uptime in ticks */
+    int error;                     /* What ended the program, or 0 */
+    struct led_notify *notify;     /* Handle from led_anim_submit(), or NULL */
+};
+
+/* Ramp to hand to the fade engine, filled in under the lock */
+struct led_anim_ramp {
+    uint16_t from;       /* Fade steps */
+    uint16_t to;         /* Fade steps */
+    uint32_t duration_ms;
+    bool retarget;       /* Redirect the fade of the LED, ignoring from */
+};
+
+static struct k_spinlock lock;  /* Protects programs[] and stats */
+static struct led_anim_program programs[CONFIG_APP_ANIM_MAX_PROGRAMS];
+static struct led_anim_stats stats;
+
+static uint16_t led_anim_u16(const uint8_t *operand)
+{
+    return (uint16_t)(operand[0] | (operand[1] << 8));
+}
+
+/**
+ * @brief Scale a program level to fade steps, rounded to nearest
+ */
+static uint16_t led_anim_steps(uint32_t level)
+{
+    return (uint16_t)((level * FADE_STEPS + LED_ANIM_LEVEL_MAX / 2) / LED_ANIM_LEVEL_MAX);
+}
+
+/**
+ * @brief Release the programs waiting at a SYNC, if none is missing
+ *
+ * Called with the lock held, whenever a program reaches a SYNC or ends.
+ */
+static void led_anim_sync_check(void)
+{
+    int id = -1;
+
+    for (size_t i = 0; i < ARRAY_SIZE(programs); i++) {
+        const struct led_anim_program *p = &programs[i];
+
+        if (!p->running) {
+            continue;
+        }
+        if (!p->syncing || (id >= 0 && p->sync_id != id)) {
+            return;  /* Someone has not reached the barrier yet */
+        }
+        id = p->sync_id;
+    }
+    if (id < 0) {
+        return;
+    }
+
+    /* Same start time for all: their clocks stay aligned after the barrier */
+    int64_t now = k_uptime_ticks();
+
+    for (size_t i = 0; i < ARRAY_SIZE(programs); i++) {
+        struct led_anim_program *p = &programs[i];
+
+        if (p->running) {
+            p->syncing = false;
+            p->time = now;
+            (void)led_sched_at(&p->entry, now);
+        }
+    }
+}
+
+static void led_anim_fade_done(size_t led, int error, void *user_data);
+
+/**
+ * @brief End a program and wake up its waiters
+ *
+ * Called with the lock held.
+ *
+ * @return Handle of the program, to complete with @p error once the lock
+ *         is released, or NULL
+ */
+static struct led_notify *led_anim_end(struct led_anim_program *p, int error)
+{
+    struct led_notify *notify = p->notify;
+
+    p->running = false;
+    p->error = error;
+    p->notify = NULL;
+    led_sched_cancel(&p->entry);
+    /* Unless someone registered their own since, or a program took over the LED */
+    (void)led_fade_replace_done_callback(p->led, led_anim_fade_done, p, NULL, NULL);
+    k_sem_give(&p->done);
+
+    /* The others may have been waiting for this one at a SYNC */
+    led_anim_sync_check();
+
+    return notify;
+}
+
+/**
+ * @brief Fill in the next segment of the current RAMP
+ *
+ * @return false once every segment was handed out
+ */
+static bool led_anim_ramp_segment(struct led_anim_program *p, const uint8_t *op,
+                                  struct led_anim_ramp *ramp)
+{
+    uint8_t curve = op[4];
+    uint32_t segments = (curve == LED_ANIM_CURVE_LINEAR) ? 1 : LED_ANIM_CURVE_SEGMENTS;
+    uint32_t duration_ms = led_anim_u16(&op[2]);
+    int32_t from = led_anim_steps(p->ramp_from);
+    int32_t change = (int32_t)led_anim_steps(op[1]) - from;
+    uint32_t k = p->segment;
+
+    if (k == segments) {
+        return false;
+    }
+
+    /* A linear ramp is its last segment: progress 256/256 */
+    uint16_t start_q8 = (k == 0) ? 0 : curve_q8[curve][k - 1];
+    uint16_t end_q8 = curve_q8[curve][segments == 1 ? LED_ANIM_CURVE_SEGMENTS - 1 : k];
+
+    ramp->from = (uint16_t)(from + (change * start_q8) / 256);
+    ramp->to = (uint16_t)(from + (change * end_q8) / 256);
+    ramp->duration_ms = (duration_ms * (k + 1)) / segments - (duration_ms * k) / segments;
+    p->segment++;
+
+    return true;
+}
+
+/**
+ * @brief Execute a program until it has to wait
+ *
+ * Called with the lock held.
+ *
+ * @param p Program to run
+ * @param ramp Filled in when the program waits for a ramp
+ * @param executed Incremented for every opcode executed
+ * @param ended Filled with the handle to complete if the program ended
+ *
+ * @return true if @p ramp must be started, with the lock released
+ */
+static bool led_anim_exec(struct led_anim_program *p, struct led_anim_ramp *ramp,
+                          uint32_t *executed, struct led_notify **ended)
+{
+    for (uint32_t budget = LED_ANIM_MAX_OPS_PER_RUN; budget > 0; budget--) {
+        const uint8_t *op = &p->code[p->pc];
+        struct led_anim_loop *loop;
+
+        (*executed)++;
+        switch (op[0]) {
+        case LED_ANIM_OP_END:
+            *ended = led_anim_end(p, 0);
+            return false;
+
+        case LED_ANIM_OP_SET:
+            p->level = op[1];
+            p->pc += op_sizes[LED_ANIM_OP_SET];
+            ramp->from = led_anim_steps(p->level);
+            ramp->to = ramp->from;
+            ramp->duration_ms = 0;
+            p->fading = true;
+            return true;
+
+        case LED_ANIM_OP_RAMP:
+            if (p->segment == 0) {
+                p->ramp_from = p->level;
+            }
+            if (led_anim_ramp_segment(p, op, ramp)) {
+                p->fading = true;
+                return true;
+            }
+            /* Every segment has ended */
+            p->level = op[1];
+            p->segment = 0;
+            p->pc += op_sizes[LED_ANIM_OP_RAMP];
+            break;
+
+        case LED_ANIM_OP_HOLD:
+            if (!p->holding) {
+                p->holding = true;
+                p->time += k_ms_to_ticks_ceil64(led_anim_u16(&op[1]));
+                (void)led_sched_at(&p->entry, p->time);
+                return false;
+            }
+            p->holding = false;
+            p->pc += op_sizes[LED_ANIM_OP_HOLD];
+            break;
+
+        case LED_ANIM_OP_LOOP:
+            if (p->depth == LED_ANIM_LOOP_DEPTH) {
+                *ended = led_anim_end(p, -EINVAL);
+                return false;
+            }
+            p->pc += op_sizes[LED_ANIM_OP_LOOP];
+            p->loops[p->depth].start = p->pc;
+            p->loops[p->depth].left = op[1];
+            p->depth++;
+            break;
+
+        case LED_ANIM_OP_END_LOOP:
+            if (p->depth == 0) {
+                *ended = led_anim_end(p, -EINVAL);
+                return false;
+            }
+            loop = &p->loops[p->depth - 1];
+            if (loop->left == 0 || --loop->left > 0) {
+                p->pc = loop->start;
+            } else {
+                p->depth--;
+                p->pc += op_sizes[LED_ANIM_OP_END_LOOP];
+            }
+            break;
+
+        case LED_ANIM_OP_SYNC:
+            p->syncing = true;
+            p->sync_id = op[1];
+            p->pc += op_sizes[LED_ANIM_OP_SYNC];
+            led_anim_sync_check();
+            return false;
+
+        case LED_ANIM_OP_JUMP:
+            p->pc = led_anim_u16(&op[1]);
+            break;
+        }
+    }
+
+    /* Only jumps and loops without a wait in between get here */
+    *ended = led_anim_end(p, -ELOOP);
+    return false;
+}
+
+/**
+ * @brief Resume a program, from the LED scheduler
+ */
+static void led_anim_run(struct led_sched_entry *entry)
+{
+    struct led_anim_program *p = CONTAINER_OF(entry, struct led_anim_program, entry);
+    struct led_notify *ended = NULL;
+    struct led_anim_ramp ramp;
+    uint32_t executed = 0;
+    bool start_ramp = false;
+    int error;
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    uint32_t start = k_cycle_get_32();
+
+    if (p->running && !p->fading && !p->syncing) {
+        start_ramp = led_anim_exec(p, &ramp, &executed, &ended);
+    }
+    ramp.retarget = start_ramp && p->crossfading;
+    if (ramp.retarget) {
+        ramp.duration_ms = MAX(ramp.duration_ms, p->crossfade_ms);
+        p->crossfading = false;
+    }
+
+    uint32_t cycles = k_cycle_get_32() - start;
+
+    stats.runs++;
+    stats.instructions += executed;
+    stats.cycles += cycles;
+    stats.max_cycles = MAX(stats.max_cycles, cycles);
+    error = p->error;
+    k_spin_unlock(&lock, key);
+
+    if (!start_ramp) {
+        led_notify_complete(ended, error);
+        return;
+    }
+
+    /* Outside the lock: the done callback takes it, and may run right away */
+    int ret = ramp.retarget ? led_fade_retarget(p->led, ramp.to, ramp.duration_ms) :
+                              led_fade_ramp(p->led, ramp.from, ramp.to, ramp.duration_ms);
+
+    if (ret < 0) {
+        key = k_spin_lock(&lock);
+        if (p->running && p->fading) {
+            p->fading = false;
+            ended = led_anim_end(p, ret);
+        }
+        k_spin_unlock(&lock, key);
+        led_notify_complete(ended, ret);
+    }
+}
+
+/**
+ * @brief Resume a program when its ramp ends, from the fade engine
+ */
+static void led_anim_fade_done(size_t led, int error, void *user_data)
+{
+    struct led_anim_program *p = user_data;
+    struct led_notify *ended = NULL;
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (p->running && p->fading && p->led == led) {
+        p->fading = false;
+        if (error < 0) {
+            ended = led_anim_end(p, error);
+        } else {
+            p->time = k_uptime_ticks();
+            (void)led_sched_at(&p->entry, p->time);
+        }
+    }
+    k_spin_unlock(&lock, key);
+
+    led_notify_complete(ended, error);
+}
+
+/**
+ * @brief Find the slot of the last program started on an LED
+ *
+ * Called with the lock held.
+ *
+ * @return The slot, or NULL if no program was ever started on the LED
+ */
+static struct led_anim_program *led_anim_find(size_t led)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(programs); i++) {
+        if (programs[i].bound && programs[i].led == led) {
+            return &programs[i];
+        }
+    }
+
+    return NULL;
+}
+
+int led_anim_init(void)
+{
+    int ret = led_sched_reserve(ARRAY_SIZE(programs));
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(programs); i++) {
+        led_sched_entry_init(&programs[i].entry, led_anim_run);
+        k_sem_init(&programs[i].done, 0, 1);
+        programs[i].bound = false;
+        programs[i].running = false;
+    }
+
+    return 0;
+}
+
+int led_anim_validate(const uint8_t *program, size_t len)
+{
+    size_t depth = 0;
+    size_t pc = 0;
+    uint8_t last = LED_ANIM_OP_END;
+
+    if (program == NULL || len == 0 || len > UINT16_MAX) {
+        return -EINVAL;
+    }
+
+    while (pc < len) {
+        const uint8_t *op = &program[pc];
+        size_t size = (op[0] < ARRAY_SIZE(op_sizes)) ? op_sizes[op[0]] : 0;
+
+        if (size == 0 || pc + size > len) {
+            return -EINVAL;  /* Unknown opcode or truncated operands */
+        }
+
+        switch (op[0]) {
+        case LED_ANIM_OP_RAMP:
+            if (op[4] >= ARRAY_SIZE(curve_q8)) {
+                return -EINVAL;
+            }
+            break;
+        case LED_ANIM_OP_LOOP:
+            if (++depth > LED_ANIM_LOOP_DEPTH) {
+                return -EINVAL;
+            }
+            break;
+        case LED_ANIM_OP_END_LOOP:
+            if (depth == 0) {
+                return -EINVAL;
+            }
+            depth--;
+            break;
+        case LED_ANIM_OP_JUMP: {
+            size_t target = led_anim_u16(&op[1]);
+            size_t at = 0;
+
+            /* The target must be the start of an opcode */
+            while (at < target && at < len) {
+                size_t at_size = (program[at] < ARRAY_SIZE(op_sizes)) ?
+                                 op_sizes[program[at]] : 0;
+
+                if (at_size == 0) {
+                    return -EINVAL;
+                }
+                at += at_size;
+            }
+            if (at != target || target >= len) {
+                return -EINVAL;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+
+        last = op[0];
+        pc += size;
+    }
+
+    /* Execution must never run off the end of the program */
+    if (depth != 0 || (last != LED_ANIM_OP_END && last != LED_ANIM_OP_JUMP)) {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Start a program on an LED
+ *
+ * @param replace Stop the program running on the LED, if any
+ * @param crossfade Start the first ramp from where the LED is
+ * @param crossfade_ms Shortest duration of that ramp
+ * @param notify Handle of the program, or NULL
+ */
+static int led_anim_launch(size_t led, const uint8_t *program, size_t len, bool replace,
+                           bool crossfade, uint32_t crossfade_ms, struct led_notify *notify)
+{
+    struct led_notify *replaced = NULL;
+    struct led_anim_program *p;
+    k_spinlock_key_t key;
+    int ret;
+
+    if (led >= led_fade_count()) {
+        return -EINVAL;
+    }
+    ret = led_anim_validate(program, len);
+    if (ret < 0) {
+        return ret;
+    }
+
+    key = k_spin_lock(&lock);
+    p = led_anim_find(led);
+    /* The ramp a stopped program left running would make the first one fail */
+    bool left_ramp = p != NULL && !p->running && p->fading && led_fade_is_active(led);
+
+    if (p != NULL && p->running) {
+        if (!replace) {
+            k_spin_unlock(&lock, key);
+            return -EBUSY;
+        }
+        replaced = led_anim_end(p, -ECANCELED);
+    }
+
+    /* Reuse the slot of the LED, else a free one, else one that has ended */
+    for (size_t i = 0; p == NULL && i < ARRAY_SIZE(programs); i++) {
+        if (!programs[i].bound) {
+            p = &programs[i];
+        }
+    }
+    for (size_t i = 0; p == NULL && i < ARRAY_SIZE(programs); i++) {
+        if (!programs[i].running) {
+            p = &programs[i];
+        }
+    }
+    if (p == NULL) {
+        k_spin_unlock(&lock, key);
+        return -ENOMEM;
+    }
+
+    p->code = program;
+    p->len = (uint16_t)len;
+    p->pc = 0;
+    p->led = (uint16_t)led;
+    p->bound = true;
+    p->running = true;
+    p->fading = false;
+    p->holding = false;
+    p->syncing = false;
+    p->crossfading = crossfade || left_ramp;
+    p->crossfade_ms = crossfade ? crossfade_ms : 0;
+    p->level = 0;
+    p->segment = 0;
+    p->depth = 0;
+    p->time = k_uptime_ticks();
+    p->error = 0;
+    k_sem_reset(&p->done);
+    if (notify != NULL) {
+        led_notify_start(notify);
+    }
+    p->notify = notify;
+
+    (void)led_fade_set_done_callback(led, led_anim_fade_done, p);
+    /* Cannot fail: led_anim_init() reserved a slot per program */
+    (void)led_sched_at(&p->entry, p->time);
+    k_spin_unlock(&lock, key);
+
+    led_notify_complete(replaced, -ECANCELED);
+
+    return 0;
+}
+
+int led_anim_start(size_t led, const uint8_t *program, size_t len)
+{
+    return led_anim_launch(led, program, len, false, false, 0, NULL);
+}
+
+int led_anim_submit(size_t led, const uint8_t *program, size_t len, struct led_notify *notify)
+{
+    return led_anim_launch(led, program, len, false, false, 0, notify);
+}
+
+int led_anim_crossfade(size_t led, const uint8_t *program, size_t len, uint32_t duration_ms)
+{
+    return led_anim_launch(led, program, len, true, true, duration_ms, NULL);
+}
+
+int led_anim_stop(size_t led)
+{
+    struct led_notify *ended = NULL;
+    struct led_anim_program *p;
+    k_spinlock_key_t key;
+    int ret = 0;
+
+    if (led >= led_fade_count()) {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&lock);
+    p = led_anim_find(led);
+    if (p == NULL || !p->running) {
+        ret = -EALREADY;
+    } else {
+        ended = led_anim_end(p, -ECANCELED);
+    }
+    k_spin_unlock(&lock, key);
+
+    led_notify_complete(ended, -ECANCELED);
+
+    return ret;
+}
+
+bool led_anim_is_running(size_t led)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    struct led_anim_program *p = led_anim_find(led);
+    bool running = (p != NULL && p->running);
+
+    k_spin_unlock(&lock, key);
+
+    return running;
+}
+
+int led_anim_wait(size_t led, k_timeout_t timeout)
+{
+    struct led_anim_program *p;
+    k_spinlock_key_t key;
+    int ret;
+
+    if (led >= led_fade_count()) {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&lock);
+    p = led_anim_find(led);
+    k_spin_unlock(&lock, key);
+    if (p == NULL) {
+        return -EINVAL;
+    }
+
+    ret = k_sem_take(&p->done, timeout);
+    if (ret < 0) {
+        return ret;  /* Still running when the timeout expired */
+    }
+
+    /* Leave the semaphore given so repeated waits keep returning */
+    k_sem_give(&p->done);
+
+    return p->error;
+}
+
+void led_anim_get_stats(struct led_anim_stats *out)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    *out = stats;
+    k_spin_unlock(&lock, key);
+}
@@ -0,0 +1,234 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Keyframe animation bytecode
+ *
+ * An effect is a small program of byte-sized opcodes, each followed by its
+ * operands, run by the interpreter of led_anim.c on one LED. Programs are
+ * const arrays: they stay in flash and are read in place, never copied to
+ * RAM, so a running program only costs the interpreter state of its slot.
+ * Any number of programs, up to CONFIG_APP_ANIM_MAX_PROGRAMS, run at once,
+ * each on its own LED.
+ *
+ * Brightness is one byte, 0 (off) to 255 (full), scaled to the FADE_STEPS
+ * levels of the fade engine, so a program does not depend on the step
+ * count of the build. Durations are 16-bit milliseconds. Multi-byte
+ * operands are little-endian.
+ *
+ *   Opcode     Operands                           Bytes
+ *   END        -                                  1    Stop; the LED keeps its level
+ *   SET        level                              2    Jump to a level
+ *   RAMP       level, duration (u16), curve       5    Move to a level over a duration
+ *   HOLD       duration (u16)                     3    Keep the level for a duration
+ *   LOOP       count                              2    Repeat up to END_LOOP count
+ *                                                      times, 0 forever
+ *   END_LOOP   -                                  1    End of the innermost LOOP
+ *   SYNC       id                                 2    Wait until every running program
+ *                                                      has reached a SYNC with this id
+ *   JUMP       offset (u16)                       3    Continue at a byte offset
+ *
+ * A program starts from the level the LED is at, assumed dark unless it
+ * starts with SET. Ramps are linear in perceived brightness (the fade
+ * engine applies the gamma table); the other curves are approximated with
+ * LED_ANIM_CURVE_SEGMENTS linear ramps. Loops nest up to
+ * LED_ANIM_LOOP_DEPTH deep; a JUMP must not leave or enter a loop.
+ *
+ * SYNC is a barrier: programs reaching it wait until every other running
+ * program waits on a SYNC with the same id, then all continue together.
+ * Programs waiting on different ids wait for good.
+ *
+ * Programs are checked once when started (led_anim_start()), so the
+ * interpreter itself trusts every opcode, operand and jump.
+ */
+
+#ifndef LED_ANIM_H_
+#define LED_ANIM_H_
+
+#include <zephyr/kernel.h>
+
+#include "led_notify.h"  /* Handles of asynchronous programs */
+
+/* Opcodes */
+#define LED_ANIM_OP_END       0x00
+#define LED_ANIM_OP_SET       0x01
+#define LED_ANIM_OP_RAMP      0x02
+#define LED_ANIM_OP_HOLD      0x03
+#define LED_ANIM_OP_LOOP      0x04
+#define LED_ANIM_OP_END_LOOP  0x05
+#define LED_ANIM_OP_SYNC      0x06
+#define LED_ANIM_OP_JUMP      0x07
+
+/* Ramp curves */
+#define LED_ANIM_CURVE_LINEAR       0
+#define LED_ANIM_CURVE_EASE_IN      1  /* Slow start (quadratic) */
+#define LED_ANIM_CURVE_EASE_OUT     2  /* Slow end (quadratic) */
+#define LED_ANIM_CURVE_EASE_IN_OUT  3  /* Slow start and end (smoothstep) */
+
+/* Linear ramps making up a curved ramp */
+#define LED_ANIM_CURVE_SEGMENTS     4
+
+/* Maximum nesting of LOOP */
+#define LED_ANIM_LOOP_DEPTH         4
+
+/* Full brightness of a program */
+#define LED_ANIM_LEVEL_MAX          255
+
+/*
+ * Program builders
+ * A program is written as a const uint8_t array of these, for example:
+ *
+ *   static const uint8_t blink[] = {
+ *       LED_ANIM_LOOP(0),
+ *           LED_ANIM_SET(255), LED_ANIM_HOLD(250),
+ *           LED_ANIM_SET(0), LED_ANIM_HOLD(250),
+ *       LED_ANIM_END_LOOP(),
+ *   };
+ */
+#define LED_ANIM_U16(v)             (uint8_t)((v) & 0xff), (uint8_t)(((v) >> 8) & 0xff)
+
+#define LED_ANIM_END()              LED_ANIM_OP_END
+#define LED_ANIM_SET(level)         LED_ANIM_OP_SET, (uint8_t)(level)
+#define LED_ANIM_RAMP(level, ms, curve) \
+    LED_ANIM_OP_RAMP, (uint8_t)(level), LED_ANIM_U16(ms), (uint8_t)(curve)
+#define LED_ANIM_HOLD(ms)           LED_ANIM_OP_HOLD, LED_ANIM_U16(ms)
+#define LED_ANIM_LOOP(count)        LED_ANIM_OP_LOOP, (uint8_t)(count)
+#define LED_ANIM_END_LOOP()         LED_ANIM_OP_END_LOOP
+#define LED_ANIM_SYNC(id)           LED_ANIM_OP_SYNC, (uint8_t)(id)
+#define LED_ANIM_JUMP(offset)       LED_ANIM_OP_JUMP, LED_ANIM_U16(offset)
+
+/**
+ * @brief Interpreter statistics, over all programs since boot
+ */
+struct led_anim_stats {
+    uint32_t runs;          /* Times the interpreter was woken up */
+    uint32_t instructions;  /* Opcodes executed */
+    uint64_t cycles;        /* CPU cycles spent interpreting */
+    uint32_t max_cycles;    /* Longest single run */
+};
+
+/**
+ * @brief Prepare the interpreter
+ *
+ * Must be called once, after led_fade_init(), before any other
+ * led_anim_*() function.
+ *
+ * @retval 0 On success
+ * @retval -ENOMEM The LED scheduler cannot queue every program slot
+ */
+int led_anim_init(void);
+
+/**
+ * @brief Check a program without running it
+ *
+ * @param program Bytecode
+ * @param len Size of the program in bytes
+ *
+ * @retval 0 The program is well formed
+ * @retval -EINVAL Unknown opcode, truncated operand, jump or curve out of
+ *                 range, unbalanced or too deep LOOP, or no END
+ */
+int led_anim_validate(const uint8_t *program, size_t len);
+
+/**
+ * @brief Start running a program on an LED without blocking
+ *
+ * The program is read in place and must stay valid until it ends.
+ *
+ * @param led Index of the LED
+ * @param program Bytecode, usually a const array in flash
+ * @param len Size of the program in bytes
+ *
+ * @retval 0 The program was started
+ * @retval -EINVAL Invalid LED index or malformed program
+ * @retval -EBUSY A program is already running on this LED
+ * @retval -ENOMEM CONFIG_APP_ANIM_MAX_PROGRAMS programs are already running
+ */
+int led_anim_start(size_t led, const uint8_t *program, size_t len);
+
+/**
+ * @brief Start a program on an LED and get told when it ends
+ *
+ * Same as led_anim_start(), with a handle that is completed with the
+ * result led_anim_wait() would return, in the way it was set up with (see
+ * led_notify.h). A thread can then follow the programs of many LEDs, and
+ * other events, with a single k_poll(). The handle is not touched if the
+ * program could not be started.
+ *
+ * @param led Index of the LED
+ * @param program Bytecode, usually a const array in flash
+ * @param len Size of the program in bytes
+ * @param notify Handle of the program, valid until it ends, or NULL
+ *
+ * @retval 0 The program was started
+ * @retval -EINVAL Invalid LED index or malformed program
+ * @retval -EBUSY A program is already running on this LED
+ * @retval -ENOMEM CONFIG_APP_ANIM_MAX_PROGRAMS programs are already running
+ */
+int led_anim_submit(size_t led, const uint8_t *program, size_t len, struct led_notify *notify);
+
+/**
+ * @brief Replace the program of an LED, cross-fading into the new one
+ *
+ * Like led_anim_start(), except that a program running on the LED is
+ * stopped, its waiters woken up with -ECANCELED, and that the LED does not
+ * jump: the first ramp of the new program (a SET, or the first segment of
+ * a RAMP) redirects the fade the LED is in with led_fade_retarget(),
+ * starting from the level it has reached, even in the middle of a ramp of
+ * the old program. That ramp takes @p duration_ms, or its own duration if
+ * longer.
+ *
+ * @param led Index of the LED
+ * @param program Bytecode, usually a const array in flash
+ * @param len Size of the program in bytes
+ * @param duration_ms Duration of the cross-fade
+ *
+ * @retval 0 The program was started
+ * @retval -EINVAL Invalid LED index or malformed program
+ * @retval -ENOMEM CONFIG_APP_ANIM_MAX_PROGRAMS programs are already running
+ */
+int led_anim_crossfade(size_t led, const uint8_t *program, size_t len, uint32_t duration_ms);
+
+/**
+ * @brief Stop the program of an LED
+ *
+ * A ramp already handed to the fade engine still ends; the LED then keeps
+ * its level. A program started on the LED before that redirects the ramp
+ * from where it is, as led_anim_crossfade() does. Waiters are woken up
+ * with -ECANCELED.
+ *
+ * @param led Index of the LED
+ *
+ * @retval 0 The program was stopped
+ * @retval -EINVAL Invalid LED index
+ * @retval -EALREADY No program runs on this LED
+ */
+int led_anim_stop(size_t led);
+
+/**
+ * @brief Check whether a program runs on an LED
+ */
+bool led_anim_is_running(size_t led);
+
+/**
+ * @brief Wait for the program of an LED to end
+ *
+ * @param led Index of the LED
+ * @param timeout How long to wait
+ *
+ * @retval 0 The program reached END
+ * @retval -EINVAL Invalid LED index, or no program was started on it
+ * @retval -EAGAIN The timeout expired first
+ * @retval -ECANCELED The program was stopped
+ * @retval -ELOOP The program looped without ever waiting
+ * @retval <0 Fade engine error that ended the program
+ */
+int led_anim_wait(size_t led, k_timeout_t timeout);
+
+/**
+ * @brief Read the interpreter statistics
+ */
+void led_anim_get_stats(struct led_anim_stats *stats);
+
+#endif /* LED_ANIM_H_ */
@@ -0,0 +1,390 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Zephyr LED API driver on the fade engine
+ *
+ * Blinking LEDs all hang off one LED scheduler entry, armed for the
+ * earliest of their next edges. Its handler toggles every LED due within
+ * the coalescing window, moves each one to its next edge on the grid of
+ * its period, and re-arms the entry once for the earliest of them. An LED
+ * served over a whole phase late starts its next phase from now rather
+ * than flashing through the edges it missed.
+ *
+ * The blink state and the level each LED should be at are changed under a
+ * lock, and the fade engine is called once it is released. Each change
+ * bumps the generation of the LED, so a writer whose level was overtaken
+ * by a newer one, such as a toggle racing led_off(), sees it and writes
+ * the current level again: the last request always wins. The lock is
+ * taken before the scheduler lock, never inside it.
+ */
+
+#define DT_DRV_COMPAT pwm_leds
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/led.h>
+#include <zephyr/spinlock.h>
+
+#include "led_api.h"
+#include "led_fade.h"
+#include "led_sched.h"
+
+struct led_api_config {
+    const struct pwm_dt_spec *specs;  /* PWM channel of each child */
+    uint16_t *leds;                   /* Fade engine LED of each child, set at init */
+    size_t num_leds;
+};
+
+/**
+ * @brief Blink state of one LED of the fade engine
+ */
+struct led_api_blink {
+    int64_t next;          /* Uptime in ticks of the next edge */
+    k_ticks_t on_ticks;    /* Length of the lit phase */
+    k_ticks_t off_ticks;   /* Length of the dark phase */
+    uint32_t gen;          /* Bumped on every change of level */
+    uint16_t level;        /* Level the LED should be at */
+    bool active;
+    bool lit;
+    bool retry;            /* The last edge did not go out: write it again */
+};
+
+/**
+ * @brief Edge of a blinking LED, written once the lock is released
+ */
+struct led_api_edge {
+    uint16_t led;
+    uint16_t level;
+    uint32_t gen;
+};
+
+static struct led_api_blink blinks[LED_FADE_NUM_LEDS];
+static struct led_sched_entry blink_entry;
+static int64_t blink_armed = INT64_MAX;  /* Deadline blink_entry is queued for */
+static size_t blinking;                  /* LEDs with an active blink */
+static struct k_spinlock lock;
+static bool started;
+
+static void led_api_blink_stop(size_t led);
+
+/**
+ * @brief Record a new level for an LED
+ *
+ * Called with the lock held.
+ *
+ * @return Generation to pass to led_api_write()
+ */
+static uint32_t led_api_change(size_t led, uint16_t level)
+{
+    blinks[led].level = level;
+
+    return ++blinks[led].gen;
+}
+
+/**
+ * @brief Move an LED to a level recorded by led_api_change()
+ *
+ * Called without the lock, through any fade running on the LED. If a
+ * newer level was recorded meanwhile, it may have been written before
+ * this one: the newer one is then written again, until the level written
+ * last is the current one.
+ *
+ * @param led Index of the LED
+ * @param gen Generation of @p level, updated to that of the level written last
+ * @param level Level to write
+ *
+ * @return Result of the last write
+ */
+static int led_api_write(size_t led, uint32_t *gen, uint16_t level)
+{
+    for (;;) {
+        int ret = led_fade_retarget(led, level, 0);
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        bool current = blinks[led].gen == *gen;
+
+        *gen = blinks[led].gen;
+        level = blinks[led].level;
+        k_spin_unlock(&lock, key);
+
+        if (current) {
+            return ret;
+        }
+    }
+}
+
+/**
+ * @brief Queue the blink entry for @p deadline if it is earlier
+ *
+ * Called with the lock held.
+ */
+static void led_api_blink_arm(int64_t deadline)
+{
+    if (deadline < blink_armed) {
+        blink_armed = deadline;
+        (void)led_sched_at(&blink_entry, blink_armed);
+    }
+}
+
+/**
+ * @brief Toggle the blinking LEDs that are due
+ *
+ * An edge the fade engine refuses with -EBUSY, while another caller has
+ * the LED, goes out again on the next frame. Any other error ends the
+ * blink.
+ */
+static void led_api_blink_step(struct led_sched_entry *entry)
+{
+    struct led_api_edge edges[ARRAY_SIZE(blinks)];
+    size_t count = 0;
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    int64_t now = k_uptime_ticks();
+    int64_t horizon = now + led_sched_window_ticks();
+    int64_t earliest = INT64_MAX;
+
+    for (size_t led = 0; led < ARRAY_SIZE(blinks); led++) {
+        struct led_api_blink *b = &blinks[led];
+
+        if (!b->active) {
+            continue;
+        }
+        if (b->next <= horizon) {
+            if (!b->retry) {
+                b->lit = !b->lit;
+            }
+            b->retry = false;
+            b->next += b->lit ? b->on_ticks : b->off_ticks;
+            if (b->next <= now) {
+                b->next = now + (b->lit ? b->on_ticks : b->off_ticks);
+            }
+            edges[count] = (struct led_api_edge){
+                .led = (uint16_t)led,
+                .level = b->lit ? FADE_STEPS : 0,
+            };
+            edges[count].gen = led_api_change(led, edges[count].level);
+            count++;
+        }
+        earliest = MIN(earliest, b->next);
+    }
+
+    blink_armed = earliest;
+    if (earliest != INT64_MAX) {
+        (void)led_sched_at(entry, earliest);
+    }
+    k_spin_unlock(&lock, key);
+
+    for (size_t k = 0; k < count; k++) {
+        struct led_api_edge *edge = &edges[k];
+        int ret = led_api_write(edge->led, &edge->gen, edge->level);
+
+        if (ret >= 0) {
+            continue;
+        }
+
+        key = k_spin_lock(&lock);
+        /* Unless the blink was changed or stopped since */
+        if (blinks[edge->led].active && blinks[edge->led].gen == edge->gen) {
+            if (ret == -EBUSY) {
+                blinks[edge->led].retry = true;
+                blinks[edge->led].next = k_uptime_ticks() +
+                                         MAX(k_ms_to_ticks_ceil64(FADE_STEP_MS), 1);
+                led_api_blink_arm(blinks[edge->led].next);
+            } else {
+                led_api_blink_stop(edge->led);
+            }
+        }
+        k_spin_unlock(&lock, key);
+    }
+}
+
+/**
+ * @brief Stop the blink of an LED, if any
+ *
+ * Called with the lock held.
+ */
+static void led_api_blink_stop(size_t led)
+{
+    if (!blinks[led].active) {
+        return;
+    }
+
+    blinks[led].active = false;
+    if (--blinking == 0) {
+        led_sched_cancel(&blink_entry);
+        blink_armed = INT64_MAX;
+    }
+}
+
+/**
+ * @brief Find the fade engine LED of a child of a device
+ *
+ * @return Index of the LED, or a negative error code
+ */
+static int led_api_lookup(const struct device *dev, uint32_t led)
+{
+    const struct led_api_config *config = dev->config;
+
+    if (led >= config->num_leds) {
+        return -EINVAL;
+    }
+    if (!started) {
+        return -EAGAIN;
+    }
+
+    return config->leds[led];
+}
+
+/**
+ * @brief Stop any blink and move an LED to a level
+ */
+static int led_api_set_level(const struct device *dev, uint32_t led, uint16_t level)
+{
+    int idx = led_api_lookup(dev, led);
+    k_spinlock_key_t key;
+    uint32_t gen;
+
+    if (idx < 0) {
+        return idx;
+    }
+
+    key = k_spin_lock(&lock);
+    led_api_blink_stop(idx);
+    gen = led_api_change(idx, level);
+    k_spin_unlock(&lock, key);
+
+    return led_api_write(idx, &gen, level);
+}
+
+static int led_api_on(const struct device *dev, uint32_t led)
+{
+    return led_api_set_level(dev, led, FADE_STEPS);
+}
+
+static int led_api_off(const struct device *dev, uint32_t led)
+{
+    return led_api_set_level(dev, led, 0);
+}
+
+static int led_api_set_brightness(const struct device *dev, uint32_t led, uint8_t value)
+{
+    if (value > LED_BRIGHTNESS_MAX) {
+        return -EINVAL;
+    }
+
+    return led_api_set_level(dev, led,
+                             DIV_ROUND_CLOSEST(value * FADE_STEPS, LED_BRIGHTNESS_MAX));
+}
+
+static int led_api_blink(const struct device *dev, uint32_t led, uint32_t delay_on,
+                         uint32_t delay_off)
+{
+    int idx = led_api_lookup(dev, led);
+    struct led_api_blink *b;
+    k_spinlock_key_t key;
+    uint32_t gen;
+    int ret;
+
+    if (idx < 0) {
+        return idx;
+    }
+    if (delay_on == 0) {
+        return led_api_off(dev, led);
+    }
+    if (delay_off == 0) {
+        return led_api_on(dev, led);
+    }
+    b = &blinks[idx];
+
+    key = k_spin_lock(&lock);
+    if (!b->active) {
+        b->active = true;
+        blinking++;
+    }
+    b->on_ticks = MAX(k_ms_to_ticks_ceil64(delay_on), 1);
+    b->off_ticks = MAX(k_ms_to_ticks_ceil64(delay_off), 1);
+    b->lit = true;
+    b->retry = false;
+    b->next = k_uptime_ticks() + b->on_ticks;
+    led_api_blink_arm(b->next);
+    gen = led_api_change(idx, FADE_STEPS);
+    k_spin_unlock(&lock, key);
+
+    /* Lit right away */
+    ret = led_api_write(idx, &gen, FADE_STEPS);
+    if (ret < 0) {
+        key = k_spin_lock(&lock);
+        if (blinks[idx].gen == gen) {
+            led_api_blink_stop(idx);
+        }
+        k_spin_unlock(&lock, key);
+        return ret;
+    }
+
+    return 0;
+}
+
+int led_api_start(void)
+{
+    int ret = led_sched_reserve(1);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    led_sched_entry_init(&blink_entry, led_api_blink_step);
+    started = true;
+
+    return 0;
+}
+
+static int led_api_init(const struct device *dev)
+{
+    const struct led_api_config *config = dev->config;
+
+    for (size_t i = 0; i < config->num_leds; i++) {
+        const struct pwm_dt_spec *spec = &config->specs[i];
+        size_t led = 0;
+
+        if (!device_is_ready(spec->dev)) {
+            return -ENODEV;
+        }
+
+        /* The fade engine numbers the LEDs of every node in one table */
+        while (led < led_fade_count() && (led_fade_spec(led)->dev != spec->dev ||
+                                          led_fade_spec(led)->channel != spec->channel)) {
+            led++;
+        }
+        if (led == led_fade_count()) {
+            return -ENODEV;
+        }
+        config->leds[i] = (uint16_t)led;
+    }
+
+    return 0;
+}
+
+static const struct led_driver_api led_api_driver_api = {
+    .on = led_api_on,
+    .off = led_api_off,
+    .set_brightness = led_api_set_brightness,
+    .blink = led_api_blink,
+};
+
+#define LED_API_SPEC(node_id) PWM_DT_SPEC_GET(node_id),
+
+#define LED_API_DEFINE(n)                                                    \
+    static const struct pwm_dt_spec led_api_specs_##n[] = {                  \
+        DT_INST_FOREACH_CHILD_STATUS_OKAY(n, LED_API_SPEC)                   \
+    };                                                                       \
+    static uint16_t led_api_leds_##n[ARRAY_SIZE(led_api_specs_##n)];         \
+    static const struct led_api_config led_api_config_##n = {                \
+        .specs = led_api_specs_##n,                                          \
+        .leds = led_api_leds_##n,                                            \
+        .num_leds = ARRAY_SIZE(led_api_specs_##n),                           \
+    };                                                                       \
+    DEVICE_DT_INST_DEFINE(n, led_api_init, NULL, NULL,                       \
+                          &led_api_config_##n, POST_KERNEL,                  \
+                          CONFIG_LED_INIT_PRIORITY, &led_api_driver_api);
+
+DT_INST_FOREACH_STATUS_OKAY(LED_API_DEFINE)
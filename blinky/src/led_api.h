@@ -0,0 +1,50 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Zephyr LED API driver on the fade engine
+ *
+ * Every enabled "pwm-leds" node gets a device of the LED driver API, so
+ * other subsystems drive the LEDs with led_on(), led_off(),
+ * led_set_brightness() and led_blink() instead of calling into the sample:
+ *
+ *   const struct device *leds = DEVICE_DT_GET(DT_PARENT(DT_ALIAS(pwm_led0)));
+ *
+ *   led_blink(leds, 0, 100, 900);
+ *
+ * LEDs are numbered per device, in the order of the children of the node,
+ * and mapped to the fade engine LED they share the PWM channel with.
+ * Brightness goes up to LED_BRIGHTNESS_MAX, mapped to the nearest fade
+ * step, so it is perceptually even like the fades.
+ *
+ * Changes, blink edges included, go through led_fade_retarget(): they take
+ * constant time, may be made from any context, and redirect an LED that
+ * is fading. The LED API and the fade engine share the LEDs, the last call
+ * winning, even between calls racing each other. An edge the fade engine
+ * refuses with -EBUSY, while another caller holds the LED, goes out again
+ * a frame later; a blink ends on any other error.
+ *
+ * Blinking takes no thread and no timer per LED: a single entry of the LED
+ * scheduler (led_sched.h) toggles every blinking LED due, one edge after
+ * the other on the absolute grid of its period, and then sleeps until the
+ * next edge of any of them. LEDs toggled in the same wakeup share it.
+ *
+ * Replaces the upstream LED_PWM driver, which binds to the same nodes.
+ */
+
+#ifndef LED_API_H_
+#define LED_API_H_
+
+/**
+ * @brief Let the LED API devices drive the LEDs
+ *
+ * The devices are bound to the LEDs at boot, but refuse calls with
+ * -EAGAIN until this is called, once, after led_fade_init().
+ *
+ * @retval 0 On success
+ * @retval -ENOMEM No LED scheduler entry left for blinking
+ */
+int led_api_start(void);
+
+#endif /* LED_API_H_ */
@@ -0,0 +1,205 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * LED command queue
+ *
+ * A producer first reserves room by incrementing the count of used slots,
+ * and gives it back if that went past the size of the ring. Once it holds
+ * a reservation, the slot at the position it claims from the tail has
+ * already been taken by the consumer: at most size reservations are held
+ * at once, and the consumer takes slots in order. The command is then
+ * copied in and published by storing its position in the slot, which the
+ * consumer checks before reading it.
+ *
+ * The consumer only gives a slot back, by decrementing the used count,
+ * after it has read the command, so a producer never overwrites a command
+ * being taken.
+ *
+ * The queue of the LED table is served by an LED scheduler entry. The
+ * producer that finds the queue empty queues the entry; the consumer
+ * queues it again for the next frame when commands are left behind, and
+ * postpones a wakeup that comes less than a frame after the previous
+ * batch. Producers thus take the scheduler lock at most once per batch,
+ * not once per command.
+ */
+
+#include "led_cmd.h"
+#include "led_fade.h"
+#include "led_sched.h"
+
+/* Commands taken from the queue at a time */
+#define LED_CMD_BATCH 16
+
+LED_CMD_QUEUE_DEFINE(cmd_leds, CONFIG_APP_LED_CMD_QUEUE_SIZE);
+
+static struct led_sched_entry drain_entry;
+static k_ticks_t frame_ticks;   /* Frame period in kernel ticks */
+static int64_t last_drain;      /* Uptime in ticks of the last batch */
+
+static struct {
+    atomic_t submitted;
+    atomic_t applied;
+    atomic_t errors;
+    atomic_t batches;
+    atomic_t max_batch;
+} stats;
+
+int led_cmd_put(struct led_cmd_queue *queue, const struct led_cmd *cmd)
+{
+    atomic_val_t used = atomic_inc(&queue->used);
+    struct led_cmd_slot *slot;
+    uint32_t pos;
+
+    if (used >= (atomic_val_t)queue->size) {
+        atomic_dec(&queue->used);
+        atomic_inc(&queue->dropped);
+        return -ENOBUFS;
+    }
+
+    pos = (uint32_t)atomic_inc(&queue->tail);
+    slot = &queue->slots[pos & (queue->size - 1)];
+    slot->cmd = *cmd;
+    atomic_set(&slot->seq, (atomic_val_t)(uint32_t)(pos + 1));
+
+    return (int)used + 1;
+}
+
+size_t led_cmd_get(struct led_cmd_queue *queue, struct led_cmd *cmds, size_t max)
+{
+    size_t n = 0;
+
+    while (n < max) {
+        struct led_cmd_slot *slot = &queue->slots[queue->head & (queue->size - 1)];
+
+        if ((uint32_t)atomic_get(&slot->seq) != queue->head + 1) {
+            break;  /* Empty, or claimed and not published yet */
+        }
+        cmds[n++] = slot->cmd;
+        queue->head++;
+        atomic_dec(&queue->used);
+    }
+
+    return n;
+}
+
+static void led_cmd_apply(const struct led_cmd *cmd)
+{
+    uint32_t duration_ms = (cmd->op == LED_CMD_RAMP) ? cmd->duration_ms : 0;
+
+    if (led_fade_retarget(cmd->led, cmd->level, duration_ms) < 0) {
+        atomic_inc(&stats.errors);
+    } else {
+        atomic_inc(&stats.applied);
+    }
+}
+
+/**
+ * @brief Apply the queued commands, once per frame
+ */
+static void led_cmd_drain(struct led_sched_entry *entry)
+{
+    struct led_cmd batch[LED_CMD_BATCH];
+    int64_t now = k_uptime_ticks();
+    size_t taken = 0;
+    size_t n;
+
+    if (now - last_drain < frame_ticks) {
+        /* Queued again by a producer right after a batch */
+        (void)led_sched_at(entry, last_drain + frame_ticks);
+        return;
+    }
+    last_drain = now;
+
+    /* No more than a queue full, so producers cannot hold the work queue */
+    do {
+        n = led_cmd_get(&cmd_leds, batch, MIN(ARRAY_SIZE(batch), cmd_leds.size - taken));
+        for (size_t i = 0; i < n; i++) {
+            led_cmd_apply(&batch[i]);
+        }
+        taken += n;
+    } while (n == ARRAY_SIZE(batch));
+
+    if (taken != 0) {
+        atomic_inc(&stats.batches);
+        if (taken > (size_t)atomic_get(&stats.max_batch)) {
+            atomic_set(&stats.max_batch, (atomic_val_t)taken);
+        }
+    }
+
+    /* Left behind, not published yet, or queued while this batch ran */
+    if (atomic_get(&cmd_leds.used) != 0) {
+        (void)led_sched_at(entry, now + frame_ticks);
+    }
+}
+
+int led_cmd_init(void)
+{
+    int ret = led_sched_reserve(1);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    frame_ticks = MAX(k_ms_to_ticks_ceil64(FADE_STEP_MS), 1);
+    last_drain = -frame_ticks;
+    led_sched_entry_init(&drain_entry, led_cmd_drain);
+
+    return 0;
+}
+
+int led_cmd_submit(const struct led_cmd *cmd)
+{
+    int ret;
+
+    if (cmd->op > LED_CMD_RAMP || cmd->led >= led_fade_count() || cmd->level > FADE_STEPS) {
+        return -EINVAL;
+    }
+
+    ret = led_cmd_put(&cmd_leds, cmd);
+    if (ret < 0) {
+        return ret;
+    }
+    atomic_inc(&stats.submitted);
+
+    if (ret == 1) {
+        /* First in an empty queue: wake the consumer */
+        (void)led_sched_at(&drain_entry, k_uptime_ticks());
+    }
+
+    return 0;
+}
+
+int led_cmd_set(size_t led, uint16_t level)
+{
+    struct led_cmd cmd = {
+        .op = LED_CMD_SET,
+        .led = (uint16_t)MIN(led, UINT16_MAX),
+        .level = level,
+    };
+
+    return led_cmd_submit(&cmd);
+}
+
+int led_cmd_ramp(size_t led, uint16_t to, uint32_t duration_ms)
+{
+    struct led_cmd cmd = {
+        .op = LED_CMD_RAMP,
+        .led = (uint16_t)MIN(led, UINT16_MAX),
+        .level = to,
+        .duration_ms = duration_ms,
+    };
+
+    return led_cmd_submit(&cmd);
+}
+
+void led_cmd_get_stats(struct led_cmd_stats *out)
+{
+    out->submitted = (uint32_t)atomic_get(&stats.submitted);
+    out->dropped = (uint32_t)atomic_get(&cmd_leds.dropped);
+    out->applied = (uint32_t)atomic_get(&stats.applied);
+    out->errors = (uint32_t)atomic_get(&stats.errors);
+    out->batches = (uint32_t)atomic_get(&stats.batches);
+    out->max_batch = (uint32_t)atomic_get(&stats.max_batch);
+}
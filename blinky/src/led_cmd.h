@@ -0,0 +1,175 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * LED command queue
+ *
+ * Threads and interrupt handlers that want to change an LED queue a
+ * command instead of calling into the fade engine themselves. The queue is
+ * a ring of slots with a single consumer:
+ *
+ *   - led_cmd_put() is wait-free: a fixed number of atomic operations
+ *     reserves room, claims the next slot and publishes the command in it,
+ *     with no lock and no retry loop, whatever the other producers do.
+ *   - led_cmd_get() takes the published commands in order, as a batch.
+ *
+ * Commands are taken in the order their slots were claimed. A producer
+ * preempted between claiming its slot and publishing it holds up the
+ * commands queued after its own until it resumes; they are not lost.
+ *
+ * The queue of the LED table (led_cmd_submit() and friends) is drained by
+ * the LED scheduler, at most once per frame: the commands queued during a
+ * frame are applied together, in order, at the start of the next one.
+ */
+
+#ifndef LED_CMD_H_
+#define LED_CMD_H_
+
+#include <zephyr/kernel.h>
+
+/**
+ * @brief Command operations
+ */
+enum led_cmd_op {
+    LED_CMD_SET,   /* Go to the level now */
+    LED_CMD_RAMP,  /* Ramp to the level over the duration */
+};
+
+/**
+ * @brief One LED command
+ */
+struct led_cmd {
+    uint8_t op;            /* enum led_cmd_op */
+    uint16_t led;          /* Index of the LED */
+    uint16_t level;        /* Target level (0..FADE_STEPS) */
+    uint32_t duration_ms;  /* Duration of LED_CMD_RAMP */
+};
+
+/**
+ * @brief Slot of the ring
+ *
+ * seq is the position the slot was last published for, plus one: the
+ * consumer knows a slot holds the command it expects next when seq is its
+ * position plus one.
+ */
+struct led_cmd_slot {
+    atomic_t seq;
+    struct led_cmd cmd;
+};
+
+/**
+ * @brief Queue state, defined with LED_CMD_QUEUE_DEFINE()
+ */
+struct led_cmd_queue {
+    struct led_cmd_slot *slots;
+    size_t size;       /* Number of slots, a power of two */
+    atomic_t used;     /* Slots reserved by producers and not taken yet */
+    atomic_t tail;     /* Position of the next slot to claim */
+    uint32_t head;     /* Position of the next slot to take, consumer only */
+    atomic_t dropped;  /* Commands refused because the queue was full */
+};
+
+/**
+ * @brief Define a static command queue and its slots
+ *
+ * @param name Name of the struct led_cmd_queue
+ * @param _size Number of slots, a power of two
+ */
+#define LED_CMD_QUEUE_DEFINE(name, _size)                                  \
+    BUILD_ASSERT(IS_POWER_OF_TWO(_size), "size must be a power of two");   \
+    static struct led_cmd_slot _CONCAT(name, _slots)[_size];               \
+    static struct led_cmd_queue name = {                                   \
+        .slots = _CONCAT(name, _slots),                                    \
+        .size = (_size),                                                   \
+    }
+
+/**
+ * @brief Queue a command
+ *
+ * Wait-free, and may be called from any context, including interrupts, by
+ * any number of producers at once.
+ *
+ * @param queue Queue
+ * @param cmd Command, copied into the queue
+ *
+ * @return Number of commands in the queue with this one (1 if it was empty)
+ * @retval -ENOBUFS The queue is full; the command was dropped
+ */
+int led_cmd_put(struct led_cmd_queue *queue, const struct led_cmd *cmd);
+
+/**
+ * @brief Take a batch of commands, oldest first
+ *
+ * Stops at the first slot not published yet. Only one context may take
+ * from a given queue at a time.
+ *
+ * @param queue Queue
+ * @param cmds Filled with the commands taken
+ * @param max Room in @p cmds
+ *
+ * @return Number of commands taken
+ */
+size_t led_cmd_get(struct led_cmd_queue *queue, struct led_cmd *cmds, size_t max);
+
+/**
+ * @brief Statistics of the queue of the LED table
+ */
+struct led_cmd_stats {
+    uint32_t submitted;  /* Commands queued */
+    uint32_t dropped;    /* Commands refused, the queue being full */
+    uint32_t applied;    /* Commands handed to the fade engine */
+    uint32_t errors;     /* Commands the fade engine refused */
+    uint32_t batches;    /* Frames that applied commands */
+    uint32_t max_batch;  /* Most commands applied in one frame */
+};
+
+/**
+ * @brief Prepare the queue of the LED table
+ *
+ * Must be called once, after led_fade_init(), before any command is
+ * submitted.
+ *
+ * @retval 0 On success
+ * @retval -ENOMEM No LED scheduler entry left for the queue
+ */
+int led_cmd_init(void);
+
+/**
+ * @brief Queue a command for the LED table
+ *
+ * The command is applied at the start of the next frame, after those
+ * queued before it: LED_CMD_SET and LED_CMD_RAMP redirect the LED with
+ * led_fade_retarget(), from wherever it is, even if it is fading. May be
+ * called from any context, including interrupts.
+ *
+ * @param cmd Command
+ *
+ * @retval 0 The command was queued
+ * @retval -EINVAL Invalid operation, LED index or level
+ * @retval -ENOBUFS The queue is full
+ */
+int led_cmd_submit(const struct led_cmd *cmd);
+
+/**
+ * @brief Queue a change of level of an LED
+ *
+ * Same as led_cmd_submit() with LED_CMD_SET.
+ */
+int led_cmd_set(size_t led, uint16_t level);
+
+/**
+ * @brief Queue a ramp of an LED to a level
+ *
+ * Same as led_cmd_submit() with LED_CMD_RAMP.
+ */
+int led_cmd_ramp(size_t led, uint16_t to, uint32_t duration_ms);
+
+/**
+ * @brief Read the statistics of the queue of the LED table
+ *
+ * @param stats Filled with the statistics
+ */
+void led_cmd_get_stats(struct led_cmd_stats *stats);
+
+#endif /* LED_CMD_H_ */
@@ -0,0 +1,221 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Layered LED compositor
+ *
+ * A commit walks the dirty bitmap one word at a time and only visits its
+ * set bits, so its cost follows the number of channels written, not the
+ * number of channels. Each dirty channel is composited from its three
+ * cells with integer operations only: alpha is widened to 0..256 so the
+ * mix is a multiply and a shift, with no division.
+ *
+ * The sink is called with the compositor unlocked, on a copy of the run,
+ * so writers are never held up by the output, however slow it is.
+ */
+
+#include <zephyr/kernel.h>
+
+#include "led_comp.h"
+#include "led_fade.h"
+
+static int led_comp_to_fade(size_t first, const uint16_t *levels, size_t count,
+                            void *user_data)
+{
+    int ret = 0;
+
+    ARG_UNUSED(user_data);
+
+    /* A fading LED would drop its level: stop the fade there instead */
+    for (size_t i = 0; i < count; i++) {
+        if (led_fade_is_active(first + i)) {
+            int err = led_fade_retarget(first + i, levels[i], 0);
+
+            if (err < 0) {
+                ret = err;
+            }
+        }
+    }
+
+    /* Cannot fail: the levels and the range were checked on the way in */
+    (void)led_fade_set_levels(first, levels, count);
+
+    return ret;
+}
+
+LED_COMP_DEFINE(comp_leds, LED_FADE_NUM_LEDS, led_comp_to_fade, NULL);
+
+struct led_comp *led_comp_leds(void)
+{
+    return &comp_leds;
+}
+
+/**
+ * @brief Output level of a channel from its layers
+ */
+static uint16_t led_comp_blend(const struct led_comp_cell *cells)
+{
+    uint32_t out = 0;
+
+    for (size_t layer = 0; layer < LED_COMP_LAYERS; layer++) {
+        const struct led_comp_cell *cell = &cells[layer];
+
+        switch (cell->blend) {
+        case LED_COMP_BLEND_MAX:
+            out = MAX(out, cell->level);
+            break;
+        case LED_COMP_BLEND_ADD:
+            out = MIN(out + cell->level, FADE_STEPS);
+            break;
+        case LED_COMP_BLEND_ALPHA: {
+            /* 0..255 to 0..256, so that 255 fully hides the layers below */
+            uint32_t alpha = cell->alpha + (cell->alpha >> 7);
+
+            out = (out * (256 - alpha) + cell->level * alpha + 128) >> 8;
+            break;
+        }
+        default:
+            break;  /* Transparent */
+        }
+    }
+
+    return (uint16_t)out;
+}
+
+int led_comp_set(struct led_comp *comp, enum led_comp_layer layer, size_t channel,
+                 uint16_t level, enum led_comp_blend blend, uint8_t alpha)
+{
+    k_spinlock_key_t key;
+
+    if (layer >= LED_COMP_LAYERS || channel >= comp->channels || level > FADE_STEPS ||
+        blend > LED_COMP_BLEND_ALPHA) {
+        return -EINVAL;
+    }
+
+    struct led_comp_cell cell = {
+        .level = (blend == LED_COMP_BLEND_NONE) ? 0 : level,
+        .blend = blend,
+        .alpha = (blend == LED_COMP_BLEND_ALPHA) ? alpha : 0,
+    };
+
+    key = k_spin_lock(&comp->lock);
+    struct led_comp_cell *old = &comp->cells[channel][layer];
+
+    if (old->level != cell.level || old->blend != cell.blend || old->alpha != cell.alpha) {
+        *old = cell;
+        comp->dirty[channel / 32] |= BIT(channel % 32);
+    }
+    k_spin_unlock(&comp->lock, key);
+
+    return 0;
+}
+
+int led_comp_clear(struct led_comp *comp, enum led_comp_layer layer, size_t channel)
+{
+    return led_comp_set(comp, layer, channel, 0, LED_COMP_BLEND_NONE, 0);
+}
+
+int led_comp_clear_layer(struct led_comp *comp, enum led_comp_layer layer)
+{
+    if (layer >= LED_COMP_LAYERS) {
+        return -EINVAL;
+    }
+
+    for (size_t channel = 0; channel < comp->channels; channel++) {
+        (void)led_comp_clear(comp, layer, channel);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Changed output levels of adjacent channels, copied for the sink
+ */
+struct led_comp_run {
+    size_t first;
+    size_t count;
+    uint16_t levels[LED_COMP_RUN_MAX];
+};
+
+/**
+ * @brief Pass a run of channels on to the sink
+ *
+ * Called with the lock released. A run the sink refuses is dirty again and
+ * no longer known to be output, so the next commit passes it on again.
+ */
+static void led_comp_flush(struct led_comp *comp, struct led_comp_run *run)
+{
+    if (run->count == 0) {
+        return;
+    }
+
+    if (comp->sink(run->first, run->levels, run->count, comp->user_data) < 0) {
+        k_spinlock_key_t key = k_spin_lock(&comp->lock);
+
+        for (size_t channel = run->first; channel < run->first + run->count; channel++) {
+            comp->synced[channel / 32] &= ~BIT(channel % 32);
+            comp->dirty[channel / 32] |= BIT(channel % 32);
+        }
+        k_spin_unlock(&comp->lock, key);
+    }
+    run->count = 0;
+}
+
+size_t led_comp_commit(struct led_comp *comp)
+{
+    struct led_comp_run run = { .count = 0 };
+    size_t changed = 0;
+
+    for (size_t word = 0; word < DIV_ROUND_UP(comp->channels, 32); word++) {
+        k_spinlock_key_t key = k_spin_lock(&comp->lock);
+        uint32_t bits = comp->dirty[word];
+
+        comp->dirty[word] = 0;
+        while (bits != 0) {
+            size_t channel = word * 32 + find_lsb_set(bits) - 1;
+            uint16_t level = led_comp_blend(comp->cells[channel]);
+
+            bits &= bits - 1;
+            if (level == comp->out[channel] &&
+                (comp->synced[word] & BIT(channel % 32)) != 0) {
+                continue;  /* Written, but nothing visible changed */
+            }
+            comp->out[channel] = level;
+            comp->synced[word] |= BIT(channel % 32);
+            changed++;
+
+            /* Pass the changed channels on in runs of neighbours */
+            if (run.count == LED_COMP_RUN_MAX ||
+                (run.count != 0 && channel != run.first + run.count)) {
+                k_spin_unlock(&comp->lock, key);
+                led_comp_flush(comp, &run);
+                key = k_spin_lock(&comp->lock);
+            }
+            if (run.count == 0) {
+                run.first = channel;
+            }
+            run.levels[run.count++] = level;
+        }
+        k_spin_unlock(&comp->lock, key);
+    }
+    led_comp_flush(comp, &run);
+
+    return changed;
+}
+
+uint16_t led_comp_level(struct led_comp *comp, size_t channel)
+{
+    k_spinlock_key_t key;
+    uint16_t level;
+
+    if (channel >= comp->channels) {
+        return 0;
+    }
+
+    key = k_spin_lock(&comp->lock);
+    level = comp->out[channel];
+    k_spin_unlock(&comp->lock, key);
+
+    return level;
+}
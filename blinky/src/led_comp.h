@@ -0,0 +1,208 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Layered LED compositor
+ *
+ * Several sources can drive the same LEDs without overwriting each other:
+ * each one writes its own layer, and the compositor combines the layers of
+ * every channel, from the bottom up, into the level that is output. A
+ * notification written on the alert layer over an ambient pattern on the
+ * base layer thus hides it only while it is set; once cleared, the ambient
+ * level shows again exactly as it was, since nothing ever wrote over it.
+ *
+ * Each cell, one per channel and layer, holds a level (0..FADE_STEPS) and
+ * how it blends with what the layers below it give:
+ *
+ *   NONE   The layer leaves the channel alone (transparent)
+ *   MAX    The brighter of the cell and the layers below
+ *   ADD    Their sum, saturated at FADE_STEPS
+ *   ALPHA  The cell over the layers below, mixed by its alpha (0..255):
+ *          255 hides them, 0 leaves them unchanged
+ *
+ * Writes only mark their channel dirty. led_comp_commit() then composites
+ * the dirty channels alone, and passes on only those whose output level
+ * changed, in runs of adjacent channels: a frame where nothing visible
+ * changed costs no output at all. A channel is always passed on the first
+ * time it is committed, and again on the next commit if its sink refused
+ * it, so the compositor never assumes an output it did not get through.
+ *
+ * The compositor of the LED table (led_comp_leds()) outputs through
+ * led_fade_set_levels(), so every commit reaches the LEDs of a controller
+ * in the same PWM period. Its scope is the levels written to its layers,
+ * and nothing else: fades, animation programs, the LED API and the stream
+ * are not rendered into a layer. They drive the LEDs directly, outside of
+ * it, and the last writer wins. A level it passes on to an LED that is
+ * fading stops the fade there; a change made by another writer since then
+ * stays until the compositor next changes that LED.
+ */
+
+#ifndef LED_COMP_H_
+#define LED_COMP_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+
+/**
+ * @brief Layers, from the bottom up
+ */
+enum led_comp_layer {
+    LED_COMP_LAYER_BASE,    /* Ambient pattern */
+    LED_COMP_LAYER_EFFECT,  /* Effects over it */
+    LED_COMP_LAYER_ALERT,   /* Short notifications, over everything */
+    LED_COMP_LAYERS,
+};
+
+/**
+ * @brief How a cell blends with the layers below it
+ */
+enum led_comp_blend {
+    LED_COMP_BLEND_NONE,
+    LED_COMP_BLEND_MAX,
+    LED_COMP_BLEND_ADD,
+    LED_COMP_BLEND_ALPHA,
+};
+
+/**
+ * @brief Level of one channel on one layer
+ */
+struct led_comp_cell {
+    uint16_t level;  /* 0..FADE_STEPS */
+    uint8_t blend;   /* enum led_comp_blend */
+    uint8_t alpha;   /* Opacity of LED_COMP_BLEND_ALPHA, 0..255 */
+};
+
+/* Most channels passed on to the sink in one call */
+#define LED_COMP_RUN_MAX 32
+
+/**
+ * @brief Receive the output levels of a run of adjacent channels
+ *
+ * Called by led_comp_commit(), in its context, with the compositor
+ * unlocked: it may take locks of its own, and a write it makes to the
+ * compositor is composited on the next commit. Longer runs are split into
+ * calls of at most LED_COMP_RUN_MAX channels.
+ *
+ * @param first First channel of the run
+ * @param levels Output levels (0..FADE_STEPS) of the run
+ * @param count Number of channels in the run
+ * @param user_data Pointer given with the compositor
+ *
+ * @retval 0 Every level of the run was taken
+ * @retval <0 Some were not: the run is passed on again on the next commit
+ */
+typedef int (*led_comp_sink_t)(size_t first, const uint16_t *levels, size_t count,
+                               void *user_data);
+
+/**
+ * @brief Compositor state, defined with LED_COMP_DEFINE()
+ *
+ * Cells are stored channel by channel, so compositing one channel reads
+ * its layers from one place.
+ */
+struct led_comp {
+    struct led_comp_cell (*cells)[LED_COMP_LAYERS];  /* Layers of each channel */
+    uint16_t *out;          /* Output level of each channel, as last passed on */
+    uint32_t *dirty;        /* Bitmap of the channels written since the last commit */
+    uint32_t *synced;       /* Bitmap of the channels whose sink took their output */
+    size_t channels;
+    led_comp_sink_t sink;
+    void *user_data;
+    struct k_spinlock lock;  /* Protects the cells, the bitmap and the output */
+};
+
+/**
+ * @brief Define a static compositor and its storage
+ *
+ * Every layer starts transparent, and every output at 0, not passed on yet.
+ *
+ * @param name Name of the struct led_comp
+ * @param _channels Number of channels
+ * @param _sink Function receiving the changed output levels
+ * @param _user_data Pointer passed to @p _sink
+ */
+#define LED_COMP_DEFINE(name, _channels, _sink, _user_data)                      \
+    static struct led_comp_cell _CONCAT(name, _cells)[_channels][LED_COMP_LAYERS]; \
+    static uint16_t _CONCAT(name, _out)[_channels];                              \
+    static uint32_t _CONCAT(name, _dirty)[DIV_ROUND_UP(_channels, 32)];          \
+    static uint32_t _CONCAT(name, _synced)[DIV_ROUND_UP(_channels, 32)];         \
+    static struct led_comp name = {                                              \
+        .cells = _CONCAT(name, _cells),                                          \
+        .out = _CONCAT(name, _out),                                              \
+        .dirty = _CONCAT(name, _dirty),                                          \
+        .synced = _CONCAT(name, _synced),                                        \
+        .channels = (_channels),                                                 \
+        .sink = (_sink),                                                         \
+        .user_data = (_user_data),                                               \
+    }
+
+/**
+ * @brief Compositor of the LED table
+ *
+ * One channel per LED, in the order of led_fade_count(), output through
+ * led_fade_set_levels(). Its sink refuses a run when the fade of one of
+ * its LEDs could not be stopped, which the controller may not allow while
+ * it plays the fade as a sequence.
+ */
+struct led_comp *led_comp_leds(void);
+
+/**
+ * @brief Write the cell of a channel on a layer
+ *
+ * Takes effect on the next led_comp_commit(). Writing a cell with what it
+ * already holds does not mark the channel dirty. May be called from any
+ * context, including interrupts.
+ *
+ * @param comp Compositor
+ * @param layer Layer to write
+ * @param channel Channel to write
+ * @param level Level (0..FADE_STEPS)
+ * @param blend How the level blends with the layers below;
+ *              LED_COMP_BLEND_NONE clears the cell
+ * @param alpha Opacity (0..255) of LED_COMP_BLEND_ALPHA, ignored otherwise
+ *
+ * @retval 0 On success
+ * @retval -EINVAL Invalid layer, channel, level or blend mode
+ */
+int led_comp_set(struct led_comp *comp, enum led_comp_layer layer, size_t channel,
+                 uint16_t level, enum led_comp_blend blend, uint8_t alpha);
+
+/**
+ * @brief Make a layer transparent on a channel
+ *
+ * Same as led_comp_set() with LED_COMP_BLEND_NONE.
+ *
+ * @retval 0 On success
+ * @retval -EINVAL Invalid layer or channel
+ */
+int led_comp_clear(struct led_comp *comp, enum led_comp_layer layer, size_t channel);
+
+/**
+ * @brief Make a layer transparent on every channel
+ *
+ * @retval 0 On success
+ * @retval -EINVAL Invalid layer
+ */
+int led_comp_clear_layer(struct led_comp *comp, enum led_comp_layer layer);
+
+/**
+ * @brief Composite the dirty channels and pass on those that changed
+ *
+ * Meant to be called once per frame, after the layers were written. Only
+ * one context may commit a given compositor at a time.
+ *
+ * @param comp Compositor
+ *
+ * @return Number of channels passed on to the sink
+ */
+size_t led_comp_commit(struct led_comp *comp);
+
+/**
+ * @brief Output level of a channel as of the last commit
+ *
+ * @return Level (0..FADE_STEPS), or 0 for an invalid channel
+ */
+uint16_t led_comp_level(struct led_comp *comp, size_t channel);
+
+#endif /* LED_COMP_H_ */
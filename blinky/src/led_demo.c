@@ -0,0 +1,58 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Blocking LED helpers of the demo loop
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>  /* Console output functions */
+
+#include "led_demo.h"
+#include "led_fade.h"
+
+int fade_led(size_t led, bool fade_in)
+{
+    struct led_notify notify;
+    struct k_sem done;
+    int ret;
+
+    /*
+     * led_fade_submit() returns immediately and the fade engine steps the
+     * LED from the system work queue; this thread only waits for the end
+     */
+    k_sem_init(&done, 0, 1);
+    led_notify_init_sem(&notify, &done);
+    ret = led_fade_submit(led, fade_in ? 0 : FADE_STEPS, fade_in ? FADE_STEPS : 0,
+                          FADE_STEPS * FADE_STEP_MS, &notify);
+    if (ret == 0) {
+        (void)k_sem_take(&done, K_FOREVER);
+        ret = led_notify_result(&notify);
+    }
+
+    return ret;
+}
+
+void set_led_brightness(size_t led, uint8_t brightness)
+{
+    /* Convert percentage to pulse width in microseconds */
+    uint32_t pulse_width = (PWM_PERIOD_US * brightness) / 100;
+    
+    /*
+     * Apply the PWM setting immediately
+     * The fade engine skips the driver call if the LED already has it
+     */
+    int ret = led_fade_set_pulse(led, pulse_width);
+    if (ret < 0) {
+        printk("Error setting PWM brightness: %d\n", ret);
+    }
+}
+
+void turn_off_all_leds(void)
+{
+    /* Loop through all LEDs and set them to off */
+    for (size_t i = 0; i < led_fade_count(); i++) {
+        led_fade_set_pulse(i, 0);  /* 0 pulse width = LED off */
+    }
+}
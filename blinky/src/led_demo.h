@@ -0,0 +1,60 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Blocking LED helpers of the demo loop
+ *
+ * Thin wrappers over the fade engine, kept out of main.c so the self-checks
+ * can replay exactly what the demo does and compare the PWM output with
+ * golden traces.
+ */
+
+#ifndef LED_DEMO_H_
+#define LED_DEMO_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Fade LED in or out and wait for the fade to end
+ *
+ * The fade itself runs on the fade engine (led_fade_submit()); only the
+ * calling thread blocks. Code running several effects at once should
+ * submit them itself and wait for all of them with one k_poll(), rather
+ * than use a thread per effect.
+ *
+ * @param led Index of the LED in the LED table
+ * @param fade_in true for fade in (dark to bright), false for fade out (bright to dark)
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int fade_led(size_t led, bool fade_in);
+
+/**
+ * @brief Set LED brightness to specific percentage
+ *
+ * This function provides direct brightness control without fading animation.
+ * Useful for setting initial states or immediate brightness changes.
+ * It calls into the fade engine from the calling thread and fails on an
+ * LED that is fading: other threads and interrupt handlers should queue
+ * a led_cmd_set() instead, or go through the LED API device of the LED
+ * (led_api.h).
+ *
+ * @param led Index of the LED in the LED table
+ * @param brightness Brightness percentage (0-100)
+ *                   0 = completely off, 100 = maximum brightness
+ */
+void set_led_brightness(size_t led, uint8_t brightness);
+
+/**
+ * @brief Turn off all LEDs immediately
+ *
+ * Sets all LEDs to 0% brightness (pulse width = 0).
+ * Useful for initialization and cleanup. LEDs that are already off
+ * cost no driver call.
+ */
+void turn_off_all_leds(void);
+
+#endif /* LED_DEMO_H_ */
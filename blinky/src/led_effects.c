@@ -0,0 +1,90 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/sys/util.h>
+
+#include "led_anim.h"
+#include "led_effects.h"
+#include "led_fade.h"
+#include "led_patterns.h"  /* Generated from patterns/ at build time */
+
+/* Full fade of the demo loop, FADE_STEPS frames */
+#define LED_EFFECT_FADE_MS MIN(FADE_STEPS * FADE_STEP_MS, UINT16_MAX)
+
+/* Fade in, hold, fade out, then a pause before the next LED */
+static const uint8_t demo[] = {
+    LED_ANIM_RAMP(LED_ANIM_LEVEL_MAX, LED_EFFECT_FADE_MS, LED_ANIM_CURVE_LINEAR),
+    LED_ANIM_HOLD(200),
+    LED_ANIM_RAMP(0, LED_EFFECT_FADE_MS, LED_ANIM_CURVE_LINEAR),
+    LED_ANIM_HOLD(100),
+    LED_ANIM_END(),
+};
+
+/* Slow rise and fall, easing at both ends */
+static const uint8_t breathe[] = {
+    LED_ANIM_LOOP(0),
+        LED_ANIM_RAMP(LED_ANIM_LEVEL_MAX, 1500, LED_ANIM_CURVE_EASE_IN_OUT),
+        LED_ANIM_RAMP(0, 1500, LED_ANIM_CURVE_EASE_IN_OUT),
+        LED_ANIM_HOLD(500),
+    LED_ANIM_END_LOOP(),
+    LED_ANIM_END(),
+};
+
+/* 2 Hz on/off */
+static const uint8_t blink[] = {
+    LED_ANIM_LOOP(0),
+        LED_ANIM_SET(LED_ANIM_LEVEL_MAX),
+        LED_ANIM_HOLD(250),
+        LED_ANIM_SET(0),
+        LED_ANIM_HOLD(250),
+    LED_ANIM_END_LOOP(),
+    LED_ANIM_END(),
+};
+
+/* Two beats close together, then a rest */
+static const uint8_t heartbeat[] = {
+    LED_ANIM_LOOP(0),
+        LED_ANIM_RAMP(LED_ANIM_LEVEL_MAX, 80, LED_ANIM_CURVE_EASE_OUT),
+        LED_ANIM_RAMP(64, 120, LED_ANIM_CURVE_EASE_IN),
+        LED_ANIM_RAMP(LED_ANIM_LEVEL_MAX, 80, LED_ANIM_CURVE_EASE_OUT),
+        LED_ANIM_RAMP(0, 320, LED_ANIM_CURVE_EASE_IN),
+        LED_ANIM_HOLD(600),
+    LED_ANIM_END_LOOP(),
+    LED_ANIM_END(),
+};
+
+/* Pulse in step with every other LED running it, realigned each period */
+static const uint8_t sync_pulse[] = {
+    LED_ANIM_LOOP(0),
+        LED_ANIM_SYNC(1),
+        LED_ANIM_RAMP(LED_ANIM_LEVEL_MAX, 250, LED_ANIM_CURVE_EASE_OUT),
+        LED_ANIM_RAMP(0, 750, LED_ANIM_CURVE_EASE_IN),
+    LED_ANIM_END_LOOP(),
+    LED_ANIM_END(),
+};
+
+#define LED_EFFECT(program) { #program, program, sizeof(program) }
+
+const struct led_effect led_effects[] = {
+    LED_EFFECT(demo),
+    LED_EFFECT(breathe),
+    LED_EFFECT(blink),
+    LED_EFFECT(heartbeat),
+    LED_EFFECT(sync_pulse),
+    LED_PATTERN_EFFECTS
+};
+
+const size_t led_effects_count = ARRAY_SIZE(led_effects);
+
+const struct led_effect *led_effect_find(const char *name)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(led_effects); i++) {
+        if (strcmp(led_effects[i].name, name) == 0) {
+            return &led_effects[i];
+        }
+    }
+
+    return NULL;
+}
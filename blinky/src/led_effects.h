@@ -0,0 +1,44 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Built-in animation effects
+ *
+ * Programs for the animation interpreter (led_anim.h), stored in flash and
+ * looked up by name. Effects that loop forever run until led_anim_stop().
+ *
+ * The table holds the effects written in C in led_effects.c, followed by
+ * those compiled at build time from the pattern files of patterns/
+ * (scripts/gen_led_patterns.py), named after their file.
+ */
+
+#ifndef LED_EFFECTS_H_
+#define LED_EFFECTS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A named animation program
+ */
+struct led_effect {
+    const char *name;
+    const uint8_t *program;  /* Bytecode, see led_anim.h */
+    size_t len;              /* Size of the bytecode in bytes */
+};
+
+/* Table of the built-in effects, led_effects_count entries */
+extern const struct led_effect led_effects[];
+extern const size_t led_effects_count;
+
+/**
+ * @brief Find a built-in effect by name
+ *
+ * @param name Name of the effect
+ *
+ * @return The effect, or NULL if there is none with this name
+ */
+const struct led_effect *led_effect_find(const char *name);
+
+#endif /* LED_EFFECTS_H_ */
@@ -0,0 +1,1606 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Non-blocking LED fade engine
+ *
+ * Fades are stepped from the LED scheduler (led_sched.h), which arms a
+ * single kernel timeout for the earliest deadline of every animation and
+ * serves those due within its coalescing window in the same wakeup. The
+ * engine queues one entry per PWM controller, for the earliest next step
+ * of the LEDs fading on it. When the last fade finishes nothing is queued,
+ * so an idle engine costs nothing.
+ *
+ * Fades follow one grid of frames, absolute deadlines counted from boot,
+ * so the time spent in the PWM driver or in preemption never accumulates
+ * into the fade length, and LEDs started at different times still fall
+ * due on the same wakeups. A new fade waits for the next frame of the
+ * grid to start (its epoch); a redirected one moves right away and joins
+ * the grid on its next frame. A fade
+ * is only woken up for the frames that change it: the next deadline of an
+ * LED is the next frame on which its level rounds to another step, or the
+ * last frame of its ramp. A slow ramp thus costs one wakeup per visible
+ * step, not one per frame. If an LED is served so late that a whole frame
+ * has passed, it jumps straight to the current frame instead of replaying
+ * the stale ones.
+ *
+ * Levels are tracked in Q16.16 fixed point so a ramp of any length only
+ * needs one division when it starts, and one per step to find the frame
+ * of the next one. Turning a level into a pulse width is
+ * a lookup in the flash-resident gamma table and a multiply by the period
+ * of the channel in hardware cycles, queried once at init. Pulses then go
+ * to the driver in hardware cycles, so a frame has no division and no
+ * time-to-cycles conversion, and duty keeps full counter resolution.
+ *
+ * LEDs that share a PWM controller are committed together: serving the
+ * entry of a controller ends with one multi-channel update (see
+ * pwm_multi.h) carrying every channel of that controller that changed.
+ *
+ * When the controller of an LED can play a sequence of duty values on its
+ * own (see pwm_seq.h), a ramp is not stepped by the scheduler at all: all
+ * of its frames are computed once when it starts and handed over as one
+ * buffer.
+ * The CPU then only wakes up once, on completion. Ramps on other
+ * controllers, or longer than CONFIG_APP_FADE_SEQ_MAX_STEPS frames, are
+ * stepped from the scheduler as before.
+ *
+ * A running fade can be redirected with led_fade_retarget(): the channel
+ * simply gets a new ramp, starting from where it is and on a new grid of
+ * frames beginning now, and its group is queued for right away. A
+ * sequenced fade is stopped on the controller first, with the lock
+ * released so the driver is never called with interrupts masked, and
+ * continues on the scheduler.
+ *
+ * A fade started with led_fade_submit() carries the handle of its caller
+ * (led_notify.h), which is completed along with the waiters of
+ * led_fade_wait() and before the done callback, once the lock is released.
+ *
+ * With CONFIG_APP_FADE_DITHER, a sequenced ramp holds one entry per PWM
+ * period rather than per frame, and the entries of a frame are dithered:
+ * see level_to_dithered_pulses().
+ *
+ * With CONFIG_APP_PWM_STAGGER, the rising edges of the LEDs of a
+ * controller are spread over the PWM period instead of all falling on its
+ * start; see led_fade_stagger().
+ *
+ * With CONFIG_APP_PWM_PM, a PWM controller is only kept running while at
+ * least one of its LEDs is lit; see led_fade_power_up().
+ *
+ * Frames, LED steps and driver calls are trace points (led_trace.h) that
+ * compile out unless CONFIG_APP_FADE_TRACING is set.
+ */
+
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/spinlock.h>
+
+#include "led_fade.h"
+#include "led_gamma_table.h"  /* Generated at build time */
+#include "led_notify.h"
+#include "led_sched.h"
+#include "led_trace.h"
+#include "pwm_multi.h"
+#include "pwm_phase.h"
+#include "pwm_seq.h"
+
+BUILD_ASSERT(LED_GAMMA_TABLE_STEPS == FADE_STEPS,
+             "Generated gamma table does not match the configuration");
+
+/**
+ * @brief Last values programmed on a PWM channel
+ *
+ * Writes that would program the same period and pulse again are skipped,
+ * which saves a driver call and the peripheral access behind it.
+ */
+struct led_fade_shadow {
+    uint32_t period_cycles;  /* Period of the last successful write */
+    uint32_t pulse_cycles;   /* Pulse width of the last successful write */
+    bool valid;              /* Cleared until the first write and after errors */
+};
+
+/**
+ * @brief Runtime statistics of one LED, see struct led_fade_counters
+ *
+ * Only ever changed with atomic operations, never under the lock: counting
+ * adds no contention to the fade path, and readers cannot stall it.
+ */
+struct led_fade_stats {
+    atomic_t pwm_writes;
+    atomic_t pwm_skipped;
+    atomic_t pwm_errors;
+    atomic_t seq_plays;
+    atomic_t fades;
+    atomic_t fade_time_ms;
+    atomic_t steps;
+    atomic_t worst_late_us;
+    atomic_t late_hist[LED_FADE_LATE_BUCKETS];
+};
+
+/**
+ * @brief Per-LED fade state
+ *
+ * Entry i describes LED i of led_specs[].
+ */
+struct led_fade_channel {
+    uint32_t period_cycles;          /* PWM_PERIOD_US in hardware cycles */
+    struct led_fade_shadow shadow;   /* What the PWM channel is set to */
+    struct led_fade_stats stats;     /* Lock-free statistics */
+    struct k_sem done;               /* Given when the fade has finished */
+    int64_t start_ms;                /* Uptime when the fade was started */
+    int64_t epoch;                   /* Uptime in ticks of frame 0 of the ramp */
+    int64_t aimed;                   /* Uptime in ticks the ramp was set up at */
+    uint32_t frame;                  /* Frame level_q16 is the level of */
+    uint32_t next_frame;             /* Frame the LED is due to be stepped on */
+    uint32_t level_q16;              /* Level to program next, Q16.16 steps */
+    int32_t delta_q16;               /* Level change per frame, Q16.16 */
+    uint16_t target;                 /* Level the ramp ends on */
+    uint16_t frames_left;            /* Frames until target is reached */
+    uint32_t dither_q16;             /* Sigma-delta residue, fraction of a cycle */
+    bool active;                     /* A fade is running on this LED */
+    bool ending;                     /* Frame being committed is the last one */
+    bool sequenced;                  /* The controller plays this fade itself */
+    bool right_aligned;              /* Pulse ends with the period, see led_fade_stagger() */
+    bool powered;                    /* Holds a runtime PM reference on the controller */
+    bool pending;                    /* pending_level waits for the next commit */
+    bool writing;                    /* A level is being written outside of a fade */
+    uint16_t pending_level;          /* Level given by led_fade_set_levels() */
+    int error;                       /* PWM error that ended the fade, or 0 */
+    led_fade_done_cb_t done_cb;      /* Called when a fade ends, or NULL */
+    void *done_user_data;
+    struct led_notify *notify;       /* Handle of the fade, from led_fade_submit(), or NULL */
+};
+
+/*
+ * LED table, generated from the devicetree
+ * Every enabled child of every enabled "pwm-leds" node is one entry, in
+ * devicetree order. The table is const, so it stays in flash as one flat
+ * array, and its size is a compile-time constant: adding LEDs only takes an
+ * overlay change.
+ */
+#define LED_FADE_SPEC(node_id)       PWM_DT_SPEC_GET(node_id),
+#define LED_FADE_NODE_SPECS(node_id) DT_FOREACH_CHILD_STATUS_OKAY(node_id, LED_FADE_SPEC)
+
+BUILD_ASSERT(DT_HAS_COMPAT_STATUS_OKAY(pwm_leds), "No enabled pwm-leds node");
+
+static const struct pwm_dt_spec led_specs[] = {
+    DT_FOREACH_STATUS_OKAY(pwm_leds, LED_FADE_NODE_SPECS)
+};
+
+#define NUM_LEDS ARRAY_SIZE(led_specs)
+
+BUILD_ASSERT(NUM_LEDS == LED_FADE_NUM_LEDS, "LED table and LED count disagree");
+
+/* Multi-channel extension of the controller of each LED, or NULL */
+#define LED_FADE_MULTI_API(node_id)       PWM_MULTI_API_GET(DT_PWMS_CTLR(node_id)),
+#define LED_FADE_NODE_MULTI_APIS(node_id) DT_FOREACH_CHILD_STATUS_OKAY(node_id, LED_FADE_MULTI_API)
+
+static const struct pwm_multi_api *const led_multi_apis[] = {
+    DT_FOREACH_STATUS_OKAY(pwm_leds, LED_FADE_NODE_MULTI_APIS)
+};
+
+#ifdef CONFIG_APP_PWM_STAGGER
+/* Phase offset extension of the controller of each LED, or NULL */
+#define LED_FADE_PHASE_API(node_id)       PWM_PHASE_API_GET(DT_PWMS_CTLR(node_id)),
+#define LED_FADE_NODE_PHASE_APIS(node_id) DT_FOREACH_CHILD_STATUS_OKAY(node_id, LED_FADE_PHASE_API)
+
+static const struct pwm_phase_api *const led_phase_apis[] = {
+    DT_FOREACH_STATUS_OKAY(pwm_leds, LED_FADE_NODE_PHASE_APIS)
+};
+#endif
+
+#ifdef CONFIG_APP_FADE_HW_SEQ
+BUILD_ASSERT((FADE_STEP_MS * USEC_PER_MSEC) % PWM_PERIOD_US == 0,
+             "Sequenced fades need a frame of a whole number of PWM periods");
+
+/* Sequence playback extension of the controller of each LED, or NULL */
+#define LED_FADE_SEQ_API(node_id)       PWM_SEQ_API_GET(DT_PWMS_CTLR(node_id)),
+#define LED_FADE_NODE_SEQ_APIS(node_id) DT_FOREACH_CHILD_STATUS_OKAY(node_id, LED_FADE_SEQ_API)
+
+static const struct pwm_seq_api *const led_seq_apis[] = {
+    DT_FOREACH_STATUS_OKAY(pwm_leds, LED_FADE_NODE_SEQ_APIS)
+};
+
+/* PWM periods in a frame */
+#define SEQ_FRAME_PERIODS ((FADE_STEP_MS * USEC_PER_MSEC) / PWM_PERIOD_US)
+
+/* Sequence entries per frame: one per PWM period when dithering */
+#ifdef CONFIG_APP_FADE_DITHER
+#define SEQ_STEPS_PER_FRAME SEQ_FRAME_PERIODS
+#else
+#define SEQ_STEPS_PER_FRAME 1
+#endif
+
+/* Pulse width of every step of a sequenced ramp, read by the controller */
+static uint32_t seq_buffers[NUM_LEDS][CONFIG_APP_FADE_SEQ_MAX_STEPS * SEQ_STEPS_PER_FRAME + 1];
+#endif
+
+static struct led_fade_channel channels[NUM_LEDS];
+
+/*
+ * LED indexes grouped by PWM controller, built once by led_fade_init().
+ * Each group is stepped by its own scheduler entry and ends with a commit.
+ */
+static uint16_t led_order[NUM_LEDS];
+
+/**
+ * @brief LEDs of one PWM controller, served and committed together
+ */
+struct led_fade_group {
+    struct led_sched_entry entry;  /* Queued for the earliest step of its LEDs */
+    uint16_t first;                /* Position of its first LED in led_order[] */
+    uint16_t end;                  /* Position after its last LED */
+};
+
+static struct led_fade_group groups[NUM_LEDS];
+static size_t num_groups;
+static uint16_t led_groups[NUM_LEDS];  /* Group of each LED */
+
+/**
+ * @brief LED an update is queued for
+ */
+struct led_fade_update_led {
+    uint16_t led;  /* Index of the LED */
+    bool fading;   /* A step of its fade, not a level of led_fade_set_levels() */
+};
+
+/* Updates of the controller being committed, and the LED of each one */
+static struct pwm_multi_update updates[NUM_LEDS];
+static struct led_fade_update_led update_leds[NUM_LEDS];
+
+/* Idle LEDs taking a level from led_fade_set_levels() in the group being served */
+static uint16_t set_leds[NUM_LEDS];
+
+static struct k_spinlock lock;  /* Protects channels[] and the group entries */
+static atomic_t late_frames;    /* Frames skipped because an LED was served late */
+
+static k_ticks_t frame_ticks;  /* Frame period in kernel ticks */
+
+/**
+ * @brief Convert a Q16.16 level to a perceptually corrected pulse width
+ *
+ * @param ch Channel the pulse is for
+ * @param level_q16 Level in Q16.16 steps
+ *
+ * @return Pulse width in hardware cycles of the channel
+ */
+static uint32_t level_to_pulse_cycles(const struct led_fade_channel *ch,
+                                      uint32_t level_q16)
+{
+    uint32_t level = (level_q16 + (1U << 15)) >> 16;  /* Round to a step */
+
+    /* Q16 duty fraction times the period: a multiply and a shift */
+    return (uint32_t)(((uint64_t)led_gamma_table[level] * ch->period_cycles) >> 16);
+}
+
+/**
+ * @brief Pulse width to program for a pulse width of an LED
+ *
+ * Right-aligned LEDs are programmed with the complement of their pulse
+ * width, and inverted polarity (led_fade_hw_flags()).
+ */
+static inline uint32_t led_fade_hw_pulse(const struct led_fade_channel *ch,
+                                         uint32_t pulse_cycles)
+{
+    if (IS_ENABLED(CONFIG_APP_PWM_STAGGER) && ch->right_aligned) {
+        return ch->period_cycles - pulse_cycles;
+    }
+
+    return pulse_cycles;
+}
+
+/**
+ * @brief PWM flags to program for an LED
+ */
+static inline pwm_flags_t led_fade_hw_flags(size_t led)
+{
+    if (IS_ENABLED(CONFIG_APP_PWM_STAGGER) && channels[led].right_aligned) {
+        return led_specs[led].flags ^ PWM_POLARITY_INVERTED;
+    }
+
+    return led_specs[led].flags;
+}
+
+/**
+ * @brief Make sure the controller of an LED is running before a write
+ *
+ * Each LED holds one runtime PM reference on its controller, from before
+ * the first write that lights it until a write leaves it dark again
+ * (led_fade_power_down()). A controller whose LEDs are all dark thus has
+ * no reference left: it is suspended, its clock stopped and its pins in
+ * their sleep state, until the next write that lights one of them.
+ *
+ * Resuming may block, so a controller is never resumed from an interrupt:
+ * a fade submitted there, e.g. chained from the completion of a sequenced
+ * one, is refused here and falls back to the scheduler, which runs on the
+ * system work queue. Compiles to nothing without CONFIG_APP_PWM_PM.
+ *
+ * @retval 0 On success
+ * @retval -EWOULDBLOCK Called from an interrupt on a suspended controller
+ * @retval <0 Error from pm_device_runtime_get()
+ */
+static int led_fade_power_up(size_t led)
+{
+#ifdef CONFIG_APP_PWM_PM
+    struct led_fade_channel *ch = &channels[led];
+    int ret;
+
+    if (ch->powered) {
+        return 0;
+    }
+    if (k_is_in_isr()) {
+        return -EWOULDBLOCK;
+    }
+
+    ret = pm_device_runtime_get(led_specs[led].dev);
+    if (ret < 0) {
+        return ret;
+    }
+    ch->powered = true;
+#else
+    ARG_UNUSED(led);
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief Release the controller of an LED that was just left dark
+ *
+ * May run in interrupt context, at the end of a sequence, so the suspend
+ * itself is deferred.
+ */
+static void led_fade_power_down(size_t led)
+{
+#ifdef CONFIG_APP_PWM_PM
+    struct led_fade_channel *ch = &channels[led];
+
+    if (ch->powered) {
+        ch->powered = false;
+        (void)pm_device_runtime_put_async(led_specs[led].dev, K_NO_WAIT);
+    }
+#else
+    ARG_UNUSED(led);
+#endif
+}
+
+#ifdef CONFIG_APP_FADE_DITHER
+/**
+ * @brief Pulse widths of one frame, one per PWM period, dithered
+ *
+ * The gamma table gives the duty with 16 fractional bits, but a PWM period
+ * can only hold a whole number of counter cycles: with a 1 MHz counter and
+ * a 1000 us period that is 10 bits, and the lowest levels, where the eye is
+ * the most sensitive, are a handful of cycles apart.
+ *
+ * This is a first-order sigma-delta modulator: the fraction of a cycle
+ * that each period loses is accumulated in the channel, and whenever it
+ * adds up to a whole cycle, that period gets one cycle more. Averaged over
+ * a few periods the duty keeps all 16 bits of the table. The pulse only
+ * ever alternates between two adjacent values, every PWM period, far above
+ * the flicker fusion rate.
+ *
+ * The cost is bounded: one multiply per frame, then an add, a shift and a
+ * mask per period, with no division.
+ *
+ * @param ch Channel the pulses are for; its residue carries over frames
+ * @param level_q16 Level of the frame in Q16.16 steps
+ * @param pulses Filled with SEQ_FRAME_PERIODS pulse widths in cycles
+ */
+static void level_to_dithered_pulses(struct led_fade_channel *ch, uint32_t level_q16,
+                                     uint32_t *pulses)
+{
+    uint32_t level = (level_q16 + (1U << 15)) >> 16;
+    uint64_t pulse_q16 = (uint64_t)led_gamma_table[level] * ch->period_cycles;
+    uint32_t pulse = (uint32_t)(pulse_q16 >> 16);
+    uint32_t fraction = (uint32_t)pulse_q16 & 0xffff;
+
+    for (uint32_t p = 0; p < SEQ_FRAME_PERIODS; p++) {
+        ch->dither_q16 += fraction;
+        pulses[p] = pulse + (ch->dither_q16 >> 16);  /* Never above the period */
+        ch->dither_q16 &= 0xffff;
+    }
+}
+#endif /* CONFIG_APP_FADE_DITHER */
+
+/**
+ * @brief Program a pulse width unless the channel already has it
+ *
+ * Single-channel path used by led_fade_set_pulse(). Only one context
+ * writes a given channel at a time: the scheduler while the LED fades or
+ * takes a level from led_fade_set_levels(), led_fade_set_pulse()
+ * otherwise. The writing flag of the channel keeps the last two apart.
+ *
+ * @param led Index of the LED to program
+ * @param pulse_cycles Pulse width in hardware cycles
+ *
+ * @return 0 on success (written or skipped), PWM error code otherwise
+ */
+static int led_fade_write(size_t led, uint32_t pulse_cycles)
+{
+    const struct pwm_dt_spec *spec = &led_specs[led];
+    struct led_fade_channel *ch = &channels[led];
+    bool dark = pulse_cycles == 0;
+    int ret;
+
+    pulse_cycles = led_fade_hw_pulse(ch, pulse_cycles);
+    if (ch->shadow.valid && ch->shadow.period_cycles == ch->period_cycles &&
+        ch->shadow.pulse_cycles == pulse_cycles) {
+        atomic_inc(&ch->stats.pwm_skipped);  /* Nothing would change */
+        return 0;
+    }
+
+    ret = led_fade_power_up(led);
+    if (ret == 0) {
+        /* Already in cycles: no unit conversion in the driver path */
+        LED_TRACE_PWM_ENTER(led, 1);
+        ret = pwm_set_cycles(spec->dev, spec->channel, ch->period_cycles,
+                             pulse_cycles, led_fade_hw_flags(led));
+        LED_TRACE_PWM_EXIT(led, 1, ret);
+    }
+    if (ret < 0) {
+        atomic_inc(&ch->stats.pwm_errors);
+        /* The hardware state is unknown now: force the next write out */
+        ch->shadow.valid = false;
+        return ret;
+    }
+
+    atomic_inc(&ch->stats.pwm_writes);
+    ch->shadow.period_cycles = ch->period_cycles;
+    ch->shadow.pulse_cycles = pulse_cycles;
+    ch->shadow.valid = true;
+    if (dark) {
+        led_fade_power_down(led);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief End the fade on a channel and wake up its waiters
+ *
+ * Called with the lock held, so a new fade cannot slip in before the
+ * waiters are released.
+ *
+ * @param ch Channel whose fade ended
+ * @param error 0 if the ramp completed, PWM error code otherwise
+ * @param user_data Filled with the pointer to pass to the callback
+ * @param notify Filled with the handle to complete once the lock is
+ *               released, or NULL
+ *
+ * @return Done callback to call once the lock is released, or NULL
+ */
+static led_fade_done_cb_t led_fade_end(struct led_fade_channel *ch, int error,
+                                       void **user_data, struct led_notify **notify)
+{
+    LED_TRACE_DONE(ch - channels, error);
+    atomic_inc(&ch->stats.fades);
+    atomic_add(&ch->stats.fade_time_ms, (atomic_val_t)(k_uptime_get() - ch->start_ms));
+    ch->active = false;
+    ch->ending = false;
+    ch->error = error;
+    k_sem_give(&ch->done);
+
+    *notify = ch->notify;
+    ch->notify = NULL;
+    *user_data = ch->done_user_data;
+
+    return ch->done_cb;
+}
+
+/**
+ * @brief Finish the fade on a channel and wake up its waiters
+ *
+ * @param ch Channel whose fade ended
+ * @param error 0 if the ramp completed, PWM error code otherwise
+ */
+static void led_fade_finish(struct led_fade_channel *ch, int error)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    struct led_notify *notify;
+    void *user_data;
+    led_fade_done_cb_t cb = led_fade_end(ch, error, &user_data, &notify);
+
+    k_spin_unlock(&lock, key);
+
+    /* Outside the lock: both may start the next fade right away */
+    led_notify_complete(notify, error);
+    if (cb != NULL) {
+        cb(ch - channels, error, user_data);
+    }
+}
+
+/**
+ * @brief Finish the fade on a channel once its last frame is out
+ *
+ * Unless the fade was retargeted since that frame was computed: it then
+ * goes on with its new ramp.
+ */
+static void led_fade_finish_last(struct led_fade_channel *ch)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    struct led_notify *notify = NULL;
+    void *user_data = NULL;
+    led_fade_done_cb_t cb = NULL;
+
+    if (ch->ending) {
+        cb = led_fade_end(ch, 0, &user_data, &notify);
+    }
+    k_spin_unlock(&lock, key);
+
+    led_notify_complete(notify, 0);
+    if (cb != NULL) {
+        cb(ch - channels, 0, user_data);
+    }
+}
+
+/**
+ * @brief Account a write of a channel that failed
+ *
+ * The fade the write was a step of ends with the error. A level of
+ * led_fade_set_levels() has no waiter to report it to: the error is only
+ * counted.
+ *
+ * @param ch Channel that was written
+ * @param fading The write was a step of the fade of the channel
+ * @param error PWM error code
+ */
+static void led_fade_write_failed(struct led_fade_channel *ch, bool fading, int error)
+{
+    atomic_inc(&ch->stats.pwm_errors);
+    /* The hardware state is unknown now: force the next write out */
+    ch->shadow.valid = false;
+    if (fading) {
+        led_fade_finish(ch, error);
+    }
+}
+
+/**
+ * @brief Queue the new pulse of an LED for the commit of its controller
+ *
+ * Nothing is queued if the channel already has this pulse width.
+ *
+ * @param led Index of the LED
+ * @param pulse_cycles Pulse width in hardware cycles
+ * @param fading The pulse is a step of the fade of the LED
+ * @param count Number of updates already queued
+ *
+ * @return New number of queued updates
+ */
+static size_t led_fade_queue(size_t led, uint32_t pulse_cycles, bool fading, size_t count)
+{
+    const struct pwm_dt_spec *spec = &led_specs[led];
+    struct led_fade_channel *ch = &channels[led];
+    int ret;
+
+    pulse_cycles = led_fade_hw_pulse(ch, pulse_cycles);
+    if (ch->shadow.valid && ch->shadow.period_cycles == ch->period_cycles &&
+        ch->shadow.pulse_cycles == pulse_cycles) {
+        atomic_inc(&ch->stats.pwm_skipped);  /* Nothing would change */
+        if (ch->ending) {
+            led_fade_finish_last(ch);
+        }
+        return count;
+    }
+
+    /* Before the commit, which writes the whole controller */
+    ret = led_fade_power_up(led);
+    if (ret < 0) {
+        led_fade_write_failed(ch, fading, ret);
+        return count;
+    }
+
+    updates[count] = (struct pwm_multi_update){
+        .channel = spec->channel,
+        .period_cycles = ch->period_cycles,
+        .pulse_cycles = pulse_cycles,
+        .flags = led_fade_hw_flags(led),
+    };
+    update_leds[count] = (struct led_fade_update_led){
+        .led = (uint16_t)led,
+        .fading = fading,
+    };
+
+    return count + 1;
+}
+
+/**
+ * @brief Commit the queued updates of one controller in a single operation
+ *
+ * @param led Any LED of the controller
+ * @param count Number of queued updates
+ */
+static void led_fade_commit(size_t led, size_t count)
+{
+    int ret;
+
+    if (count == 0) {
+        return;  /* Nothing changed on this controller */
+    }
+
+    LED_TRACE_PWM_ENTER(led, count);
+    ret = pwm_multi_set_cycles(led_specs[led].dev, led_multi_apis[led], updates, count);
+    LED_TRACE_PWM_EXIT(led, count, ret);
+
+    /*
+     * A failure is only counted, and traced above: this runs on every
+     * frame, and the fade it ends reports the error to its waiters
+     */
+    for (size_t k = 0; k < count; k++) {
+        struct led_fade_channel *ch = &channels[update_leds[k].led];
+
+        if (ret < 0) {
+            led_fade_write_failed(ch, update_leds[k].fading, ret);
+            continue;
+        }
+
+        atomic_inc(&ch->stats.pwm_writes);
+        ch->shadow.period_cycles = updates[k].period_cycles;
+        ch->shadow.pulse_cycles = updates[k].pulse_cycles;
+        ch->shadow.valid = true;
+        if (led_fade_hw_pulse(ch, updates[k].pulse_cycles) == 0) {
+            led_fade_power_down(update_leds[k].led);
+        }
+        if (ch->ending) {
+            led_fade_finish_last(ch);
+        }
+    }
+}
+
+#ifdef CONFIG_APP_FADE_HW_SEQ
+/**
+ * @brief Completion of a sequenced ramp
+ *
+ * Called by the PWM driver, possibly from an interrupt.
+ */
+static void led_fade_seq_done(const struct device *dev, uint32_t channel,
+                              int status, void *user_data)
+{
+    size_t led = (size_t)(uintptr_t)user_data;
+    struct led_fade_channel *ch = &channels[led];
+
+    ARG_UNUSED(dev);
+    ARG_UNUSED(channel);
+
+    if (status < 0) {
+        atomic_inc(&ch->stats.pwm_errors);
+        ch->shadow.valid = false;
+    } else {
+        /* The channel holds the last frame of the sequence */
+        ch->level_q16 = (uint32_t)ch->target << 16;
+        ch->shadow.period_cycles = ch->period_cycles;
+        ch->shadow.pulse_cycles = seq_buffers[led][ch->frames_left * SEQ_STEPS_PER_FRAME];
+        ch->shadow.valid = true;
+        if (led_fade_hw_pulse(ch, ch->shadow.pulse_cycles) == 0) {
+            led_fade_power_down(led);
+        }
+    }
+    led_fade_finish(ch, status);
+}
+
+/**
+ * @brief Hand a whole ramp over to the controller of the LED
+ *
+ * The buffer holds exactly the frames the scheduler would have stepped: the
+ * same Q16.16 stepping, the same gamma lookup, ending on the target. When
+ * dithering, each frame is instead SEQ_FRAME_PERIODS dithered entries, one
+ * per PWM period; the final entry, which the channel keeps once the
+ * sequence is over, is the plain pulse width of the target.
+ *
+ * @param led Index of an LED whose ramp was just set up
+ *
+ * @retval 0 The controller plays the ramp
+ * @retval -ENOTSUP The controller cannot play sequences
+ * @retval -ENOMEM The ramp is longer than the sequence buffer
+ * @retval -EWOULDBLOCK Called from an interrupt on a suspended controller
+ * @retval <0 Error from the driver; nothing was played
+ */
+static int led_fade_play(size_t led)
+{
+    const struct pwm_dt_spec *spec = &led_specs[led];
+    struct led_fade_channel *ch = &channels[led];
+    uint32_t *buf = seq_buffers[led];
+    uint32_t frames = ch->frames_left;
+    uint32_t level_q16 = ch->level_q16;
+    int ret;
+
+    if (led_seq_apis[led] == NULL) {
+        return -ENOTSUP;
+    }
+    if (frames > CONFIG_APP_FADE_SEQ_MAX_STEPS) {
+        return -ENOMEM;
+    }
+
+    for (uint32_t n = 0; n < frames; n++) {
+#ifdef CONFIG_APP_FADE_DITHER
+        level_to_dithered_pulses(ch, level_q16, &buf[n * SEQ_STEPS_PER_FRAME]);
+#else
+        buf[n] = level_to_pulse_cycles(ch, level_q16);
+#endif
+        level_q16 += ch->delta_q16;
+    }
+    buf[frames * SEQ_STEPS_PER_FRAME] = level_to_pulse_cycles(ch, (uint32_t)ch->target << 16);
+    if (IS_ENABLED(CONFIG_APP_PWM_STAGGER) && ch->right_aligned) {
+        for (uint32_t n = 0; n <= frames * SEQ_STEPS_PER_FRAME; n++) {
+            buf[n] = led_fade_hw_pulse(ch, buf[n]);
+        }
+    }
+
+    const struct pwm_seq seq = {
+        .channel = spec->channel,
+        .period_cycles = ch->period_cycles,
+        .flags = led_fade_hw_flags(led),
+        .pulse_cycles = buf,
+        .len = frames * SEQ_STEPS_PER_FRAME + 1,
+        .step_periods = SEQ_FRAME_PERIODS / SEQ_STEPS_PER_FRAME,
+    };
+
+    /* The controller must run for the whole sequence; not from an interrupt */
+    ret = led_fade_power_up(led);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = led_seq_apis[led]->play(spec->dev, &seq, led_fade_seq_done,
+                                  (void *)(uintptr_t)led);
+    if (ret == 0) {
+        LED_TRACE_SEQ(led, frames);
+        atomic_inc(&ch->stats.pwm_writes);
+        atomic_inc(&ch->stats.seq_plays);
+    } else {
+        atomic_inc(&ch->stats.pwm_errors);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Stop the sequence playing the fade of an LED, where it is
+ *
+ * Called without the lock: the driver may take its own locks or wait on
+ * the controller. The channel keeps the step being played, and a stopped
+ * sequence never completes, so the fade stays sequenced until the caller
+ * takes the lock again.
+ *
+ * @param led Index of an LED whose fade is sequenced
+ * @param played Filled with the number of steps applied
+ *
+ * @retval 0 The sequence was stopped
+ * @retval -ENOTSUP The controller cannot stop a sequence
+ * @retval -EBUSY The sequence is just ending, or not playing yet
+ */
+static int led_fade_seq_stop(size_t led, size_t *played)
+{
+    const struct pwm_seq_api *api = led_seq_apis[led];
+    int ret;
+
+    if (api->stop == NULL) {
+        return -ENOTSUP;
+    }
+
+    *played = 0;
+    ret = api->stop(led_specs[led].dev, led_specs[led].channel, played);
+    if (ret < 0) {
+        return (ret == -EALREADY) ? -EBUSY : ret;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Take over the state a stopped sequence left an LED in
+ *
+ * Called with the lock held, after led_fade_seq_stop().
+ *
+ * @param led Index of the LED
+ * @param played Number of steps the sequence applied
+ *
+ * @return Level of the step the channel keeps, in Q16.16 steps
+ */
+static uint32_t led_fade_seq_stopped(size_t led, size_t played)
+{
+    struct led_fade_channel *ch = &channels[led];
+    uint32_t frame = (played - 1) / SEQ_STEPS_PER_FRAME;
+
+    ch->shadow.period_cycles = ch->period_cycles;
+    ch->shadow.pulse_cycles = seq_buffers[led][played - 1];
+    ch->shadow.valid = true;
+    if (frame >= ch->frames_left) {
+        return (uint32_t)ch->target << 16;
+    }
+
+    return ch->level_q16 + ch->delta_q16 * (int32_t)frame;
+}
+#endif /* CONFIG_APP_FADE_HW_SEQ */
+
+/**
+ * @brief Absolute deadline of a frame of the grid of a channel
+ *
+ * @return Uptime in ticks
+ */
+static inline int64_t led_fade_deadline(const struct led_fade_channel *ch, uint32_t n)
+{
+    return ch->epoch + (int64_t)n * frame_ticks;
+}
+
+/**
+ * @brief First frame of the shared grid at or after a time
+ *
+ * @param ticks Uptime in ticks
+ *
+ * @return Uptime in ticks
+ */
+static inline int64_t led_fade_grid_ceil(int64_t ticks)
+{
+    return DIV_ROUND_UP(ticks, (int64_t)frame_ticks) * frame_ticks;
+}
+
+/**
+ * @brief Put a channel on a new ramp, on the next frame of the shared grid
+ *
+ * Called with the lock held. The only division of the ramp: the per-frame
+ * increment. A jump, with no frames, is due at once.
+ *
+ * @param ch Channel to set up
+ * @param from_q16 Level of frame 0, in Q16.16 steps
+ * @param to Final level (0..FADE_STEPS)
+ * @param frames Frames until @p to is reached, 0 to go there at once
+ */
+static void led_fade_aim(struct led_fade_channel *ch, uint32_t from_q16, uint16_t to,
+                         uint32_t frames)
+{
+    ch->level_q16 = frames ? from_q16 : (uint32_t)to << 16;
+    ch->delta_q16 = frames ? ((int32_t)((uint32_t)to << 16) - (int32_t)from_q16) /
+                             (int32_t)frames : 0;
+    ch->target = to;
+    ch->frames_left = frames;
+    ch->aimed = k_uptime_ticks();
+    ch->epoch = frames ? led_fade_grid_ceil(ch->aimed) : ch->aimed;
+    ch->frame = 0;
+    ch->next_frame = 0;
+    ch->ending = false;
+}
+
+/**
+ * @brief Level a channel stepped by the scheduler has reached by now
+ *
+ * That is the level of the current frame of its grid, even when the
+ * channel was not woken up for it because it rounds to the step the LED
+ * already shows.
+ *
+ * @return Level in Q16.16 steps
+ */
+static uint32_t led_fade_level_now(const struct led_fade_channel *ch, int64_t now)
+{
+    if (now < led_fade_deadline(ch, ch->frame + 1)) {
+        return ch->level_q16;
+    }
+
+    uint32_t advance = (uint32_t)((now - ch->epoch) / frame_ticks) - ch->frame;
+
+    if (advance >= ch->frames_left) {
+        return (uint32_t)ch->target << 16;
+    }
+
+    return ch->level_q16 + ch->delta_q16 * (int32_t)advance;
+}
+
+/**
+ * @brief Work out which frame a channel is stepped to now
+ *
+ * Normally the frame it was due on. When it is served late by a whole
+ * frame or more, the frame is computed from the current time so the
+ * missed ones are skipped.
+ *
+ * @param ch Channel being served
+ * @param now Current uptime in ticks
+ *
+ * @return Number of frames since the previous step of the channel
+ */
+static uint32_t led_fade_catch_up(struct led_fade_channel *ch, int64_t now)
+{
+    uint32_t next = ch->next_frame;
+
+    if (now >= led_fade_deadline(ch, next + 1)) {
+        /* Behind schedule: the only division, and only when late */
+        uint32_t current = (uint32_t)((now - ch->epoch) / frame_ticks);
+
+        atomic_add(&late_frames, current - next);
+        next = current;
+    }
+
+    uint32_t advance = next - ch->frame;
+
+    ch->frame = next;
+
+    return advance;
+}
+
+/**
+ * @brief Advance a channel by a number of frames
+ *
+ * @return true if the channel reached the end of its ramp
+ */
+static bool led_fade_advance(struct led_fade_channel *ch, uint32_t advance)
+{
+    if (advance >= ch->frames_left) {
+        /* Land exactly on the target */
+        ch->frames_left = 0;
+        ch->level_q16 = (uint32_t)ch->target << 16;
+    } else {
+        ch->frames_left -= advance;
+        ch->level_q16 += ch->delta_q16 * (int32_t)advance;
+    }
+
+    return ch->frames_left == 0;
+}
+
+/**
+ * @brief Frames until the level of a channel rounds to another step
+ *
+ * The frames in between would program the same pulse width again, so
+ * the channel is not woken up for them. Never past the last frame of the
+ * ramp, which must be stepped on time to end the fade.
+ *
+ * @return Number of frames, at least 1
+ */
+static uint32_t led_fade_frames_to_change(const struct led_fade_channel *ch)
+{
+    uint32_t step_q16 = (ch->level_q16 + (1U << 15)) & ~0xffffU;  /* Rounded */
+    uint32_t distance_q16;
+    uint32_t speed_q16;
+
+    if (ch->delta_q16 > 0) {
+        /* Up to where it rounds to the next step */
+        distance_q16 = step_q16 + (1U << 15) - ch->level_q16;
+        speed_q16 = (uint32_t)ch->delta_q16;
+    } else if (ch->delta_q16 < 0) {
+        /* Down to below where it rounds to this step */
+        distance_q16 = ch->level_q16 + (1U << 15) + 1 - step_q16;
+        speed_q16 = (uint32_t)-ch->delta_q16;
+    } else {
+        return MAX(ch->frames_left, 1U);
+    }
+
+    return CLAMP(DIV_ROUND_UP(distance_q16, speed_q16), 1U, MAX(ch->frames_left, 1U));
+}
+
+/**
+ * @brief Account one step of a channel programmed @p late_us after its deadline
+ *
+ * Lock-free: the group entry of an LED is the only context that steps it,
+ * and the maximum is kept with a compare-and-swap loop that only retries if
+ * a reset raced with it.
+ */
+static void led_fade_record_step(struct led_fade_channel *ch, uint32_t late_us)
+{
+    size_t bucket = 0;
+    atomic_val_t worst = atomic_get(&ch->stats.worst_late_us);
+
+    while (bucket < LED_FADE_LATE_BUCKETS - 1 &&
+           late_us >= LED_FADE_LATE_BUCKET_LIMIT_US(bucket)) {
+        bucket++;
+    }
+    atomic_inc(&ch->stats.steps);
+    atomic_inc(&ch->stats.late_hist[bucket]);
+
+    while ((uint32_t)worst < late_us &&
+           !atomic_cas(&ch->stats.worst_late_us, worst, (atomic_val_t)late_us)) {
+        worst = atomic_get(&ch->stats.worst_late_us);
+    }
+}
+
+/**
+ * @brief Queue the entry of a group for the earliest step of its LEDs
+ *
+ * Called with the lock held. Nothing is queued when none of its LEDs is
+ * stepped from the scheduler.
+ */
+static void led_fade_arm(struct led_fade_group *group)
+{
+    int64_t earliest = INT64_MAX;
+
+    for (size_t pos = group->first; pos < group->end; pos++) {
+        const struct led_fade_channel *ch = &channels[led_order[pos]];
+
+        if (ch->active && !ch->sequenced) {
+            earliest = MIN(earliest, led_fade_deadline(ch, ch->next_frame));
+        } else if (ch->pending && !ch->active && !ch->writing) {
+            earliest = MIN(earliest, k_uptime_ticks());  /* Levels go out right away */
+        }
+    }
+
+    if (earliest != INT64_MAX) {
+        /* Cannot fail: led_fade_init() reserved a slot per group */
+        (void)led_sched_at(&group->entry, earliest);
+    }
+}
+
+/**
+ * @brief Step the due LEDs of one controller and commit them together
+ *
+ * Runs on the system work queue when the entry of the group is due. Every
+ * LED of the group due within the coalescing window is stepped, and every
+ * idle LED given a level by led_fade_set_levels() takes it, then the
+ * changed channels are committed in one operation. The channel state is
+ * sampled under the lock, but the PWM driver is called outside of it.
+ *
+ * @param entry Scheduler entry of the group
+ */
+static void led_fade_serve(struct led_sched_entry *entry)
+{
+    struct led_fade_group *group = CONTAINER_OF(entry, struct led_fade_group, entry);
+    int64_t now = k_uptime_ticks();
+    int64_t horizon = now + led_sched_window_ticks();
+    size_t count = 0;  /* Updates queued for the controller */
+    size_t set_count = 0;
+
+    for (size_t pos = group->first; pos < group->end; pos++) {
+        size_t i = led_order[pos];
+        struct led_fade_channel *ch = &channels[i];
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        bool due = ch->active && !ch->sequenced &&
+                   led_fade_deadline(ch, ch->next_frame) <= horizon;
+        uint32_t late_us = 0;
+
+        if (due) {
+            ch->ending = led_fade_advance(ch, led_fade_catch_up(ch, now));
+            ch->next_frame = ch->frame + led_fade_frames_to_change(ch);
+            /* A redirected ramp dates its first frame before it was set up */
+            int64_t deadline = MAX(led_fade_deadline(ch, ch->frame), ch->aimed);
+
+            if (now > deadline) {
+                late_us = k_ticks_to_us_floor32((uint32_t)(now - deadline));
+            }
+        }
+        /* Not while led_fade_set_pulse() writes the channel: it re-arms the group */
+        bool set = ch->pending && !ch->active && !ch->writing;
+
+        if (set) {
+            /* Kept as the level of the idle LED, which led_fade_retarget() starts from */
+            ch->level_q16 = (uint32_t)ch->pending_level << 16;
+            ch->ending = false;  /* No fade to finish */
+            ch->writing = true;
+            set_leds[set_count++] = i;
+        }
+        uint32_t level_q16 = ch->level_q16;
+
+        if (set || ch->active) {
+            ch->pending = false;  /* Taken, or dropped by the fading LED */
+        }
+        k_spin_unlock(&lock, key);
+
+        if (due) {
+            uint32_t pulse_cycles = level_to_pulse_cycles(ch, level_q16);
+
+            LED_TRACE_STEP(i, (level_q16 + (1U << 15)) >> 16, pulse_cycles);
+            led_fade_record_step(ch, late_us);
+            count = led_fade_queue(i, pulse_cycles, true, count);
+        } else if (set) {
+            count = led_fade_queue(i, level_to_pulse_cycles(ch, level_q16), false, count);
+        }
+    }
+
+    led_fade_commit(led_order[group->first], count);
+
+    /*
+     * Queue the group again for its next step while anything on it is
+     * still fading. This is decided under the lock so a fade started
+     * during this run is not lost.
+     */
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    for (size_t k = 0; k < set_count; k++) {
+        channels[set_leds[k]].writing = false;
+    }
+    led_fade_arm(group);
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief Order the LEDs so that those of one controller are adjacent
+ *
+ * Stable: controllers appear in the order of their first LED, and LEDs
+ * keep their table order within a controller. Each controller gets a
+ * group, with its scheduler entry. Runs once at init.
+ */
+static void led_fade_group_by_controller(void)
+{
+    size_t n = 0;
+
+    num_groups = 0;
+
+    for (size_t i = 0; i < NUM_LEDS; i++) {
+        bool grouped = false;
+
+        for (size_t k = 0; k < n; k++) {
+            if (led_specs[led_order[k]].dev == led_specs[i].dev) {
+                grouped = true;
+                break;
+            }
+        }
+        if (grouped) {
+            continue;
+        }
+
+        /* First LED of a new controller: bring in all of its LEDs */
+        struct led_fade_group *group = &groups[num_groups];
+
+        led_sched_entry_init(&group->entry, led_fade_serve);
+        group->first = n;
+        for (size_t j = i; j < NUM_LEDS; j++) {
+            if (led_specs[j].dev == led_specs[i].dev) {
+                led_groups[j] = num_groups;
+                led_order[n++] = j;
+            }
+        }
+        group->end = n;
+        num_groups++;
+    }
+}
+
+#ifdef CONFIG_APP_PWM_STAGGER
+/**
+ * @brief Spread the rising edges of the LEDs of each controller
+ *
+ * With edge-aligned PWM every lit LED switches on at the start of the
+ * period, so their currents add up into one peak. Here the k-th of the n
+ * LEDs of a controller instead starts its pulse k/n of the way into the
+ * period, when the controller supports phase offsets (pwm_phase.h).
+ *
+ * Otherwise, every other LED is right-aligned: its pulse ends with the
+ * period instead of starting with it. That takes no hardware support,
+ * only the regular PWM API: the polarity of the channel is inverted and
+ * the complement of the pulse width is programmed. It only gives two
+ * phases, but at up to 50% duty no two neighbours are on at once.
+ *
+ * Controllers do not share a time base, so LEDs are only staggered
+ * against the others of their controller. Runs once at init, after
+ * led_fade_group_by_controller() and before any write.
+ */
+static int led_fade_stagger(void)
+{
+    size_t end;
+
+    for (size_t first = 0; first < NUM_LEDS; first = end) {
+        const struct device *dev = led_specs[led_order[first]].dev;
+
+        end = first + 1;
+        while (end < NUM_LEDS && led_specs[led_order[end]].dev == dev) {
+            end++;
+        }
+
+        for (size_t pos = first; pos < end; pos++) {
+            size_t i = led_order[pos];
+            const struct pwm_phase_api *api = led_phase_apis[i];
+            uint32_t k = pos - first;
+            int ret;
+
+            if (IS_ENABLED(CONFIG_APP_PWM_STAGGER_ALTERNATE)) {
+                api = NULL;
+            }
+
+            if (api == NULL) {
+                channels[i].right_aligned = (k % 2) != 0;
+                continue;
+            }
+
+            ret = api->set_phase(dev, led_specs[i].channel,
+                                 (uint32_t)(((uint64_t)channels[i].period_cycles * k) /
+                                            (end - first)));
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+
+    return 0;
+}
+#endif /* CONFIG_APP_PWM_STAGGER */
+
+int led_fade_init(void)
+{
+    int ret;
+
+    led_fade_group_by_controller();
+    ret = led_sched_reserve(num_groups);
+    if (ret < 0) {
+        return ret;  /* Not every controller could be queued at once */
+    }
+
+    for (size_t i = 0; i < NUM_LEDS; i++) {
+        const struct pwm_dt_spec *spec = &led_specs[i];
+        uint64_t cycles_per_sec;
+
+        /*
+         * Query the PWM clock once: every later write is done directly
+         * in hardware cycles with this cached period
+         */
+        ret = pwm_get_cycles_per_sec(spec->dev, spec->channel, &cycles_per_sec);
+        if (ret < 0) {
+            return ret;
+        }
+        if ((cycles_per_sec * PWM_PERIOD_US) / USEC_PER_SEC > UINT32_MAX) {
+            return -ENOTSUP;
+        }
+
+        channels[i].period_cycles = (uint32_t)((cycles_per_sec * PWM_PERIOD_US) / USEC_PER_SEC);
+        channels[i].shadow.valid = false;
+        channels[i].active = false;
+        channels[i].sequenced = false;
+        channels[i].right_aligned = false;
+        channels[i].powered = false;
+        channels[i].pending = false;
+        channels[i].writing = false;
+        channels[i].dither_q16 = 0;
+        channels[i].error = 0;
+        k_sem_init(&channels[i].done, 0, 1);
+    }
+
+#ifdef CONFIG_APP_PWM_STAGGER
+    ret = led_fade_stagger();
+    if (ret < 0) {
+        return ret;
+    }
+#endif
+
+#ifdef CONFIG_APP_PWM_PM
+    /*
+     * Let every controller be suspended while no LED holds it. Drivers
+     * without power management support refuse, and simply keep running.
+     */
+    for (size_t i = 0; i < NUM_LEDS; i++) {
+        (void)pm_device_runtime_enable(led_specs[i].dev);
+    }
+#endif
+
+    frame_ticks = MAX(k_ms_to_ticks_ceil64(FADE_STEP_MS), 1);
+
+    return 0;
+}
+
+size_t led_fade_count(void)
+{
+    return NUM_LEDS;
+}
+
+const struct pwm_dt_spec *led_fade_spec(size_t led)
+{
+    return (led < NUM_LEDS) ? &led_specs[led] : NULL;
+}
+
+int led_fade_submit(size_t led, uint16_t from, uint16_t to, uint32_t duration_ms,
+                    struct led_notify *notify)
+{
+    struct led_fade_channel *ch;
+    uint32_t frames = MIN(duration_ms / FADE_STEP_MS, UINT16_MAX);
+    k_spinlock_key_t key;
+
+    if (led >= NUM_LEDS || from > FADE_STEPS || to > FADE_STEPS) {
+        return -EINVAL;
+    }
+    ch = &channels[led];
+
+    key = k_spin_lock(&lock);
+    if (ch->active) {
+        k_spin_unlock(&lock, key);
+        return -EBUSY;
+    }
+
+    led_fade_aim(ch, (uint32_t)from << 16, to, frames);
+    ch->error = 0;
+    ch->active = true;
+    ch->sequenced = false;
+    ch->start_ms = k_uptime_get();
+    k_sem_reset(&ch->done);
+    if (notify != NULL) {
+        led_notify_start(notify);
+    }
+    ch->notify = notify;
+
+#ifdef CONFIG_APP_FADE_HW_SEQ
+    /* Keep the scheduler off the channel while the sequence is uploaded */
+    ch->sequenced = true;
+    k_spin_unlock(&lock, key);
+
+    if (led_fade_play(led) == 0) {
+        return 0;  /* The controller finishes the fade on its own */
+    }
+
+    /* No sequence playback for this ramp: step it from the scheduler */
+    key = k_spin_lock(&lock);
+    ch->sequenced = false;
+#endif
+
+    /* Frame 0 is due now: move the entry of the controller up to it */
+    led_fade_arm(&groups[led_groups[led]]);
+    k_spin_unlock(&lock, key);
+
+    return 0;
+}
+
+int led_fade_ramp(size_t led, uint16_t from, uint16_t to, uint32_t duration_ms)
+{
+    return led_fade_submit(led, from, to, duration_ms, NULL);
+}
+
+int led_fade_start(size_t led, bool fade_in)
+{
+    uint32_t duration_ms = FADE_STEPS * FADE_STEP_MS;
+
+    if (fade_in) {
+        /* Fade in: Start at 0% and increase to 100% */
+        return led_fade_ramp(led, 0, FADE_STEPS, duration_ms);
+    }
+
+    /* Fade out: Start at 100% and decrease to 0% */
+    return led_fade_ramp(led, FADE_STEPS, 0, duration_ms);
+}
+
+int led_fade_retarget(size_t led, uint16_t to, uint32_t duration_ms)
+{
+    struct led_fade_channel *ch;
+    uint32_t frames = MIN(duration_ms / FADE_STEP_MS, UINT16_MAX - 2);
+    uint32_t from_q16;
+    k_spinlock_key_t key;
+
+    if (led >= NUM_LEDS || to > FADE_STEPS) {
+        return -EINVAL;
+    }
+    ch = &channels[led];
+
+    key = k_spin_lock(&lock);
+    if (!ch->active) {
+        /* A new fade, from where the LED was left */
+        from_q16 = ch->pending ? (uint32_t)ch->pending_level << 16 : ch->level_q16;
+        ch->error = 0;
+        ch->start_ms = k_uptime_get();
+        k_sem_reset(&ch->done);
+#ifdef CONFIG_APP_FADE_HW_SEQ
+    } else if (ch->sequenced) {
+        size_t played;
+        int ret;
+
+        /* Not with interrupts masked: the driver may take a while */
+        k_spin_unlock(&lock, key);
+        ret = led_fade_seq_stop(led, &played);
+        key = k_spin_lock(&lock);
+        if (ret == 0 && !(ch->active && ch->sequenced)) {
+            ret = -EBUSY;  /* Taken over by another caller meanwhile */
+        }
+        if (ret < 0) {
+            k_spin_unlock(&lock, key);
+            return ret;
+        }
+        from_q16 = led_fade_seq_stopped(led, played);
+#endif
+    } else {
+        from_q16 = led_fade_level_now(ch, k_uptime_ticks());
+    }
+
+    /* Always on the scheduler: uploading a sequence is not for interrupts */
+    if (frames == 0) {
+        led_fade_aim(ch, from_q16, to, 0);
+    } else {
+        /*
+         * Frame 0 would be the level the LED already shows: date frame 1
+         * back to the last frame of the shared grid, so the first frame
+         * that moves is due right away and the next ones are shared with
+         * the other LEDs. Off the grid that takes one frame more, for the
+         * ramp to still end after duration_ms.
+         */
+        int64_t now = k_uptime_ticks();
+        int64_t joined = led_fade_grid_ceil(now);
+        uint32_t lead = joined == now ? 1 : 2;
+
+        led_fade_aim(ch, from_q16, to, frames + lead);
+        ch->epoch = joined - (int64_t)lead * frame_ticks;
+        ch->next_frame = 1;
+    }
+    ch->active = true;
+    ch->sequenced = false;
+    led_fade_arm(&groups[led_groups[led]]);
+    k_spin_unlock(&lock, key);
+
+    return 0;
+}
+
+int led_fade_set_pulse(size_t led, uint32_t pulse_us)
+{
+    struct led_fade_channel *ch;
+    uint32_t pulse_cycles;
+    k_spinlock_key_t key;
+    bool busy;
+    int ret;
+
+    if (led >= NUM_LEDS || pulse_us > PWM_PERIOD_US) {
+        return -EINVAL;
+    }
+    ch = &channels[led];
+
+    key = k_spin_lock(&lock);
+    busy = ch->active || ch->pending || ch->writing;
+    if (!busy) {
+        ch->writing = true;
+    }
+    k_spin_unlock(&lock, key);
+
+    if (busy) {
+        return -EBUSY;  /* The scheduler owns the channel, or is about to */
+    }
+
+    /* Not on the fade path, so a division is fine here */
+    pulse_cycles = (uint32_t)(((uint64_t)ch->period_cycles * pulse_us) / PWM_PERIOD_US);
+    ret = led_fade_write(led, pulse_cycles);
+
+    /* A level given meanwhile goes out now that the channel is free */
+    key = k_spin_lock(&lock);
+    ch->writing = false;
+    if (ch->pending) {
+        led_fade_arm(&groups[led_groups[led]]);
+    }
+    k_spin_unlock(&lock, key);
+
+    return ret;
+}
+
+int led_fade_set_levels(size_t first, const uint16_t *levels, size_t count)
+{
+    k_spinlock_key_t key;
+
+    if (first > NUM_LEDS || count > NUM_LEDS - first) {
+        return -EINVAL;
+    }
+    for (size_t k = 0; k < count; k++) {
+        if (levels[k] > FADE_STEPS) {
+            return -EINVAL;
+        }
+    }
+
+    key = k_spin_lock(&lock);
+    for (size_t k = 0; k < count; k++) {
+        channels[first + k].pending_level = levels[k];
+        channels[first + k].pending = true;
+    }
+    /* Neighbouring LEDs usually share a controller: arm it once for them */
+    for (size_t i = first; i < first + count; i++) {
+        if (i + 1 == first + count || led_groups[i + 1] != led_groups[i]) {
+            led_fade_arm(&groups[led_groups[i]]);
+        }
+    }
+    k_spin_unlock(&lock, key);
+
+    return 0;
+}
+
+int led_fade_get_counters(size_t led, struct led_fade_counters *counters)
+{
+    struct led_fade_stats *stats;
+
+    if (led >= NUM_LEDS) {
+        return -EINVAL;
+    }
+    stats = &channels[led].stats;
+
+    counters->pwm_writes = (uint32_t)atomic_get(&stats->pwm_writes);
+    counters->pwm_skipped = (uint32_t)atomic_get(&stats->pwm_skipped);
+    counters->pwm_errors = (uint32_t)atomic_get(&stats->pwm_errors);
+    counters->seq_plays = (uint32_t)atomic_get(&stats->seq_plays);
+    counters->fades = (uint32_t)atomic_get(&stats->fades);
+    counters->fade_time_ms = (uint32_t)atomic_get(&stats->fade_time_ms);
+    counters->steps = (uint32_t)atomic_get(&stats->steps);
+    counters->worst_late_us = (uint32_t)atomic_get(&stats->worst_late_us);
+    for (size_t b = 0; b < LED_FADE_LATE_BUCKETS; b++) {
+        counters->late_hist[b] = (uint32_t)atomic_get(&stats->late_hist[b]);
+    }
+
+    return 0;
+}
+
+int led_fade_reset_counters(size_t led)
+{
+    struct led_fade_stats *stats;
+
+    if (led >= NUM_LEDS) {
+        return -EINVAL;
+    }
+    stats = &channels[led].stats;
+
+    atomic_clear(&stats->pwm_writes);
+    atomic_clear(&stats->pwm_skipped);
+    atomic_clear(&stats->pwm_errors);
+    atomic_clear(&stats->seq_plays);
+    atomic_clear(&stats->fades);
+    atomic_clear(&stats->fade_time_ms);
+    atomic_clear(&stats->steps);
+    atomic_clear(&stats->worst_late_us);
+    for (size_t b = 0; b < LED_FADE_LATE_BUCKETS; b++) {
+        atomic_clear(&stats->late_hist[b]);
+    }
+
+    return 0;
+}
+
+bool led_fade_is_active(size_t led)
+{
+    k_spinlock_key_t key;
+    bool active;
+
+    if (led >= NUM_LEDS) {
+        return false;
+    }
+
+    key = k_spin_lock(&lock);
+    active = channels[led].active;
+    k_spin_unlock(&lock, key);
+
+    return active;
+}
+
+int led_fade_wait(size_t led, k_timeout_t timeout)
+{
+    int ret;
+
+    if (led >= NUM_LEDS) {
+        return -EINVAL;
+    }
+
+    ret = k_sem_take(&channels[led].done, timeout);
+    if (ret < 0) {
+        return ret;  /* Still fading when the timeout expired */
+    }
+
+    /* Leave the semaphore given so repeated waits keep returning */
+    k_sem_give(&channels[led].done);
+
+    return channels[led].error;
+}
+
+int led_fade_set_done_callback(size_t led, led_fade_done_cb_t cb, void *user_data)
+{
+    k_spinlock_key_t key;
+
+    if (led >= NUM_LEDS) {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&lock);
+    channels[led].done_cb = cb;
+    channels[led].done_user_data = user_data;
+    k_spin_unlock(&lock, key);
+
+    return 0;
+}
+
+int led_fade_replace_done_callback(size_t led, led_fade_done_cb_t old_cb, void *old_user_data,
+                                   led_fade_done_cb_t cb, void *user_data)
+{
+    struct led_fade_channel *ch;
+    k_spinlock_key_t key;
+    int ret = 0;
+
+    if (led >= NUM_LEDS) {
+        return -EINVAL;
+    }
+    ch = &channels[led];
+
+    key = k_spin_lock(&lock);
+    if (ch->done_cb == old_cb && ch->done_user_data == old_user_data) {
+        ch->done_cb = cb;
+        ch->done_user_data = user_data;
+    } else {
+        ret = -EBUSY;
+    }
+    k_spin_unlock(&lock, key);
+
+    return ret;
+}
+
+uint32_t led_fade_wakeups(void)
+{
+    return led_sched_wakeups();
+}
+
+uint32_t led_fade_late_frames(void)
+{
+    return (uint32_t)atomic_get(&late_frames);
+}
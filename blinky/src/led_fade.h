@@ -0,0 +1,362 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Non-blocking LED fade engine
+ *
+ * A fade is started with led_fade_start(), led_fade_ramp() or
+ * led_fade_submit(), which return immediately. Running fades are then
+ * stepped from the LED scheduler (led_sched.h) on the system work queue,
+ * which wakes up once for all the LEDs due at about the same time, and
+ * only on the frames that change a level. The calling thread stays free
+ * while they fade.
+ *
+ * Brightness is expressed in fade steps, from 0 (off) to FADE_STEPS (full).
+ * Steps are perceptually even: each one is mapped to a duty cycle through a
+ * CIE L* table generated at build time (scripts/gen_gamma_table.py).
+ *
+ * With CONFIG_APP_FADE_HW_SEQ, ramps on controllers that can play PWM
+ * sequences are uploaded whole and played by the controller, without the
+ * scheduler; see pwm_seq.h.
+ */
+
+#ifndef LED_FADE_H_
+#define LED_FADE_H_
+
+#include <zephyr/kernel.h>      /* Work queue, semaphores and atomics */
+#include <zephyr/drivers/pwm.h> /* PWM driver API */
+
+#include "led_notify.h"         /* Handles of asynchronous fades */
+
+/*
+ * PWM Configuration Constants
+ * These define the timing and behavior of the fading effect and are set
+ * through Kconfig so the build can size the generated gamma table from them
+ */
+
+/* PWM period in microseconds (1kHz frequency by default)
+ * Lower frequency = smoother fading but more visible flicker
+ * Higher frequency = less smooth but no visible flicker */
+#define PWM_PERIOD_US   CONFIG_APP_PWM_PERIOD_US
+
+/* Time between each fade step in milliseconds
+ * Smaller values = smoother but slower fading
+ * Larger values = faster but more stepped fading */
+#define FADE_STEP_MS    CONFIG_APP_FADE_STEP_MS
+
+/* Number of steps in fade transition
+ * More steps = smoother fading but takes longer
+ * Fewer steps = faster but more noticeable steps */
+#define FADE_STEPS      CONFIG_APP_FADE_STEPS
+
+/* Number of LEDs, every enabled child of every enabled "pwm-leds" node,
+ * for sizing tables at build time; led_fade_count() at run time */
+#define LED_FADE_ONE(node_id)       +1
+#define LED_FADE_NODE_LEDS(node_id) DT_FOREACH_CHILD_STATUS_OKAY(node_id, LED_FADE_ONE)
+#define LED_FADE_NUM_LEDS           (0 DT_FOREACH_STATUS_OKAY(pwm_leds, LED_FADE_NODE_LEDS))
+
+/* Buckets of the step lateness histogram of struct led_fade_counters */
+#define LED_FADE_LATE_BUCKETS 6
+
+/*
+ * Upper bound, exclusive, of a step lateness bucket in microseconds:
+ * 64 us, then four times more per bucket. The last bucket has no bound.
+ */
+#define LED_FADE_LATE_BUCKET_LIMIT_US(b) (64U << (2 * (b)))
+
+/**
+ * @brief Runtime statistics of one LED
+ *
+ * The engine keeps a shadow copy of what each channel was last set to and
+ * skips writes that would not change it.
+ *
+ * Step lateness is how long after its deadline on the shared frame grid
+ * the scheduler programmed a step of this LED. Sequenced fades are
+ * stepped by the controller and add none.
+ */
+struct led_fade_counters {
+    uint32_t pwm_writes;     /* Driver calls or sequences that succeeded */
+    uint32_t pwm_skipped;    /* Calls saved by the shadow copy */
+    uint32_t pwm_errors;     /* Driver calls or sequences that failed */
+    uint32_t seq_plays;      /* Ramps played by the controller as a sequence */
+    uint32_t fades;          /* Fades that ended, completed or aborted */
+    uint32_t fade_time_ms;   /* Total time spent fading */
+    uint32_t steps;          /* Steps computed by the scheduler */
+    uint32_t worst_late_us;  /* Worst step lateness */
+    uint32_t late_hist[LED_FADE_LATE_BUCKETS];  /* Steps per lateness bucket */
+};
+
+/**
+ * @brief Prepare the fade engine for every LED of the devicetree
+ *
+ * The LEDs are all children of all enabled "pwm-leds" nodes, in devicetree
+ * order, and are addressed by that index (0..led_fade_count() - 1). Must
+ * be called once, after the PWM devices are ready, before any other
+ * led_fade_*() function.
+ *
+ * The PWM clock of every LED is queried here, once; fades are then driven
+ * with pwm_set_cycles() using the cached period in hardware cycles.
+ *
+ * @retval 0 On success
+ * @retval -ENOTSUP PWM_PERIOD_US does not fit the counter of an LED
+ * @retval <0 Error from pwm_get_cycles_per_sec()
+ */
+int led_fade_init(void);
+
+/**
+ * @brief Number of LEDs in the devicetree LED table
+ */
+size_t led_fade_count(void);
+
+/**
+ * @brief PWM specification of an LED
+ *
+ * @param led Index of the LED
+ *
+ * @return Entry of the LED table, or NULL for an invalid index
+ */
+const struct pwm_dt_spec *led_fade_spec(size_t led);
+
+/**
+ * @brief Start a fade between two brightness levels without blocking
+ *
+ * The LED is set to @p from on the next frame of the LED scheduler, at
+ * most FADE_STEP_MS from now, and then moves linearly to @p to, one frame
+ * every FADE_STEP_MS, reaching it @p duration_ms later. Every LED can run
+ * its own ramp at the same time. Frames are scheduled on absolute
+ * deadlines of a grid shared by every LED, so fades share their wakeups,
+ * and the ramp ends on time even when some of its frames run late or are
+ * skipped. Frames that would not change the brightness step of the LED
+ * are skipped on purpose.
+ *
+ * If the controller of the LED can play sequences, the frames are instead
+ * computed here, in the caller's context, and the whole ramp is uploaded to
+ * the controller at once. The CPU is then only woken up once, when it
+ * ends.
+ *
+ * @param led Index of the LED
+ * @param from Start level (0..FADE_STEPS)
+ * @param to Final level (0..FADE_STEPS)
+ * @param duration_ms Duration of the ramp, rounded down to whole frames
+ *
+ * @retval 0 The fade was started
+ * @retval -EINVAL Invalid LED index or level
+ * @retval -EBUSY A fade is already running on this LED
+ */
+int led_fade_ramp(size_t led, uint16_t from, uint16_t to, uint32_t duration_ms);
+
+/**
+ * @brief Start a fade and get told when it ends
+ *
+ * Same as led_fade_ramp(), with a handle that is completed when the fade
+ * ends, in the way it was set up with (see led_notify.h): its result reads
+ * -EINPROGRESS until then. The handle follows the fade through
+ * led_fade_retarget(), and is completed once, when it ends on its last
+ * target. It is not touched if the fade could not be started.
+ *
+ * May be called from a completion callback, to chain fades without a
+ * thread.
+ *
+ * @param led Index of the LED
+ * @param from Start level (0..FADE_STEPS)
+ * @param to Final level (0..FADE_STEPS)
+ * @param duration_ms Duration of the ramp, rounded down to whole frames
+ * @param notify Handle of the fade, valid until it ends, or NULL
+ *
+ * @retval 0 The fade was started
+ * @retval -EINVAL Invalid LED index or level
+ * @retval -EBUSY A fade is already running on this LED
+ */
+int led_fade_submit(size_t led, uint16_t from, uint16_t to, uint32_t duration_ms,
+                    struct led_notify *notify);
+
+/**
+ * @brief Start a full fade in or out without blocking
+ *
+ * Same as led_fade_ramp() from 0 to FADE_STEPS (fade in) or back (fade
+ * out), taking FADE_STEPS frames.
+ *
+ * @param led Index of the LED
+ * @param fade_in true for fade in (dark to bright), false for fade out
+ *
+ * @retval 0 The fade was started
+ * @retval -EINVAL Invalid LED index
+ * @retval -EBUSY A fade is already running on this LED
+ */
+int led_fade_start(size_t led, bool fade_in);
+
+/**
+ * @brief Redirect the fade of an LED to a new level and duration
+ *
+ * The LED moves on from the level it has reached by now to @p to, over
+ * at least @p duration_ms, so there is no jump. The first frame that
+ * moves goes out on the next wakeup of the LED scheduler, which is due
+ * right away, not one frame later; the next ones follow the frame grid
+ * shared by every LED, which may take one frame more. A fade
+ * the controller plays is stopped where it is and continued by the
+ * scheduler. On an LED that is not fading, a new fade starts from the
+ * level its last fade or led_fade_set_levels() left it at.
+ *
+ * Waiters of led_fade_wait() and the done callback see a single fade,
+ * ending on the new target.
+ *
+ * Takes constant time whatever the length of the fade, and may be called
+ * from any context, including interrupts.
+ *
+ * @param led Index of the LED
+ * @param to Final level (0..FADE_STEPS)
+ * @param duration_ms Duration of the new ramp, rounded down to whole frames
+ *
+ * @retval 0 The fade was redirected, or started
+ * @retval -EINVAL Invalid LED index or level
+ * @retval -ENOTSUP The controller plays the fade and cannot stop it early
+ * @retval -EBUSY The controller is just starting or ending the fade
+ */
+int led_fade_retarget(size_t led, uint16_t to, uint32_t duration_ms);
+
+/**
+ * @brief Set the pulse width of an LED immediately
+ *
+ * The write is skipped if the channel already has this pulse width.
+ *
+ * @param led Index of the LED
+ * @param pulse_us Pulse width in microseconds (0..PWM_PERIOD_US)
+ *
+ * @retval 0 On success
+ * @retval -EINVAL Invalid LED index or pulse width
+ * @retval -EBUSY The LED is fading, or a level given by
+ *                led_fade_set_levels() has yet to go out
+ * @retval <0 PWM error code
+ */
+int led_fade_set_pulse(size_t led, uint32_t pulse_us);
+
+/**
+ * @brief Set the level of a range of LEDs at once without blocking
+ *
+ * The levels are applied on the next wakeup of the LED scheduler, which is
+ * due right away. The LEDs of each controller are committed together, so
+ * they change in the same PWM period. A level given again before then
+ * replaces the previous one. LEDs that are fading keep fading and drop
+ * their level. May be called from any context, including interrupts.
+ *
+ * @param first Index of the first LED
+ * @param levels Levels (0..FADE_STEPS) of the LEDs from @p first on
+ * @param count Number of entries in @p levels
+ *
+ * @retval 0 The levels were queued
+ * @retval -EINVAL Invalid LED range or level
+ */
+int led_fade_set_levels(size_t first, const uint16_t *levels, size_t count);
+
+/**
+ * @brief Read the runtime statistics of an LED
+ *
+ * The counters are updated with atomic operations and no lock, so they can
+ * be read at any time without slowing the fade down. Each field is read
+ * on its own: a snapshot taken while the LED fades may be one step apart
+ * between fields.
+ *
+ * @param led Index of the LED
+ * @param counters Filled with the counters
+ *
+ * @retval 0 On success
+ * @retval -EINVAL Invalid LED index
+ */
+int led_fade_get_counters(size_t led, struct led_fade_counters *counters);
+
+/**
+ * @brief Clear the runtime statistics of an LED
+ *
+ * @param led Index of the LED
+ *
+ * @retval 0 On success
+ * @retval -EINVAL Invalid LED index
+ */
+int led_fade_reset_counters(size_t led);
+
+/**
+ * @brief Check whether a fade is still running
+ *
+ * @param led Index of the LED
+ *
+ * @return true while the fade engine is still stepping this LED
+ */
+bool led_fade_is_active(size_t led);
+
+/**
+ * @brief Wait for the running fade to finish
+ *
+ * @param led Index of the LED
+ * @param timeout How long to wait for the fade to complete
+ *
+ * @retval 0 The fade completed
+ * @retval -EINVAL Invalid LED index
+ * @retval -EAGAIN The timeout expired first
+ * @retval <0 PWM error code that aborted the fade
+ */
+int led_fade_wait(size_t led, k_timeout_t timeout);
+
+/**
+ * @brief Called when a fade of an LED ends
+ *
+ * @param led Index of the LED
+ * @param error 0 if the ramp completed, PWM error code otherwise
+ * @param user_data Pointer given with the callback
+ */
+typedef void (*led_fade_done_cb_t)(size_t led, int error, void *user_data);
+
+/**
+ * @brief Register a callback called whenever a fade of an LED ends, or NULL
+ *
+ * The callback runs after the waiters of led_fade_wait() are released, and
+ * may start the next fade of the LED. When the controller plays the fade
+ * itself, it runs in the interrupt that ends the sequence, so it must not
+ * block.
+ *
+ * @param led Index of the LED
+ * @param cb Callback, or NULL to remove it
+ * @param user_data Pointer passed to the callback
+ *
+ * @retval 0 On success
+ * @retval -EINVAL Invalid LED index
+ */
+int led_fade_set_done_callback(size_t led, led_fade_done_cb_t cb, void *user_data);
+
+/**
+ * @brief Replace the done callback of an LED only if it is still a given one
+ *
+ * Lets a user that registered a callback take it back without removing
+ * one registered since by someone else.
+ *
+ * @param led Index of the LED
+ * @param old_cb Callback expected to be registered, or NULL
+ * @param old_user_data Pointer expected to be registered with it
+ * @param cb New callback, or NULL to remove it
+ * @param user_data Pointer passed to the new callback
+ *
+ * @retval 0 The callback was replaced
+ * @retval -EINVAL Invalid LED index
+ * @retval -EBUSY Another callback is registered; it was left in place
+ */
+int led_fade_replace_done_callback(size_t led, led_fade_done_cb_t old_cb, void *old_user_data,
+                                   led_fade_done_cb_t cb, void *user_data);
+
+/**
+ * @brief Number of wakeups of the LED scheduler since boot
+ *
+ * Each one is one run of the system work queue, whatever the number of
+ * LEDs it stepped.
+ */
+uint32_t led_fade_wakeups(void);
+
+/**
+ * @brief Number of frames skipped since boot
+ *
+ * The frames of a fade follow a grid of absolute deadlines. When an LED is
+ * served a whole frame late, it moves straight to the current frame; the
+ * frames it passed over are counted here, for every LED.
+ */
+uint32_t led_fade_late_frames(void);
+
+#endif /* LED_FADE_H_ */
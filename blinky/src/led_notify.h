@@ -0,0 +1,197 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Completion notification of asynchronous LED operations
+ *
+ * led_fade_submit() and led_anim_submit() return right away and take a
+ * struct led_notify, owned by the caller, which is the handle of the
+ * operation: its result reads -EINPROGRESS until the operation ends, and
+ * the caller is then told in the way the handle was set up with:
+ *
+ *   callback  A function is called, in the context that ended the
+ *             operation, which may be an interrupt
+ *   signal    A k_poll_signal is raised with the result
+ *   sem       A k_sem is given
+ *
+ * Signals and semaphores can both be waited for with k_poll(), along with
+ * any other kernel event, so a single thread can follow any number of
+ * fades and animations without blocking on each in turn.
+ */
+
+#ifndef LED_NOTIFY_H_
+#define LED_NOTIFY_H_
+
+#include <zephyr/kernel.h>
+
+struct led_notify;
+
+/**
+ * @brief Called when the operation of a handle ends
+ *
+ * Must not block: it may run in an interrupt. It may submit the next
+ * operation, with this handle or another one.
+ *
+ * @param notify Handle of the operation
+ * @param result 0 if the operation completed, negative error code otherwise
+ */
+typedef void (*led_notify_cb_t)(struct led_notify *notify, int result);
+
+/**
+ * @brief How a handle tells its owner
+ */
+enum led_notify_method {
+    LED_NOTIFY_NONE,      /* Only the result is updated */
+    LED_NOTIFY_CALLBACK,
+    LED_NOTIFY_SIGNAL,
+    LED_NOTIFY_SEM,
+};
+
+/**
+ * @brief Handle of an asynchronous operation
+ *
+ * Set up with one of the led_notify_init_*() functions before each
+ * submission. It must stay valid until the operation ends.
+ */
+struct led_notify {
+    union {
+        led_notify_cb_t cb;
+        struct k_poll_signal *signal;
+        struct k_sem *sem;
+    };
+    void *user_data;  /* For the owner, e.g. to find its state from the callback */
+    atomic_t result;  /* -EINPROGRESS while the operation runs */
+    uint8_t method;   /* enum led_notify_method */
+};
+
+/**
+ * @brief Set up a handle that only records the result
+ *
+ * The owner then polls it with led_notify_result().
+ */
+static inline void led_notify_init(struct led_notify *notify)
+{
+    notify->method = LED_NOTIFY_NONE;
+    atomic_set(&notify->result, 0);
+}
+
+/**
+ * @brief Set up a handle calling a function when the operation ends
+ *
+ * @param notify Handle
+ * @param cb Function to call
+ * @param user_data Stored in the handle, for @p cb
+ */
+static inline void led_notify_init_callback(struct led_notify *notify, led_notify_cb_t cb,
+                                            void *user_data)
+{
+    led_notify_init(notify);
+    notify->method = LED_NOTIFY_CALLBACK;
+    notify->cb = cb;
+    notify->user_data = user_data;
+}
+
+/**
+ * @brief Set up a handle raising a poll signal when the operation ends
+ *
+ * The signal is raised with the result of the operation. It is not reset
+ * here: the owner resets it before reusing it.
+ *
+ * @param notify Handle
+ * @param signal Signal to raise
+ */
+static inline void led_notify_init_signal(struct led_notify *notify,
+                                          struct k_poll_signal *signal)
+{
+    led_notify_init(notify);
+    notify->method = LED_NOTIFY_SIGNAL;
+    notify->signal = signal;
+}
+
+/**
+ * @brief Set up a handle giving a semaphore when the operation ends
+ *
+ * One semaphore may be shared by several handles, to count the
+ * operations that ended.
+ *
+ * @param notify Handle
+ * @param sem Semaphore to give
+ */
+static inline void led_notify_init_sem(struct led_notify *notify, struct k_sem *sem)
+{
+    led_notify_init(notify);
+    notify->method = LED_NOTIFY_SEM;
+    notify->sem = sem;
+}
+
+/**
+ * @brief Result of the operation of a handle
+ *
+ * @retval -EINPROGRESS The operation is still running
+ * @retval 0 The operation completed
+ * @retval <0 Error code that ended it
+ */
+static inline int led_notify_result(const struct led_notify *notify)
+{
+    return (int)atomic_get((atomic_t *)&notify->result);
+}
+
+/**
+ * @brief Mark the operation of a handle as running
+ *
+ * For the modules that take handles, when an operation is submitted.
+ */
+static inline void led_notify_start(struct led_notify *notify)
+{
+    atomic_set(&notify->result, -EINPROGRESS);
+}
+
+/**
+ * @brief Record the result of the operation of a handle and tell its owner
+ *
+ * For the modules that take handles, once their own state no longer
+ * refers to the handle: the owner may reuse it right away.
+ *
+ * @param notify Handle, or NULL
+ * @param result 0 if the operation completed, negative error code otherwise
+ */
+static inline void led_notify_complete(struct led_notify *notify, int result)
+{
+    if (notify == NULL) {
+        return;
+    }
+
+    /*
+     * The target is read before the result is set: an owner polling the
+     * result may reuse the handle as soon as it changes
+     */
+    switch (notify->method) {
+    case LED_NOTIFY_CALLBACK: {
+        led_notify_cb_t cb = notify->cb;
+
+        atomic_set(&notify->result, result);
+        cb(notify, result);
+        break;
+    }
+    case LED_NOTIFY_SIGNAL: {
+        struct k_poll_signal *signal = notify->signal;
+
+        atomic_set(&notify->result, result);
+        (void)k_poll_signal_raise(signal, result);
+        break;
+    }
+    case LED_NOTIFY_SEM: {
+        struct k_sem *sem = notify->sem;
+
+        atomic_set(&notify->result, result);
+        k_sem_give(sem);
+        break;
+    }
+    default:
+        atomic_set(&notify->result, result);
+        break;
+    }
+}
+
+#endif /* LED_NOTIFY_H_ */
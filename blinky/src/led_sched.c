@@ -0,0 +1,292 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * LED wakeup scheduler
+ *
+ * The queued entries form a binary min-heap on their deadline, stored as
+ * an array of pointers: the earliest entry is always heap[0], and queuing,
+ * moving or serving an entry costs O(log n) swaps. Each entry remembers
+ * its slot, so it can be moved without searching for it.
+ *
+ * One delayable work item is armed for heap[0]. When it runs, every entry
+ * due by the end of the coalescing window is taken out of the heap first,
+ * then their handlers are called. Handlers re-queue their entries for their
+ * next deadline, and the work item is re-armed once, after all of them,
+ * for whatever is earliest then.
+ */
+
+#include <zephyr/spinlock.h>
+
+#include "led_sched.h"
+#include "led_trace.h"
+
+static struct k_spinlock lock;  /* Protects everything below */
+static struct led_sched_entry *heap[CONFIG_APP_LED_SCHED_MAX_ENTRIES];
+static size_t heap_len;
+static size_t reserved;         /* Slots reserved by led_sched_reserve() */
+static bool running;            /* Handlers are being called */
+static bool armed;              /* The work item is scheduled */
+static int64_t armed_deadline;  /* Deadline it is scheduled for */
+static uint32_t window_us = CONFIG_APP_LED_SCHED_WINDOW_US;  /* Coalescing window */
+static led_sched_wakeup_cb_t wakeup_cb;
+static void *wakeup_user_data;
+static atomic_t wakeups;
+
+static void led_sched_run(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(work, led_sched_run);
+
+/* Marks an entry that is not in the heap */
+#define LED_SCHED_NOT_QUEUED UINT16_MAX
+
+BUILD_ASSERT(CONFIG_APP_LED_SCHED_MAX_ENTRIES < LED_SCHED_NOT_QUEUED,
+             "Heap slots must fit an entry slot field");
+
+static void heap_place(size_t slot, struct led_sched_entry *entry)
+{
+    heap[slot] = entry;
+    entry->slot = (uint16_t)slot;
+}
+
+/**
+ * @brief Move the entry of a slot up until its parent is not later
+ */
+static void heap_sift_up(size_t slot)
+{
+    struct led_sched_entry *entry = heap[slot];
+
+    while (slot > 0) {
+        size_t parent = (slot - 1) / 2;
+
+        if (heap[parent]->deadline <= entry->deadline) {
+            break;
+        }
+        heap_place(slot, heap[parent]);
+        slot = parent;
+    }
+    heap_place(slot, entry);
+}
+
+/**
+ * @brief Move the entry of a slot down until no child is earlier
+ */
+static void heap_sift_down(size_t slot)
+{
+    struct led_sched_entry *entry = heap[slot];
+
+    for (;;) {
+        size_t child = 2 * slot + 1;
+
+        if (child >= heap_len) {
+            break;
+        }
+        if (child + 1 < heap_len && heap[child + 1]->deadline < heap[child]->deadline) {
+            child++;
+        }
+        if (entry->deadline <= heap[child]->deadline) {
+            break;
+        }
+        heap_place(slot, heap[child]);
+        slot = child;
+    }
+    heap_place(slot, entry);
+}
+
+/**
+ * @brief Take a queued entry out of the heap
+ */
+static void heap_remove(struct led_sched_entry *entry)
+{
+    size_t slot = entry->slot;
+    struct led_sched_entry *last = heap[--heap_len];
+
+    entry->slot = LED_SCHED_NOT_QUEUED;
+    if (last == entry) {
+        return;
+    }
+
+    /* Fill the hole with the last entry and restore the order around it */
+    heap_place(slot, last);
+    heap_sift_up(slot);
+    heap_sift_down(last->slot);
+}
+
+/**
+ * @brief Arm the work item for the earliest entry, if that changed
+ *
+ * Called with the lock held. While the handlers run, arming is left to
+ * led_sched_run(), which does it once at the end.
+ */
+static void led_sched_arm(void)
+{
+    if (running) {
+        return;
+    }
+
+    if (heap_len == 0) {
+        if (armed) {
+            (void)k_work_cancel_delayable(&work);
+            armed = false;
+        }
+        return;
+    }
+
+    if (!armed || armed_deadline != heap[0]->deadline) {
+        armed = true;
+        armed_deadline = heap[0]->deadline;
+        (void)k_work_reschedule(&work, K_TIMEOUT_ABS_TICKS(armed_deadline));
+    }
+}
+
+/**
+ * @brief Serve every entry due by the end of the coalescing window
+ *
+ * @param work Work item of the scheduler
+ */
+static void led_sched_run(struct k_work *work)
+{
+    struct led_sched_entry *due[CONFIG_APP_LED_SCHED_MAX_ENTRIES];
+    size_t served = 0;
+    uint32_t late_us = 0;
+    k_spinlock_key_t key;
+
+    ARG_UNUSED(work);
+
+    key = k_spin_lock(&lock);
+    armed = false;
+    running = true;
+
+    int64_t now = k_uptime_ticks();
+    int64_t horizon = now + k_us_to_ticks_floor64(window_us);
+
+    if (heap_len > 0 && heap[0]->deadline < now) {
+        late_us = k_ticks_to_us_floor32((uint32_t)(now - heap[0]->deadline));
+    }
+
+    /*
+     * Take all due entries out first: a handler re-queuing its entry
+     * within the window must wait for the next wakeup, not loop here.
+     */
+    while (heap_len > 0 && heap[0]->deadline <= horizon) {
+        due[served] = heap[0];
+        heap_remove(due[served]);
+        served++;
+    }
+
+    led_sched_wakeup_cb_t cb = wakeup_cb;
+    void *user_data = wakeup_user_data;
+
+    k_spin_unlock(&lock, key);
+
+    atomic_inc(&wakeups);
+    LED_TRACE_WAKEUP(served, late_us);
+    if (cb != NULL) {
+        cb((uint32_t)served, late_us, user_data);
+    }
+
+    for (size_t k = 0; k < served; k++) {
+        due[k]->handler(due[k]);
+    }
+
+    key = k_spin_lock(&lock);
+    running = false;
+    led_sched_arm();
+    k_spin_unlock(&lock, key);
+}
+
+void led_sched_entry_init(struct led_sched_entry *entry, led_sched_handler_t handler)
+{
+    entry->handler = handler;
+    entry->deadline = 0;
+    entry->slot = LED_SCHED_NOT_QUEUED;
+}
+
+int led_sched_at(struct led_sched_entry *entry, int64_t deadline)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (entry->slot != LED_SCHED_NOT_QUEUED) {
+        /* Moving: earlier goes up the heap, later goes down */
+        bool earlier = deadline < entry->deadline;
+
+        entry->deadline = deadline;
+        if (earlier) {
+            heap_sift_up(entry->slot);
+        } else {
+            heap_sift_down(entry->slot);
+        }
+    } else {
+        if (heap_len == ARRAY_SIZE(heap)) {
+            k_spin_unlock(&lock, key);
+            return -ENOMEM;
+        }
+        entry->deadline = deadline;
+        heap_place(heap_len++, entry);
+        heap_sift_up(entry->slot);
+    }
+
+    led_sched_arm();
+    k_spin_unlock(&lock, key);
+
+    return 0;
+}
+
+void led_sched_cancel(struct led_sched_entry *entry)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (entry->slot != LED_SCHED_NOT_QUEUED) {
+        heap_remove(entry);
+        led_sched_arm();
+    }
+    k_spin_unlock(&lock, key);
+}
+
+int led_sched_reserve(size_t count)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    int ret = 0;
+
+    if (count > ARRAY_SIZE(heap) - reserved) {
+        ret = -ENOMEM;
+    } else {
+        reserved += count;
+    }
+    k_spin_unlock(&lock, key);
+
+    return ret;
+}
+
+k_ticks_t led_sched_window_ticks(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    k_ticks_t ticks = k_us_to_ticks_floor64(window_us);
+
+    k_spin_unlock(&lock, key);
+
+    return ticks;
+}
+
+void led_sched_set_window_us(uint32_t new_window_us)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    window_us = new_window_us;
+    k_spin_unlock(&lock, key);
+}
+
+void led_sched_set_wakeup_callback(led_sched_wakeup_cb_t cb, void *user_data)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    wakeup_cb = cb;
+    wakeup_user_data = user_data;
+    k_spin_unlock(&lock, key);
+}
+
+uint32_t led_sched_wakeups(void)
+{
+    return (uint32_t)atomic_get(&wakeups);
+}
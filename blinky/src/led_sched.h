@@ -0,0 +1,136 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * LED wakeup scheduler
+ *
+ * Every animation of the LED layer that needs the CPU at some later time
+ * queues an entry here with the absolute deadline of its next step. The
+ * entries are kept in a min-heap, and exactly one kernel timeout is armed,
+ * for the earliest of them: however many animations are running, the CPU
+ * only leaves idle when one of them is due.
+ *
+ * When it wakes up, the scheduler also serves every entry due within the
+ * coalescing window after the current time, early, in the same wakeup.
+ * Animations whose deadlines fall close to each other then share their
+ * wakeups instead of each cutting the idle time short.
+ *
+ * Handlers run on the system work queue, one after the other.
+ */
+
+#ifndef LED_SCHED_H_
+#define LED_SCHED_H_
+
+#include <zephyr/kernel.h>
+
+struct led_sched_entry;
+
+/**
+ * @brief Serve a due entry
+ *
+ * The entry is no longer queued when its handler runs: the handler queues
+ * it again with led_sched_at() if it has a next deadline.
+ *
+ * @param entry Entry that is due
+ */
+typedef void (*led_sched_handler_t)(struct led_sched_entry *entry);
+
+/**
+ * @brief Scheduled wakeup of one animation
+ *
+ * Usually embedded in the state of the animation, which the handler gets
+ * back with CONTAINER_OF().
+ */
+struct led_sched_entry {
+    led_sched_handler_t handler;  /* Called when the deadline is reached */
+    int64_t deadline;             /* Uptime in ticks the entry is due at */
+    uint16_t slot;                /* Position in the heap, if queued */
+};
+
+/**
+ * @brief Called on every scheduler wakeup
+ *
+ * @param served Number of entries served by this wakeup
+ * @param late_us How late the wakeup was for the earliest of them
+ * @param user_data Pointer given with the callback
+ */
+typedef void (*led_sched_wakeup_cb_t)(uint32_t served, uint32_t late_us, void *user_data);
+
+/**
+ * @brief Prepare an entry, not queued
+ *
+ * @param entry Entry to prepare
+ * @param handler Function serving the entry when it is due
+ */
+void led_sched_entry_init(struct led_sched_entry *entry, led_sched_handler_t handler);
+
+/**
+ * @brief Queue an entry for an absolute deadline
+ *
+ * An entry that is already queued is moved to the new deadline. The
+ * single kernel timeout is only re-armed when the earliest deadline
+ * changes. May be called from any context, including handlers.
+ *
+ * @param entry Entry to queue
+ * @param deadline Uptime in ticks, as k_uptime_ticks()
+ *
+ * @retval 0 On success
+ * @retval -ENOMEM CONFIG_APP_LED_SCHED_MAX_ENTRIES entries are already queued
+ */
+int led_sched_at(struct led_sched_entry *entry, int64_t deadline);
+
+/**
+ * @brief Take an entry out of the queue
+ *
+ * Nothing happens if it is not queued. A handler that was already taken
+ * out of the heap for the current wakeup may still run once.
+ *
+ * @param entry Entry to cancel
+ */
+void led_sched_cancel(struct led_sched_entry *entry);
+
+/**
+ * @brief Reserve room in the heap for entries of a client
+ *
+ * A client that reserves one slot per entry it owns, once at init, can
+ * then ignore the return value of led_sched_at().
+ *
+ * @param count Number of entries of the client
+ *
+ * @retval 0 On success
+ * @retval -ENOMEM Fewer than @p count slots are left unreserved
+ */
+int led_sched_reserve(size_t count);
+
+/**
+ * @brief Coalescing window in kernel ticks
+ *
+ * Handlers serving several deadlines of their own use it to take along
+ * those due within the window, as the scheduler does with entries.
+ */
+k_ticks_t led_sched_window_ticks(void);
+
+/**
+ * @brief Change the coalescing window
+ *
+ * Starts as CONFIG_APP_LED_SCHED_WINDOW_US. 0 serves every entry exactly
+ * on its deadline.
+ *
+ * @param new_window_us New window in microseconds
+ */
+void led_sched_set_window_us(uint32_t new_window_us);
+
+/**
+ * @brief Register a callback called on every wakeup, or NULL to remove it
+ *
+ * The callback runs on the system work queue before the handlers.
+ */
+void led_sched_set_wakeup_callback(led_sched_wakeup_cb_t cb, void *user_data);
+
+/**
+ * @brief Number of scheduler wakeups since boot
+ */
+uint32_t led_sched_wakeups(void);
+
+#endif /* LED_SCHED_H_ */
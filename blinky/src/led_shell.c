@@ -0,0 +1,119 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * "led" shell command
+ *
+ *   led stats          Runtime statistics of every LED of the fade engine
+ *   led stats reset    Print them, then clear them
+ *
+ * Everything printed comes from led_fade_get_counters(), the global
+ * wakeup counters and the command queue statistics, which are read without
+ * taking the fade engine lock.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include "led_cmd.h"
+#include "led_fade.h"
+
+/* Scheduler wakeups and uptime at the previous "led stats" */
+static uint32_t last_wakeups;
+static int64_t last_uptime_ms;
+
+/**
+ * @brief Wakeups per second, in hundredths, over an interval
+ */
+static uint32_t wakeup_rate_x100(uint32_t wakeups, int64_t elapsed_ms)
+{
+    return (uint32_t)(((uint64_t)wakeups * MSEC_PER_SEC * 100U) / MAX(elapsed_ms, 1));
+}
+
+static void print_wakeups(const struct shell *sh)
+{
+    uint32_t wakeups = led_fade_wakeups();
+    int64_t now = k_uptime_get();
+    uint32_t since_boot = wakeup_rate_x100(wakeups, now);
+    uint32_t recent = wakeup_rate_x100(wakeups - last_wakeups, now - last_uptime_ms);
+
+    shell_print(sh, "sched: %u wakeups, %u.%02u/s since boot, %u.%02u/s since last stats, "
+                "%u frames skipped", wakeups, since_boot / 100, since_boot % 100,
+                recent / 100, recent % 100, led_fade_late_frames());
+
+    last_wakeups = wakeups;
+    last_uptime_ms = now;
+}
+
+static void print_commands(const struct shell *sh)
+{
+    struct led_cmd_stats s;
+
+    led_cmd_get_stats(&s);
+    shell_print(sh, "cmd: %u submitted, %u dropped, %u applied, %u refused, %u batches "
+                "(largest %u)", s.submitted, s.dropped, s.applied, s.errors, s.batches,
+                s.max_batch);
+}
+
+static void print_led(const struct shell *sh, size_t led)
+{
+    struct led_fade_counters c;
+
+    if (led_fade_get_counters(led, &c) < 0) {
+        return;
+    }
+
+    shell_print(sh, "led %u: pwm writes=%u skipped=%u errors=%u, fades=%u (%u sequenced) "
+                "fade_ms=%u, steps=%u worst_late_us=%u", (unsigned int)led, c.pwm_writes,
+                c.pwm_skipped, c.pwm_errors, c.fades, c.seq_plays, c.fade_time_ms,
+                c.steps, c.worst_late_us);
+
+    if (c.steps == 0) {
+        return;
+    }
+    shell_fprintf(sh, SHELL_NORMAL, "  late_us:");
+    for (size_t b = 0; b < LED_FADE_LATE_BUCKETS; b++) {
+        if (b + 1 < LED_FADE_LATE_BUCKETS) {
+            shell_fprintf(sh, SHELL_NORMAL, " <%u:%u", LED_FADE_LATE_BUCKET_LIMIT_US(b),
+                          c.late_hist[b]);
+        } else {
+            shell_fprintf(sh, SHELL_NORMAL, " >=%u:%u", LED_FADE_LATE_BUCKET_LIMIT_US(b - 1),
+                          c.late_hist[b]);
+        }
+    }
+    shell_fprintf(sh, SHELL_NORMAL, "\n");
+}
+
+static int cmd_led_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    bool reset = false;
+
+    if (argc > 1) {
+        if (strcmp(argv[1], "reset") != 0) {
+            shell_error(sh, "unknown argument: %s", argv[1]);
+            return -EINVAL;
+        }
+        reset = true;
+    }
+
+    print_wakeups(sh);
+    print_commands(sh);
+    for (size_t i = 0; i < led_fade_count(); i++) {
+        print_led(sh, i);
+        if (reset) {
+            (void)led_fade_reset_counters(i);
+        }
+    }
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_led,
+    SHELL_CMD_ARG(stats, NULL, "Fade engine statistics per LED [reset]", cmd_led_stats, 1, 1),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(led, &sub_led, "LED fade engine commands", NULL);
@@ -0,0 +1,233 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * LED frame streaming from a host over UART
+ *
+ * Receive path: the driver fills the receive buffers by DMA, two of them
+ * in turn, one being filled while the next one is queued. Every chunk the
+ * driver reports (UART_RX_RDY) is decoded right away, in the callback,
+ * straight from the buffer, so by the time the driver releases a buffer it
+ * has been fully consumed and can be handed back: the two buffers form a
+ * ring without any copy or any thread in between.
+ *
+ * The decoder is a small state machine fed one chunk at a time, so frames
+ * may span buffers. Only the levels of the frame being received are kept,
+ * converted to fade steps as they arrive, and handed to the fade engine
+ * when the CRC matches.
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/crc.h>
+
+#include "led_fade.h"
+#include "led_stream.h"
+
+#define STREAM_UART DT_CHOSEN(app_led_stream_uart)
+
+BUILD_ASSERT(DT_NODE_EXISTS(STREAM_UART),
+             "CONFIG_APP_LED_STREAM needs an app,led-stream-uart chosen node");
+
+/* One buffer being filled, one queued */
+#define LED_STREAM_RX_BUFS 2
+
+#define LED_STREAM_CRC_INIT 0xff
+
+enum led_stream_state {
+    LED_STREAM_HUNT,    /* Looking for a sync byte */
+    LED_STREAM_SEQ,
+    LED_STREAM_COUNT,
+    LED_STREAM_LEVELS,
+    LED_STREAM_CRC,
+};
+
+static const struct device *const uart = DEVICE_DT_GET(STREAM_UART);
+
+static uint8_t rx_bufs[LED_STREAM_RX_BUFS][CONFIG_APP_LED_STREAM_RX_BUF_SIZE];
+static size_t rx_next;  /* Buffer to hand to the driver next */
+
+/* Decoder state, only used by led_stream_feed() */
+static enum led_stream_state state;
+static uint8_t seq;
+static uint8_t count;       /* Levels in the frame */
+static uint16_t received;   /* Level bytes of the frame received so far */
+static uint8_t crc;
+static uint8_t level_lsb;   /* Low byte of the level being received */
+static uint16_t levels[CONFIG_APP_LED_STREAM_MAX_LEDS];  /* In fade steps */
+static bool seq_valid;      /* next_seq holds the expected sequence number */
+static uint8_t next_seq;
+
+static struct {
+    atomic_t frames;
+    atomic_t bytes;
+    atomic_t crc_errors;
+    atomic_t rejected;
+    atomic_t lost;
+    atomic_t rx_errors;
+    atomic_t frame_cycles;
+} stats;
+
+static uint8_t *led_stream_next_buf(void)
+{
+    uint8_t *buf = rx_bufs[rx_next];
+
+    rx_next = (rx_next + 1) % LED_STREAM_RX_BUFS;
+
+    return buf;
+}
+
+/**
+ * @brief Hand a complete, checked frame to the fade engine
+ */
+static void led_stream_apply(void)
+{
+    bool whole = true;
+
+    if (seq_valid && seq != next_seq) {
+        atomic_add(&stats.lost, (uint8_t)(seq - next_seq));
+    }
+    seq_valid = true;
+    next_seq = seq + 1;
+
+    /* A fading LED would drop its level: stop the fade there instead */
+    for (size_t i = 0; i < count; i++) {
+        if (led_fade_is_active(i) && led_fade_retarget(i, levels[i], 0) < 0) {
+            whole = false;
+        }
+    }
+    if (led_fade_set_levels(0, levels, count) < 0) {
+        atomic_inc(&stats.rejected);
+        return;
+    }
+    if (!whole) {
+        atomic_inc(&stats.rejected);
+    }
+
+    atomic_inc(&stats.frames);
+    atomic_set(&stats.frame_cycles, (atomic_val_t)k_cycle_get_32());
+}
+
+void led_stream_feed(const uint8_t *data, size_t len)
+{
+    size_t max_leds = MIN(led_fade_count(), CONFIG_APP_LED_STREAM_MAX_LEDS);
+
+    atomic_add(&stats.bytes, (atomic_val_t)len);
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t byte = data[i];
+
+        switch (state) {
+        case LED_STREAM_HUNT:
+            if (byte == LED_STREAM_SYNC) {
+                crc = LED_STREAM_CRC_INIT;
+                state = LED_STREAM_SEQ;
+            }
+            break;
+
+        case LED_STREAM_SEQ:
+            seq = byte;
+            crc = crc8_ccitt(crc, &byte, 1);
+            state = LED_STREAM_COUNT;
+            break;
+
+        case LED_STREAM_COUNT:
+            if (byte == 0 || byte > max_leds) {
+                atomic_inc(&stats.crc_errors);
+                state = LED_STREAM_HUNT;
+                break;
+            }
+            count = byte;
+            received = 0;
+            crc = crc8_ccitt(crc, &byte, 1);
+            state = LED_STREAM_LEVELS;
+            break;
+
+        case LED_STREAM_LEVELS: {
+            /* As many level bytes as this chunk holds, in one go */
+            size_t n = MIN(len - i, 2U * count - received);
+
+            crc = crc8_ccitt(crc, &data[i], n);
+            for (size_t k = 0; k < n; k++, received++) {
+                if (received % 2 == 0) {
+                    level_lsb = data[i + k];
+                } else {
+                    uint32_t level = level_lsb | (data[i + k] << 8);
+
+                    levels[received / 2] =
+                        (uint16_t)((level * FADE_STEPS + UINT16_MAX / 2) / UINT16_MAX);
+                }
+            }
+            i += n - 1;
+            if (received == 2U * count) {
+                state = LED_STREAM_CRC;
+            }
+            break;
+        }
+
+        case LED_STREAM_CRC:
+            if (byte == crc) {
+                led_stream_apply();
+            } else {
+                atomic_inc(&stats.crc_errors);
+            }
+            state = LED_STREAM_HUNT;
+            break;
+        }
+    }
+}
+
+static void led_stream_uart_cb(const struct device *dev, struct uart_event *evt,
+                               void *user_data)
+{
+    ARG_UNUSED(user_data);
+
+    switch (evt->type) {
+    case UART_RX_RDY:
+        led_stream_feed(&evt->data.rx.buf[evt->data.rx.offset], evt->data.rx.len);
+        break;
+    case UART_RX_BUF_REQUEST:
+        (void)uart_rx_buf_rsp(dev, led_stream_next_buf(), CONFIG_APP_LED_STREAM_RX_BUF_SIZE);
+        break;
+    case UART_RX_STOPPED:
+        atomic_inc(&stats.rx_errors);
+        break;
+    case UART_RX_DISABLED:
+        /* After an error, or if the driver ran out of buffers: start over */
+        state = LED_STREAM_HUNT;
+        (void)uart_rx_enable(dev, led_stream_next_buf(), CONFIG_APP_LED_STREAM_RX_BUF_SIZE,
+                             CONFIG_APP_LED_STREAM_RX_TIMEOUT_US);
+        break;
+    default:
+        break;
+    }
+}
+
+int led_stream_start(void)
+{
+    int ret;
+
+    if (!device_is_ready(uart)) {
+        return -ENODEV;
+    }
+
+    ret = uart_callback_set(uart, led_stream_uart_cb, NULL);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return uart_rx_enable(uart, led_stream_next_buf(), CONFIG_APP_LED_STREAM_RX_BUF_SIZE,
+                          CONFIG_APP_LED_STREAM_RX_TIMEOUT_US);
+}
+
+void led_stream_get_stats(struct led_stream_stats *out)
+{
+    out->frames = (uint32_t)atomic_get(&stats.frames);
+    out->bytes = (uint32_t)atomic_get(&stats.bytes);
+    out->crc_errors = (uint32_t)atomic_get(&stats.crc_errors);
+    out->rejected = (uint32_t)atomic_get(&stats.rejected);
+    out->lost = (uint32_t)atomic_get(&stats.lost);
+    out->rx_errors = (uint32_t)atomic_get(&stats.rx_errors);
+    out->frame_cycles = (uint32_t)atomic_get(&stats.frame_cycles);
+}
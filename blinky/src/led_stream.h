@@ -0,0 +1,83 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * LED frame streaming from a host over UART
+ *
+ * A host drives every LED of the LED table live by sending frames over the
+ * UART chosen as "app,led-stream-uart" in the devicetree. Each frame is
+ *
+ *   Byte     Field
+ *   0        Sync, LED_STREAM_SYNC
+ *   1        Sequence number, incremented by one per frame
+ *   2        Number of levels n, 1 to led_fade_count(), at most
+ *            CONFIG_APP_LED_STREAM_MAX_LEDS
+ *   3..2n+2  Levels of LEDs 0..n-1, u16 little-endian, 0 (off) to 65535
+ *            (full), in perceived brightness like the fade steps
+ *   2n+3     CRC-8 (polynomial 0x07, initial value 0xff) of bytes 1..2n+2
+ *
+ * A frame is applied as a whole with led_fade_set_levels(), on the next
+ * wakeup of the LED scheduler, with one commit per PWM controller: the LEDs
+ * of a controller change in the same PWM period, but controllers are
+ * written one after the other and may show the frame a period apart. LEDs
+ * that are fading when a frame reaches them are stopped at its level.
+ * Frames with a bad CRC are dropped, and the decoder hunts for the next
+ * sync byte. Gaps in the sequence numbers count lost frames.
+ *
+ * The UART is read with the asynchronous (DMA) API. The receive buffers
+ * form a ring handed to the driver in turn, and frames are decoded in place
+ * from them, in the receive callback: received bytes are never copied.
+ * scripts/led_stream_gen.py is a host-side frame generator.
+ */
+
+#ifndef LED_STREAM_H_
+#define LED_STREAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* First byte of every frame */
+#define LED_STREAM_SYNC 0xa5
+
+/**
+ * @brief Streaming statistics since boot
+ */
+struct led_stream_stats {
+    uint32_t frames;       /* Frames applied */
+    uint32_t bytes;        /* Bytes received */
+    uint32_t crc_errors;   /* Frames dropped for a bad CRC or length */
+    uint32_t rejected;     /* Good frames the fade engine refused, in whole or in part */
+    uint32_t lost;         /* Frames missing from the sequence numbers */
+    uint32_t rx_errors;    /* Receive errors reported by the UART driver */
+    uint32_t frame_cycles; /* k_cycle_get_32() when the last frame was decoded */
+};
+
+/**
+ * @brief Start receiving frames
+ *
+ * Must be called after led_fade_init().
+ *
+ * @retval 0 On success
+ * @retval -ENODEV The stream UART is not ready
+ * @retval <0 Error code of the UART driver
+ */
+int led_stream_start(void);
+
+/**
+ * @brief Decode received bytes
+ *
+ * Called by the receive callback with each chunk of a receive buffer;
+ * also lets the self-checks decode frames without a UART. Not reentrant.
+ *
+ * @param data Received bytes
+ * @param len Number of bytes
+ */
+void led_stream_feed(const uint8_t *data, size_t len);
+
+/**
+ * @brief Read the streaming statistics
+ */
+void led_stream_get_stats(struct led_stream_stats *stats);
+
+#endif /* LED_STREAM_H_ */
@@ -0,0 +1,66 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Fade engine trace points
+ *
+ * With CONFIG_APP_FADE_TRACING, the LED layer reports every wakeup of its
+ * scheduler, every LED step and every PWM driver call as Zephyr named trace
+ * events, which the CTF backend records with a timestamp.
+ * scripts/fade_trace.py turns a capture into per-LED timelines, idle time
+ * and lateness statistics.
+ *
+ * A named event carries two 32-bit words. Where an event needs more, an
+ * LED index goes in the upper 16 bits of the first word:
+ *
+ *   sched_wakeup  entries served         lateness behind the deadline, us
+ *   fade_step     led << 16 | step       pulse width, hardware cycles
+ *   fade_seq      led << 16 | frames     0
+ *   fade_done     led                    0, or negative error code
+ *   pwm_enter     led << 16 | channels   0
+ *   pwm_exit      led << 16 | channels   driver return value
+ *
+ * For pwm_enter/pwm_exit, led is the first LED of the controller written.
+ * The deadline a wakeup was armed for is its timestamp minus its lateness.
+ *
+ * Without CONFIG_APP_FADE_TRACING every macro expands to nothing and its
+ * arguments are not evaluated, so the instrumentation costs neither code
+ * nor time.
+ */
+
+#ifndef LED_TRACE_H_
+#define LED_TRACE_H_
+
+#ifdef CONFIG_APP_FADE_TRACING
+
+#include <zephyr/tracing/tracing.h>
+
+#define LED_TRACE_PACK(led, value) (((uint32_t)(led) << 16) | ((uint32_t)(value) & 0xffffU))
+
+#define LED_TRACE_WAKEUP(served, late_us)                                     \
+    sys_trace_named_event("sched_wakeup", (uint32_t)(served), (uint32_t)(late_us))
+#define LED_TRACE_STEP(led, step, pulse_cycles)                               \
+    sys_trace_named_event("fade_step", LED_TRACE_PACK(led, step),             \
+                          (uint32_t)(pulse_cycles))
+#define LED_TRACE_SEQ(led, frames)                                            \
+    sys_trace_named_event("fade_seq", LED_TRACE_PACK(led, frames), 0)
+#define LED_TRACE_DONE(led, error)                                            \
+    sys_trace_named_event("fade_done", (uint32_t)(led), (uint32_t)(error))
+#define LED_TRACE_PWM_ENTER(led, channels)                                    \
+    sys_trace_named_event("pwm_enter", LED_TRACE_PACK(led, channels), 0)
+#define LED_TRACE_PWM_EXIT(led, channels, ret)                                \
+    sys_trace_named_event("pwm_exit", LED_TRACE_PACK(led, channels), (uint32_t)(ret))
+
+#else
+
+#define LED_TRACE_WAKEUP(served, late_us)        do { } while (0)
+#define LED_TRACE_STEP(led, step, pulse_cycles)  do { } while (0)
+#define LED_TRACE_SEQ(led, frames)               do { } while (0)
+#define LED_TRACE_DONE(led, error)               do { } while (0)
+#define LED_TRACE_PWM_ENTER(led, channels)       do { } while (0)
+#define LED_TRACE_PWM_EXIT(led, channels, ret)   do { } while (0)
+
+#endif /* CONFIG_APP_FADE_TRACING */
+
+#endif /* LED_TRACE_H_ */
@@ -12,9 +12,13 @@
  * brightness transitions by varying the PWM duty cycle.
  * 
  * Key concepts demonstrated:
- * - PWM device tree integration
+ * - PWM device tree integration (LED table generated from all pwm-leds nodes)
  * - Duty cycle manipulation for brightness control
  * - Sequential LED control with fading effects
+ * - Non-blocking fades driven by the system work queue
+ * - Completion signals waited for with k_poll()
+ * - The LEDs shared with other subsystems through the Zephyr LED API
+ * - Keyframe animation programs run from flash
  * - Error handling for PWM operations
  */
 
@@ -22,165 +26,75 @@
 #include <zephyr/drivers/pwm.h> /* PWM driver API */
 #include <zephyr/sys/printk.h>  /* Console output functions */
 
-/*
- * PWM Configuration Constants
- * These define the timing and behavior of the fading effect
- */
-#define PWM_PERIOD_US   1000U  /* PWM period in microseconds (1kHz frequency)
-                                * Lower frequency = smoother fading but more visible flicker
-                                * Higher frequency = less smooth but no visible flicker */
-
-#define FADE_STEP_MS    10     /* Time between each fade step in milliseconds
-                                * Smaller values = smoother but slower fading
-                                * Larger values = faster but more stepped fading */
-
-#define FADE_STEPS      100    /* Number of steps in fade transition
-                                * More steps = smoother fading but takes longer
-                                * Fewer steps = faster but more noticeable steps */
-
-/*
- * Device Tree Node Definitions
- * These macros get the PWM LED nodes from the device tree overlay
- * DT_ALIAS() retrieves nodes defined in the "aliases" section
- */
-#define PWM_LED0_NODE   DT_ALIAS(pwm_led0)  /* References pwm_led0 alias */
-#define PWM_LED1_NODE   DT_ALIAS(pwm_led1)  /* References pwm_led1 alias */
-#define PWM_LED2_NODE   DT_ALIAS(pwm_led2)  /* References pwm_led2 alias */
-#define PWM_LED3_NODE   DT_ALIAS(pwm_led3)  /* References pwm_led3 alias */
-
-/*
- * PWM Device Specifications
- * These structures contain all the information needed to control each PWM LED
- * PWM_DT_SPEC_GET() extracts PWM controller, channel, period, and flags from device tree
- * 
- * Fallback mechanism: If pwm-led nodes don't exist, try regular led nodes
- * This provides compatibility with boards that don't have PWM LED definitions
- */
-#if DT_NODE_EXISTS(PWM_LED0_NODE)
-static const struct pwm_dt_spec pwm_led0 = PWM_DT_SPEC_GET(PWM_LED0_NODE);
-#else
-#define PWM_LED0_NODE   DT_ALIAS(led0)  /* Fallback to regular LED node */
-static const struct pwm_dt_spec pwm_led0 = PWM_DT_SPEC_GET_BY_IDX(PWM_LED0_NODE, 0);
-#endif
-
-#if DT_NODE_EXISTS(PWM_LED1_NODE)
-static const struct pwm_dt_spec pwm_led1 = PWM_DT_SPEC_GET(PWM_LED1_NODE);
-#else
-#define PWM_LED1_NODE   DT_ALIAS(led1)
-static const struct pwm_dt_spec pwm_led1 = PWM_DT_SPEC_GET_BY_IDX(PWM_LED1_NODE, 0);
-#endif
-
-#if DT_NODE_EXISTS(PWM_LED2_NODE)
-static const struct pwm_dt_spec pwm_led2 = PWM_DT_SPEC_GET(PWM_LED2_NODE);
-#else
-#define PWM_LED2_NODE   DT_ALIAS(led2)
-static const struct pwm_dt_spec pwm_led2 = PWM_DT_SPEC_GET_BY_IDX(PWM_LED2_NODE, 0);
-#endif
-
-#if DT_NODE_EXISTS(PWM_LED3_NODE)
-static const struct pwm_dt_spec pwm_led3 = PWM_DT_SPEC_GET(PWM_LED3_NODE);
-#else
-#define PWM_LED3_NODE   DT_ALIAS(led3)
-static const struct pwm_dt_spec pwm_led3 = PWM_DT_SPEC_GET_BY_IDX(PWM_LED3_NODE, 0);
-#endif
+#include "led_fade.h"           /* Non-blocking fade engine */
+#include "led_anim.h"           /* Keyframe animation interpreter */
+#include "led_cmd.h"            /* Commands queued from any thread or ISR */
+#include "led_api.h"            /* Zephyr LED API on the fade engine */
+#include "led_effects.h"        /* Built-in animation programs */
+#include "led_demo.h"           /* Blocking helpers: fade_led() and friends */
+#include "led_stream.h"         /* LED frames streamed from a host */
+#include "selftest.h"           /* native_sim self-checks */
+#include "bench.h"              /* Fade engine benchmarks */
 
 /*
- * Array of PWM LED specifications for easy iteration
- * This allows us to loop through all LEDs instead of handling each individually
+ * LED table
+ * The fade engine builds its LED table at compile time from every child of
+ * every "pwm-leds" node in the devicetree, so boards with any number of
+ * LEDs work without code changes. LEDs are addressed by their index.
  */
-static const struct pwm_dt_spec *pwm_leds[] = {
-    &pwm_led0,  /* LED 1 on nRF5340 DK */
-    &pwm_led1,  /* LED 2 on nRF5340 DK */
-    &pwm_led2,  /* LED 3 on nRF5340 DK */
-    &pwm_led3   /* LED 4 on nRF5340 DK */
-};
-
-#define NUM_LEDS ARRAY_SIZE(pwm_leds)  /* Calculate number of LEDs automatically */
+#define NUM_LEDS led_fade_count()  /* Number of LEDs found in the devicetree */
 
 /**
- * @brief Fade LED in or out with smooth transition
- * 
- * This function creates a smooth fading effect by gradually changing the PWM duty cycle.
- * PWM duty cycle determines how long the signal is HIGH vs LOW in each period:
- * - 0% duty cycle = LED off (signal always LOW)
- * - 50% duty cycle = LED at half brightness (signal HIGH 50% of time)
- * - 100% duty cycle = LED at full brightness (signal always HIGH)
- * 
- * @param led_spec Pointer to PWM LED specification structure
- * @param fade_in true for fade in (dark to bright), false for fade out (bright to dark)
+ * @brief Print how many PWM driver calls the shadow copy saved so far
  */
-static void fade_led(const struct pwm_dt_spec *led_spec, bool fade_in)
+static void print_pwm_counters(void)
 {
-    uint32_t pulse_width;  /* PWM pulse width in microseconds */
-    
-    /* 
-     * Loop through all fade steps to create smooth transition
-     * Each step calculates a new pulse width based on the current step
-     */
-    for (int step = 0; step <= FADE_STEPS; step++) {
-        if (fade_in) {
-            /* Fade in: Start at 0% and increase to 100% */
-            pulse_width = (PWM_PERIOD_US * step) / FADE_STEPS;
-        } else {
-            /* Fade out: Start at 100% and decrease to 0% */
-            pulse_width = (PWM_PERIOD_US * (FADE_STEPS - step)) / FADE_STEPS;
-        }
-        
-        /*
-         * Set the PWM signal with calculated pulse width
-         * pwm_set_dt() configures:
-         * - PWM period (how long each cycle lasts)
-         * - Pulse width (how long signal is HIGH in each cycle)
-         * The ratio pulse_width/period determines brightness
-         */
-        int ret = pwm_set_dt(led_spec, PWM_PERIOD_US, pulse_width);
-        if (ret < 0) {
-            printk("Error setting PWM: %d\n", ret);
-            return;  /* Exit on error to prevent further issues */
+    uint32_t writes = 0;
+    uint32_t skipped = 0;
+    uint32_t sequences = 0;
+
+    for (int i = 0; i < NUM_LEDS; i++) {
+        struct led_fade_counters counters;
+
+        if (led_fade_get_counters(i, &counters) == 0) {
+            writes += counters.pwm_writes;
+            skipped += counters.pwm_skipped;
+            sequences += counters.seq_plays;
         }
-        
-        /* 
-         * Small delay between steps creates the fading effect
-         * Without this delay, the change would be instantaneous
-         */
-        k_msleep(FADE_STEP_MS);
     }
+
+    printk("PWM driver calls: %u issued, %u skipped as redundant, %u fades sequenced\n",
+           writes, skipped, sequences);
 }
 
 /**
- * @brief Set LED brightness to specific percentage
- * 
- * This function provides direct brightness control without fading animation.
- * Useful for setting initial states or immediate brightness changes.
- * 
- * @param led_spec Pointer to PWM LED specification structure
- * @param brightness Brightness percentage (0-100)
- *                   0 = completely off, 100 = maximum brightness
+ * @brief Let a host drive the LEDs, reporting the link every few seconds
+ *
+ * @return Negative error code if streaming could not start
  */
-static void set_led_brightness(const struct pwm_dt_spec *led_spec, uint8_t brightness)
+static int stream_leds(void)
 {
-    /* Convert percentage to pulse width in microseconds */
-    uint32_t pulse_width = (PWM_PERIOD_US * brightness) / 100;
-    
-    /* Apply the PWM setting immediately */
-    int ret = pwm_set_dt(led_spec, PWM_PERIOD_US, pulse_width);
+    struct led_stream_stats prev = {0};
+    int ret = led_stream_start();
+
     if (ret < 0) {
-        printk("Error setting PWM brightness: %d\n", ret);
+        printk("Error: LED stream failed to start: %d\n", ret);
+        return ret;
     }
-}
+    printk("Waiting for LED frames from the host\n");
 
-/**
- * @brief Turn off all LEDs immediately
- * 
- * Sets all LEDs to 0% brightness (pulse width = 0).
- * Useful for initialization and cleanup.
- */
-static void turn_off_all_leds(void)
-{
-    /* Loop through all LEDs and set them to off */
-    for (int i = 0; i < NUM_LEDS; i++) {
-        pwm_set_dt(pwm_leds[i], PWM_PERIOD_US, 0);  /* 0 pulse width = LED off */
+    while (1) {
+        struct led_stream_stats stats;
+
+        k_sleep(K_SECONDS(5));
+        led_stream_get_stats(&stats);
+        printk("Stream: %u frames (%u/s), %u bytes, %u CRC errors, %u rejected, %u lost\n",
+               stats.frames, (stats.frames - prev.frames) / 5, stats.bytes,
+               stats.crc_errors, stats.rejected, stats.lost);
+        prev = stats;
     }
+
+    return 0;
 }
 
 /**
@@ -206,11 +120,45 @@ int main(void)
      * device_is_ready() returns true if the device driver is loaded and functional
      */
     for (int i = 0; i < NUM_LEDS; i++) {
-        if (!device_is_ready(pwm_leds[i]->dev)) {
-            printk("Error: PWM device %s is not ready\n", pwm_leds[i]->dev->name);
+        const struct pwm_dt_spec *led = led_fade_spec(i);
+
+        if (!device_is_ready(led->dev)) {
+            printk("Error: PWM device %s is not ready\n", led->dev->name);
             return -1;  /* Exit with error code */
         }
-        printk("PWM LED %d ready (device: %s)\n", i, pwm_leds[i]->dev->name);
+        printk("PWM LED %d ready (device: %s, channel %u)\n", i, led->dev->name,
+               led->channel);
+    }
+
+    /*
+     * Start the fade engine
+     * It caches the PWM clock of every LED before the first fade
+     */
+    ret = led_fade_init();
+    if (ret < 0) {
+        printk("Error: fade engine init failed: %d\n", ret);
+        return ret;
+    }
+
+    ret = led_anim_init();
+    if (ret < 0) {
+        printk("Error: animation init failed: %d\n", ret);
+        return ret;
+    }
+
+    ret = led_cmd_init();
+    if (ret < 0) {
+        printk("Error: command queue init failed: %d\n", ret);
+        return ret;
+    }
+
+    if (IS_ENABLED(CONFIG_APP_LED_API)) {
+        /* From here on, the LED API devices take calls */
+        ret = led_api_start();
+        if (ret < 0) {
+            printk("Error: LED API start failed: %d\n", ret);
+            return ret;
+        }
     }
     
     /*
@@ -219,31 +167,66 @@ int main(void)
      */
     turn_off_all_leds();
     printk("All LEDs initialized to OFF state\n");
+
+    if (IS_ENABLED(CONFIG_APP_SELFTEST)) {
+        /* native_sim test build: check the engine instead of looping forever */
+        return app_selftest();
+    }
+
+    if (IS_ENABLED(CONFIG_APP_BENCH)) {
+        /* Benchmark build: measure the engine and report the results */
+        return app_bench();
+    }
+
+    if (IS_ENABLED(CONFIG_APP_LED_STREAM)) {
+        /* Installation build: the LEDs follow the frames of a host */
+        return stream_leds();
+    }
     
     /*
      * Main Application Loop
      * Continuously cycles through LEDs with fading effects
      */
+    const struct led_effect *demo = led_effect_find("demo");
     int current_led = 0;  /* Index of currently active LED */
+
+    /*
+     * Completion of the running program, raised by the interpreter
+     * Other events (a button, a message queue) can be added to the array
+     * and served from this same thread, whatever the number of effects
+     */
+    struct k_poll_signal demo_done;
+    struct k_poll_event events[] = {
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &demo_done),
+    };
+    struct led_notify notify;
+
+    k_poll_signal_init(&demo_done);
     
     while (1) {  /* Infinite loop - typical for embedded applications */
         printk("Fading LED %d (User LED %d on board)\n", current_led, current_led + 1);
         
         /*
-         * Fade in sequence:
+         * Fade sequence, the "demo" program of led_effects.c:
          * 1. Gradually increase brightness from 0% to 100%
-         * 2. Hold at full brightness briefly
+         * 2. Hold at full brightness for 200ms
          * 3. Gradually decrease brightness from 100% to 0%
+         * 4. Pause for 100ms for visual separation
+         *
+         * The interpreter runs the program from flash on the LED scheduler
+         * and raises the signal when it ends; this thread only polls.
          */
-        
-        /* Phase 1: Fade in (dark to bright) */
-        fade_led(pwm_leds[current_led], true);
-        
-        /* Phase 2: Hold at full brightness */
-        k_msleep(200);  /* Keep LED on for 200ms */
-        
-        /* Phase 3: Fade out (bright to dark) */
-        fade_led(pwm_leds[current_led], false);
+        k_poll_signal_reset(&demo_done);
+        events[0].state = K_POLL_STATE_NOT_READY;
+        led_notify_init_signal(&notify, &demo_done);
+        ret = led_anim_submit(current_led, demo->program, demo->len, &notify);
+        if (ret == 0) {
+            (void)k_poll(events, ARRAY_SIZE(events), K_FOREVER);
+            ret = led_notify_result(&notify);
+        }
+        if (ret < 0) {
+            printk("Fade sequence failed: %d\n", ret);
+        }
         
         /*
          * Move to next LED in sequence
@@ -251,9 +234,9 @@ int main(void)
          * This creates a continuous cycling pattern: 0 -> 1 -> 2 -> 3 -> 0 -> ...
          */
         current_led = (current_led + 1) % NUM_LEDS;
-        
-        /* Small pause between LEDs for visual separation */
-        k_msleep(100);
+        if (current_led == 0) {
+            print_pwm_counters();  /* Once per round of all LEDs */
+        }
     }
     
     /*
@@ -0,0 +1,600 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Emulated PWM controller for native_sim
+ *
+ * There is no pin to drive, so set_cycles only stores the requested period
+ * and pulse per channel. The reported counter frequency comes from the
+ * devicetree "frequency" property so the PWM API performs the same unit
+ * conversions it would on real hardware.
+ *
+ * Sequence playback runs on one k_timer per channel, so the steps are
+ * applied from the timer interrupt on a drift-free period, as a DMA-fed
+ * peripheral would, while the application stays asleep.
+ *
+ * With CONFIG_PM_DEVICE the controller can be suspended, which stands for
+ * gating its clock: while suspended it refuses every write, as an
+ * unclocked peripheral would not apply it.
+ */
+
+#define DT_DRV_COMPAT vnd_pwm_emul
+
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/spinlock.h>
+
+#include "pwm_emul.h"
+#include "pwm_multi.h"
+#include "pwm_phase.h"
+#include "pwm_seq.h"
+
+struct pwm_emul_config {
+    uint32_t frequency_hz;  /* Counter clock reported to the PWM API */
+};
+
+/**
+ * @brief Sequence being played on one channel
+ */
+struct pwm_emul_player {
+    struct k_timer timer;        /* Stands in for the peripheral's step clock */
+    const struct device *dev;    /* Controller of the channel */
+    uint32_t channel;            /* Channel played on */
+    struct pwm_seq seq;          /* Sequence, buffer owned by the caller */
+    size_t next;                 /* Index of the next step to apply */
+    pwm_seq_done_t done;         /* Completion callback */
+    void *user_data;             /* Argument of done */
+};
+
+struct pwm_emul_data {
+    struct k_spinlock lock;  /* Protects the channel state */
+    struct pwm_emul_channel_state channels[PWM_EMUL_NUM_CHANNELS];
+    struct pwm_emul_player players[PWM_EMUL_NUM_CHANNELS];
+    uint32_t commits;        /* Number of calls that changed channels */
+    pwm_emul_commit_cb_t commit_cb;  /* Observer of commits, or NULL */
+    void *commit_cb_data;            /* Argument of commit_cb */
+    struct pwm_emul_capture *capture;  /* Capture buffer, NULL when not capturing */
+    size_t capture_size;               /* Entries in capture */
+    size_t capture_len;                /* Entries recorded so far */
+    uint32_t capture_dropped;          /* Changes that did not fit */
+    bool suspended;                    /* Suspended by power management */
+    uint32_t suspends;                 /* Number of times it was suspended */
+};
+
+/**
+ * @brief Record the state of a channel in the capture; the caller holds the lock
+ */
+static void pwm_emul_record(struct pwm_emul_data *data, uint32_t channel, int64_t now)
+{
+    const struct pwm_emul_channel_state *state = &data->channels[channel];
+
+    if (data->capture == NULL) {
+        return;
+    }
+    if (data->capture_len == data->capture_size) {
+        data->capture_dropped++;
+        return;
+    }
+
+    data->capture[data->capture_len++] = (struct pwm_emul_capture){
+        .time_us = k_ticks_to_us_floor64(now),
+        .channel = channel,
+        .period_cycles = state->period_cycles,
+        .pulse_cycles = state->pulse_cycles,
+    };
+}
+
+static bool pwm_emul_update_valid(const struct pwm_multi_update *update)
+{
+    return update->channel < PWM_EMUL_NUM_CHANNELS &&
+           update->pulse_cycles <= update->period_cycles;
+}
+
+/**
+ * @brief Tell the commit observer, if any; called without the lock
+ */
+static void pwm_emul_notify(const struct device *dev, pwm_emul_commit_cb_t cb,
+                            void *cb_data, uint32_t commit)
+{
+    if (cb != NULL) {
+        cb(dev, commit, cb_data);
+    }
+}
+
+/**
+ * @brief Apply updates as one commit; the caller holds the lock
+ */
+static void pwm_emul_apply(struct pwm_emul_data *data,
+                           const struct pwm_multi_update *updates, size_t count)
+{
+    int64_t now = k_uptime_ticks();
+
+    /* Callers checked that no sequence owns these channels */
+    data->commits++;
+    for (size_t i = 0; i < count; i++) {
+        struct pwm_emul_channel_state *state = &data->channels[updates[i].channel];
+
+        state->period_cycles = updates[i].period_cycles;
+        state->pulse_cycles = updates[i].pulse_cycles;
+        state->flags = updates[i].flags;
+        state->writes++;
+        state->last_write = now;
+        state->commit = data->commits;
+        pwm_emul_record(data, updates[i].channel, now);
+    }
+}
+
+static int pwm_emul_set_cycles(const struct device *dev, uint32_t channel,
+                               uint32_t period_cycles, uint32_t pulse_cycles,
+                               pwm_flags_t flags)
+{
+    struct pwm_emul_data *data = dev->data;
+    const struct pwm_multi_update update = {
+        .channel = channel,
+        .period_cycles = period_cycles,
+        .pulse_cycles = pulse_cycles,
+        .flags = flags,
+    };
+    pwm_emul_commit_cb_t cb;
+    void *cb_data;
+    uint32_t commit;
+    k_spinlock_key_t key;
+
+    if (!pwm_emul_update_valid(&update)) {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&data->lock);
+    if (data->suspended) {
+        k_spin_unlock(&data->lock, key);
+        return -EIO;  /* Not clocked */
+    }
+    if (data->channels[channel].playing) {
+        k_spin_unlock(&data->lock, key);
+        return -EBUSY;  /* The sequence owns the channel */
+    }
+    pwm_emul_apply(data, &update, 1);
+    commit = data->commits;
+    cb = data->commit_cb;
+    cb_data = data->commit_cb_data;
+    k_spin_unlock(&data->lock, key);
+
+    pwm_emul_notify(dev, cb, cb_data, commit);
+
+    return 0;
+}
+
+static int pwm_emul_set_cycles_multi(const struct device *dev,
+                                     const struct pwm_multi_update *updates,
+                                     size_t count)
+{
+    struct pwm_emul_data *data = dev->data;
+    pwm_emul_commit_cb_t cb;
+    void *cb_data;
+    uint32_t commit;
+    k_spinlock_key_t key;
+
+    /* All or nothing: validate everything before touching any channel */
+    for (size_t i = 0; i < count; i++) {
+        if (!pwm_emul_update_valid(&updates[i])) {
+            return -EINVAL;
+        }
+    }
+
+    key = k_spin_lock(&data->lock);
+    if (data->suspended) {
+        k_spin_unlock(&data->lock, key);
+        return -EIO;  /* Not clocked */
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (data->channels[updates[i].channel].playing) {
+            k_spin_unlock(&data->lock, key);
+            return -EBUSY;
+        }
+    }
+    pwm_emul_apply(data, updates, count);
+    commit = data->commits;
+    cb = data->commit_cb;
+    cb_data = data->commit_cb_data;
+    k_spin_unlock(&data->lock, key);
+
+    pwm_emul_notify(dev, cb, cb_data, commit);
+
+    return 0;
+}
+
+/**
+ * @brief Apply the next step of a sequence; the caller holds the lock
+ *
+ * @return true if that was the last step
+ */
+static bool pwm_emul_step(struct pwm_emul_data *data, struct pwm_emul_player *player)
+{
+    struct pwm_emul_channel_state *state = &data->channels[player->channel];
+
+    state->pulse_cycles = player->seq.pulse_cycles[player->next++];
+    state->seq_steps++;
+    state->last_step = k_uptime_ticks();
+    pwm_emul_record(data, player->channel, state->last_step);
+
+    if (player->next < player->seq.len) {
+        return false;
+    }
+
+    state->playing = false;
+
+    return true;
+}
+
+static void pwm_emul_step_expired(struct k_timer *timer)
+{
+    struct pwm_emul_player *player = CONTAINER_OF(timer, struct pwm_emul_player, timer);
+    struct pwm_emul_data *data = player->dev->data;
+    k_spinlock_key_t key;
+    bool last;
+
+    key = k_spin_lock(&data->lock);
+    if (!data->channels[player->channel].playing) {
+        /* Stopped while this expiry was on its way */
+        k_spin_unlock(&data->lock, key);
+        return;
+    }
+    last = pwm_emul_step(data, player);
+    if (last) {
+        /* Stopped before the channel can be claimed by a new sequence */
+        k_timer_stop(timer);
+    }
+    k_spin_unlock(&data->lock, key);
+
+    if (last) {
+        player->done(player->dev, player->channel, 0, player->user_data);
+    }
+}
+
+static int pwm_emul_seq_play(const struct device *dev, const struct pwm_seq *seq,
+                             pwm_seq_done_t done, void *user_data)
+{
+    const struct pwm_emul_config *config = dev->config;
+    struct pwm_emul_data *data = dev->data;
+    struct pwm_emul_player *player;
+    struct pwm_emul_channel_state *state;
+    uint64_t step_ns;
+    k_spinlock_key_t key;
+    bool last;
+
+    if (seq->channel >= PWM_EMUL_NUM_CHANNELS || seq->len == 0 ||
+        seq->step_periods == 0 || done == NULL) {
+        return -EINVAL;
+    }
+    for (size_t i = 0; i < seq->len; i++) {
+        if (seq->pulse_cycles[i] > seq->period_cycles) {
+            return -EINVAL;
+        }
+    }
+
+    /* How long the peripheral would hold each step */
+    step_ns = ((uint64_t)seq->step_periods * seq->period_cycles * NSEC_PER_SEC) /
+              config->frequency_hz;
+
+    player = &data->players[seq->channel];
+    state = &data->channels[seq->channel];
+
+    key = k_spin_lock(&data->lock);
+    if (data->suspended) {
+        k_spin_unlock(&data->lock, key);
+        return -EIO;  /* Not clocked */
+    }
+    if (state->playing) {
+        k_spin_unlock(&data->lock, key);
+        return -EBUSY;
+    }
+
+    player->dev = dev;
+    player->channel = seq->channel;
+    player->seq = *seq;
+    player->next = 0;
+    player->done = done;
+    player->user_data = user_data;
+
+    /* Uploading the sequence is one driver call, like any other write */
+    data->commits++;
+    state->period_cycles = seq->period_cycles;
+    state->flags = seq->flags;
+    state->writes++;
+    state->last_write = k_uptime_ticks();
+    state->commit = data->commits;
+    state->playing = true;
+    state->seq_start = state->last_write;
+
+    /* The first step goes out with the upload */
+    last = pwm_emul_step(data, player);
+    if (!last) {
+        k_timer_start(&player->timer, K_NSEC(step_ns), K_NSEC(step_ns));
+    }
+    k_spin_unlock(&data->lock, key);
+
+    if (last) {
+        done(dev, seq->channel, 0, user_data);
+    }
+
+    return 0;
+}
+
+static int pwm_emul_seq_stop(const struct device *dev, uint32_t channel, size_t *played)
+{
+    struct pwm_emul_data *data = dev->data;
+    k_spinlock_key_t key;
+
+    if (channel >= PWM_EMUL_NUM_CHANNELS) {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&data->lock);
+    if (!data->channels[channel].playing) {
+        k_spin_unlock(&data->lock, key);
+        return -EALREADY;
+    }
+    k_timer_stop(&data->players[channel].timer);
+    data->channels[channel].playing = false;
+    *played = data->players[channel].next;
+    k_spin_unlock(&data->lock, key);
+
+    return 0;
+}
+
+static int pwm_emul_get_cycles_per_sec(const struct device *dev, uint32_t channel,
+                                       uint64_t *cycles)
+{
+    const struct pwm_emul_config *config = dev->config;
+
+    if (channel >= PWM_EMUL_NUM_CHANNELS) {
+        return -EINVAL;
+    }
+
+    *cycles = config->frequency_hz;
+
+    return 0;
+}
+
+static int pwm_emul_set_phase(const struct device *dev, uint32_t channel,
+                              uint32_t offset_cycles)
+{
+    struct pwm_emul_data *data = dev->data;
+    k_spinlock_key_t key;
+
+    if (channel >= PWM_EMUL_NUM_CHANNELS) {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&data->lock);
+    data->channels[channel].phase_cycles = offset_cycles;
+    k_spin_unlock(&data->lock, key);
+
+    return 0;
+}
+
+int pwm_emul_get_channel(const struct device *dev, uint32_t channel,
+                         struct pwm_emul_channel_state *state)
+{
+    struct pwm_emul_data *data = dev->data;
+    k_spinlock_key_t key;
+
+    if (channel >= PWM_EMUL_NUM_CHANNELS) {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&data->lock);
+    *state = data->channels[channel];
+    k_spin_unlock(&data->lock, key);
+
+    return 0;
+}
+
+uint32_t pwm_emul_get_commits(const struct device *dev)
+{
+    struct pwm_emul_data *data = dev->data;
+    k_spinlock_key_t key;
+    uint32_t commits;
+
+    key = k_spin_lock(&data->lock);
+    commits = data->commits;
+    k_spin_unlock(&data->lock, key);
+
+    return commits;
+}
+
+void pwm_emul_set_commit_callback(const struct device *dev, pwm_emul_commit_cb_t cb,
+                                  void *user_data)
+{
+    struct pwm_emul_data *data = dev->data;
+    k_spinlock_key_t key;
+
+    key = k_spin_lock(&data->lock);
+    data->commit_cb = cb;
+    data->commit_cb_data = user_data;
+    k_spin_unlock(&data->lock, key);
+}
+
+void pwm_emul_capture_start(const struct device *dev, struct pwm_emul_capture *buf,
+                            size_t size)
+{
+    struct pwm_emul_data *data = dev->data;
+    int64_t now = k_uptime_ticks();
+    k_spinlock_key_t key;
+
+    key = k_spin_lock(&data->lock);
+    data->capture = buf;
+    data->capture_size = size;
+    data->capture_len = 0;
+    data->capture_dropped = 0;
+
+    /* Starting point of the waveform */
+    for (uint32_t ch = 0; ch < PWM_EMUL_NUM_CHANNELS; ch++) {
+        pwm_emul_record(data, ch, now);
+    }
+    k_spin_unlock(&data->lock, key);
+}
+
+size_t pwm_emul_capture_stop(const struct device *dev, uint32_t *dropped)
+{
+    struct pwm_emul_data *data = dev->data;
+    k_spinlock_key_t key;
+    size_t len;
+
+    key = k_spin_lock(&data->lock);
+    len = data->capture_len;
+    if (dropped != NULL) {
+        *dropped = data->capture_dropped;
+    }
+    data->capture = NULL;
+    k_spin_unlock(&data->lock, key);
+
+    return len;
+}
+
+int pwm_emul_get_on_window(const struct device *dev, uint32_t channel,
+                           pwm_flags_t led_flags, struct pwm_emul_window *window)
+{
+    struct pwm_emul_channel_state state;
+    uint32_t pulse_ppm;
+    uint32_t phase_ppm;
+    int ret;
+
+    ret = pwm_emul_get_channel(dev, channel, &state);
+    if (ret < 0) {
+        return ret;
+    }
+    if (state.period_cycles == 0) {
+        /* Never programmed: the LED is off */
+        *window = (struct pwm_emul_window){ 0 };
+        return 0;
+    }
+
+    pulse_ppm = (uint32_t)(((uint64_t)state.pulse_cycles * 1000000U) / state.period_cycles);
+    phase_ppm = (uint32_t)(((uint64_t)(state.phase_cycles % state.period_cycles) * 1000000U) /
+                           state.period_cycles);
+
+    if ((state.flags & PWM_POLARITY_MASK) == (led_flags & PWM_POLARITY_MASK)) {
+        window->start_ppm = phase_ppm;
+        window->len_ppm = pulse_ppm;
+    } else {
+        /* Inverted: lit once the pulse is over, until the end of the period */
+        window->start_ppm = (phase_ppm + pulse_ppm) % 1000000U;
+        window->len_ppm = 1000000U - pulse_ppm;
+    }
+
+    return 0;
+}
+
+uint32_t pwm_emul_peak_on(const struct pwm_emul_window *windows, size_t count)
+{
+    uint32_t peak = 0;
+
+    /* The count only goes up where a window starts: look at those points */
+    for (size_t i = 0; i < count; i++) {
+        uint32_t on = 0;
+
+        if (windows[i].len_ppm == 0) {
+            continue;
+        }
+        for (size_t j = 0; j < count; j++) {
+            uint32_t from_start = (windows[i].start_ppm + 1000000U - windows[j].start_ppm) %
+                                  1000000U;
+
+            if (from_start < windows[j].len_ppm) {
+                on++;
+            }
+        }
+        peak = MAX(peak, on);
+    }
+
+    return peak;
+}
+
+const struct pwm_multi_api pwm_emul_multi_api = {
+    .set_cycles = pwm_emul_set_cycles_multi,
+};
+
+const struct pwm_seq_api pwm_emul_seq_api = {
+    .play = pwm_emul_seq_play,
+    .stop = pwm_emul_seq_stop,
+};
+
+const struct pwm_phase_api pwm_emul_phase_api = {
+    .set_phase = pwm_emul_set_phase,
+};
+
+bool pwm_emul_is_suspended(const struct device *dev)
+{
+    struct pwm_emul_data *data = dev->data;
+
+    return data->suspended;
+}
+
+uint32_t pwm_emul_get_suspends(const struct device *dev)
+{
+    struct pwm_emul_data *data = dev->data;
+
+    return data->suspends;
+}
+
+static int pwm_emul_pm_action(const struct device *dev, enum pm_device_action action)
+{
+    struct pwm_emul_data *data = dev->data;
+    k_spinlock_key_t key;
+    int ret = 0;
+
+    key = k_spin_lock(&data->lock);
+    switch (action) {
+    case PM_DEVICE_ACTION_SUSPEND:
+        for (size_t i = 0; i < PWM_EMUL_NUM_CHANNELS; i++) {
+            if (data->channels[i].playing) {
+                ret = -EBUSY;  /* The sequence needs the clock */
+            }
+        }
+        if (ret == 0) {
+            data->suspended = true;
+            data->suspends++;
+        }
+        break;
+    case PM_DEVICE_ACTION_RESUME:
+        data->suspended = false;
+        break;
+    default:
+        ret = -ENOTSUP;
+        break;
+    }
+    k_spin_unlock(&data->lock, key);
+
+    return ret;
+}
+
+static int pwm_emul_init(const struct device *dev)
+{
+    struct pwm_emul_data *data = dev->data;
+
+    for (size_t i = 0; i < PWM_EMUL_NUM_CHANNELS; i++) {
+        k_timer_init(&data->players[i].timer, pwm_emul_step_expired, NULL);
+    }
+
+    return 0;
+}
+
+static const struct pwm_driver_api pwm_emul_api = {
+    .set_cycles = pwm_emul_set_cycles,
+    .get_cycles_per_sec = pwm_emul_get_cycles_per_sec,
+};
+
+#define PWM_EMUL_DEFINE(n)                                                   \
+    static struct pwm_emul_data pwm_emul_data_##n;                           \
+    static const struct pwm_emul_config pwm_emul_config_##n = {              \
+        .frequency_hz = DT_INST_PROP(n, frequency),                          \
+    };                                                                       \
+    PM_DEVICE_DT_INST_DEFINE(n, pwm_emul_pm_action);                         \
+    DEVICE_DT_INST_DEFINE(n, pwm_emul_init, PM_DEVICE_DT_INST_GET(n),        \
+                          &pwm_emul_data_##n,                                \
+                          &pwm_emul_config_##n, POST_KERNEL,                 \
+                          CONFIG_PWM_INIT_PRIORITY, &pwm_emul_api);
+
+DT_INST_FOREACH_STATUS_OKAY(PWM_EMUL_DEFINE)
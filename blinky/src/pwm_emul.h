@@ -0,0 +1,195 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Emulated PWM controller (compatible "vnd,pwm-emul")
+ *
+ * The driver accepts the regular PWM API, plus the multi-channel extension
+ * of pwm_multi.h and the phase offsets of pwm_phase.h, and remembers what was programmed on each channel. Checks
+ * running on native_sim read that state back with pwm_emul_get_channel().
+ *
+ * Every call that changes channels, single or multi-channel, is one
+ * "commit" of the controller. Channels updated together share a commit
+ * number, which shows whether a frame reached the hardware atomically.
+ *
+ * Sequence playback (pwm_seq.h) is emulated with a kernel timer per
+ * channel standing in for the peripheral: it applies one step per step
+ * duration and timestamps it, with no driver call.
+ *
+ * Every change of a channel can also be recorded, with its time, into a
+ * capture buffer supplied by the caller (pwm_emul_capture_start()). The
+ * self-checks compare such captures with golden traces.
+ *
+ * With CONFIG_PM_DEVICE, the controller supports suspend and resume, and
+ * rejects writes with -EIO while suspended.
+ *
+ * For current analysis, pwm_emul_get_on_window() tells which part of the
+ * period a channel keeps its LED lit, and pwm_emul_peak_on() how many LEDs
+ * are lit at once at worst over a set of such windows.
+ */
+
+#ifndef PWM_EMUL_H_
+#define PWM_EMUL_H_
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/pwm.h>
+
+/* Channels provided by every emulated controller instance */
+#define PWM_EMUL_NUM_CHANNELS 4
+
+/**
+ * @brief Snapshot of one emulated PWM channel
+ */
+struct pwm_emul_channel_state {
+    uint32_t period_cycles;  /* Last period programmed */
+    uint32_t pulse_cycles;   /* Last pulse width programmed */
+    pwm_flags_t flags;       /* Last flags programmed */
+    uint32_t phase_cycles;   /* Start of the pulse within the period */
+    uint32_t writes;         /* Number of set_cycles calls on this channel */
+    int64_t last_write;      /* Uptime in ticks of the last set_cycles call */
+    uint32_t commit;         /* Controller commit that last wrote the channel */
+    bool playing;            /* A sequence is playing on the channel */
+    uint32_t seq_steps;      /* Sequence steps applied so far, all sequences */
+    int64_t seq_start;       /* Uptime in ticks the last sequence started */
+    int64_t last_step;       /* Uptime in ticks of the last step applied */
+};
+
+/**
+ * @brief One recorded change of an emulated PWM channel
+ */
+struct pwm_emul_capture {
+    uint64_t time_us;        /* Uptime of the change in microseconds */
+    uint32_t channel;        /* Channel that changed */
+    uint32_t period_cycles;  /* Period from then on */
+    uint32_t pulse_cycles;   /* Pulse width from then on */
+};
+
+/**
+ * @brief Part of the PWM period during which a channel lights its LED
+ *
+ * In parts per million of the period, from its start. A window may wrap
+ * around the end of the period.
+ */
+struct pwm_emul_window {
+    uint32_t start_ppm;  /* Where the LED turns on */
+    uint32_t len_ppm;    /* How long it stays on */
+};
+
+/**
+ * @brief Read back the state of an emulated PWM channel
+ *
+ * @param dev Emulated PWM controller
+ * @param channel Channel number
+ * @param state Filled with the current channel state
+ *
+ * @retval 0 On success
+ * @retval -EINVAL The channel does not exist
+ */
+int pwm_emul_get_channel(const struct device *dev, uint32_t channel,
+                         struct pwm_emul_channel_state *state);
+
+/**
+ * @brief Called after every commit of an emulated controller
+ *
+ * Runs in the context of the driver call, right after the channels were
+ * changed, so it can timestamp when frames reach the "hardware".
+ *
+ * @param dev Emulated PWM controller
+ * @param commit Number of the commit that just happened
+ * @param user_data Pointer given to pwm_emul_set_commit_callback()
+ */
+typedef void (*pwm_emul_commit_cb_t)(const struct device *dev, uint32_t commit,
+                                     void *user_data);
+
+/**
+ * @brief Install or remove the commit callback of a controller
+ *
+ * @param dev Emulated PWM controller
+ * @param cb Callback, or NULL to remove it
+ * @param user_data Passed to @p cb
+ */
+void pwm_emul_set_commit_callback(const struct device *dev, pwm_emul_commit_cb_t cb,
+                                  void *user_data);
+
+/**
+ * @brief Number of commits (driver calls that changed channels) so far
+ *
+ * @param dev Emulated PWM controller
+ */
+uint32_t pwm_emul_get_commits(const struct device *dev);
+
+/**
+ * @brief Start recording every channel change of a controller
+ *
+ * The current state of every channel is recorded first, at the current
+ * time, so the capture describes the whole waveform from this point on.
+ * Then each change, from regular writes, multi-channel commits or
+ * sequence steps, is appended until @p buf is full. Later changes are only
+ * counted. A capture already running is replaced.
+ *
+ * @param dev Emulated PWM controller
+ * @param buf Buffer for the records; must stay valid until stopped
+ * @param size Number of entries in @p buf
+ */
+void pwm_emul_capture_start(const struct device *dev, struct pwm_emul_capture *buf,
+                            size_t size);
+
+/**
+ * @brief Stop recording
+ *
+ * @param dev Emulated PWM controller
+ * @param dropped If not NULL, set to the number of changes that did not fit
+ *
+ * @return Number of entries recorded in the buffer
+ */
+size_t pwm_emul_capture_stop(const struct device *dev, uint32_t *dropped);
+
+/**
+ * @brief Check whether a controller is suspended by power management
+ *
+ * @param dev Emulated PWM controller
+ */
+bool pwm_emul_is_suspended(const struct device *dev);
+
+/**
+ * @brief Number of times a controller was suspended since boot
+ *
+ * @param dev Emulated PWM controller
+ */
+uint32_t pwm_emul_get_suspends(const struct device *dev);
+
+/**
+ * @brief Window of the period during which a channel lights its LED
+ *
+ * An LED is lit during the pulse when the channel is programmed with the
+ * flags the LED is wired for, and during the rest of the period when the
+ * polarity was inverted. The phase offset of the channel shifts both.
+ *
+ * @param dev Emulated PWM controller
+ * @param channel Channel number
+ * @param led_flags PWM flags of the LED, as given by its devicetree node
+ * @param window Filled with the lit part of the period
+ *
+ * @retval 0 On success
+ * @retval -EINVAL The channel does not exist
+ */
+int pwm_emul_get_on_window(const struct device *dev, uint32_t channel,
+                           pwm_flags_t led_flags, struct pwm_emul_window *window);
+
+/**
+ * @brief Largest number of windows that overlap at any point of the period
+ *
+ * This is the peak number of LEDs lit at the same time, which sets the
+ * peak current drawn from their supply. All windows are taken on the same
+ * time base, i.e. with the periods of all controllers starting together,
+ * the worst case for controllers that are not synchronized.
+ *
+ * @param windows Windows of every LED
+ * @param count Number of windows
+ *
+ * @return Peak number of LEDs lit at once
+ */
+uint32_t pwm_emul_peak_on(const struct pwm_emul_window *windows, size_t count);
+
+#endif /* PWM_EMUL_H_ */
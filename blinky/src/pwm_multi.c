@@ -0,0 +1,39 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Multi-channel PWM updates: dispatch and fallback
+ */
+
+#include <zephyr/kernel.h>
+
+#include "pwm_multi.h"
+
+int pwm_multi_set_cycles(const struct device *dev, const struct pwm_multi_api *api,
+                         const struct pwm_multi_update *updates, size_t count)
+{
+    int ret = 0;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    if (api != NULL) {
+        /* Native support: one driver call for the whole controller */
+        return api->set_cycles(dev, updates, count);
+    }
+
+    /* Keep the calls together: no other thread may run in between */
+    k_sched_lock();
+    for (size_t i = 0; i < count; i++) {
+        ret = pwm_set_cycles(dev, updates[i].channel, updates[i].period_cycles,
+                             updates[i].pulse_cycles, updates[i].flags);
+        if (ret < 0) {
+            break;
+        }
+    }
+    k_sched_unlock();
+
+    return ret;
+}
@@ -0,0 +1,88 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Multi-channel PWM updates
+ *
+ * The PWM API programs one channel per call. When several LEDs share a
+ * controller, a frame is better applied to all of its channels in one
+ * operation: one driver call instead of one per channel, and no period in
+ * which some channels show the new frame and others the old one.
+ *
+ * Drivers that can do this natively expose a struct pwm_multi_api. It is
+ * looked up at compile time from the compatible of the controller node, so
+ * there is no runtime discovery. For other controllers pwm_multi_set_cycles()
+ * falls back to back-to-back pwm_set_cycles() calls.
+ */
+
+#ifndef PWM_MULTI_H_
+#define PWM_MULTI_H_
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/pwm.h>
+#include <zephyr/sys/util.h>
+
+/**
+ * @brief New settings for one channel of a controller
+ */
+struct pwm_multi_update {
+    uint32_t channel;        /* Channel of the controller */
+    uint32_t period_cycles;  /* Period in hardware cycles */
+    uint32_t pulse_cycles;   /* Pulse width in hardware cycles */
+    pwm_flags_t flags;       /* PWM flags, e.g. polarity */
+};
+
+/**
+ * @brief Apply several channel updates of one controller at once
+ *
+ * The driver validates every update before applying any, and all of them
+ * take effect from the same PWM period.
+ *
+ * @return 0 on success, negative error code if nothing was applied
+ */
+typedef int (*pwm_multi_set_cycles_t)(const struct device *dev,
+                                      const struct pwm_multi_update *updates,
+                                      size_t count);
+
+/**
+ * @brief Multi-channel extension of a PWM driver
+ */
+struct pwm_multi_api {
+    pwm_multi_set_cycles_t set_cycles;
+};
+
+#ifdef CONFIG_APP_PWM_EMUL
+extern const struct pwm_multi_api pwm_emul_multi_api;
+#endif
+
+/**
+ * @brief Multi-channel extension of a PWM controller node, or NULL
+ *
+ * Resolved at compile time from the compatible of @p ctlr_node.
+ */
+#define PWM_MULTI_API_GET(ctlr_node)                                          \
+    COND_CODE_1(DT_NODE_HAS_COMPAT(ctlr_node, vnd_pwm_emul),                  \
+                (&pwm_emul_multi_api), (NULL))
+
+/**
+ * @brief Apply several channel updates of one controller
+ *
+ * Uses @p api when the controller has one. Otherwise the updates are issued
+ * as pwm_set_cycles() calls back to back with the scheduler locked, so they
+ * land in as few PWM periods as the hardware allows; on controllers that
+ * latch new values at the end of a period (such as the nRF PWM) that is
+ * normally the same one. The fallback stops at the first error.
+ *
+ * @param dev PWM controller
+ * @param api Multi-channel extension of the controller, or NULL
+ * @param updates Channel updates
+ * @param count Number of entries in @p updates
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int pwm_multi_set_cycles(const struct device *dev, const struct pwm_multi_api *api,
+                         const struct pwm_multi_update *updates, size_t count);
+
+#endif /* PWM_MULTI_H_ */
@@ -0,0 +1,64 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * PWM channel phase offsets
+ *
+ * Edge-aligned PWM channels all switch on at the start of their period, so
+ * the current of every LED lit at that moment is drawn at once. Many PWM
+ * peripherals can delay the start of the pulse of each channel within the
+ * period (a phase offset or compare shift), which spreads those rising
+ * edges out.
+ *
+ * The PWM API has no call for this. Drivers that support it expose a
+ * struct pwm_phase_api, which is looked up at compile time from the
+ * compatible of the controller node, like pwm_multi.h. For controllers
+ * without one, PWM_PHASE_API_GET() gives NULL.
+ */
+
+#ifndef PWM_PHASE_H_
+#define PWM_PHASE_H_
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/sys/util.h>
+
+/**
+ * @brief Delay the start of the pulse of a channel within its period
+ *
+ * The offset wraps around: a pulse that would run past the end of the
+ * period continues at the start of the next one. It applies to every
+ * period and pulse programmed afterwards.
+ *
+ * @param dev PWM controller
+ * @param channel Channel of the controller
+ * @param offset_cycles Delay from the start of the period, in cycles
+ *
+ * @retval 0 On success
+ * @retval -EINVAL Invalid channel
+ */
+typedef int (*pwm_phase_set_t)(const struct device *dev, uint32_t channel,
+                               uint32_t offset_cycles);
+
+/**
+ * @brief Phase offset extension of a PWM driver
+ */
+struct pwm_phase_api {
+    pwm_phase_set_t set_phase;
+};
+
+#ifdef CONFIG_APP_PWM_EMUL
+extern const struct pwm_phase_api pwm_emul_phase_api;
+#endif
+
+/**
+ * @brief Phase offset extension of a PWM controller node, or NULL
+ *
+ * Resolved at compile time from the compatible of @p ctlr_node.
+ */
+#define PWM_PHASE_API_GET(ctlr_node)                                          \
+    COND_CODE_1(DT_NODE_HAS_COMPAT(ctlr_node, vnd_pwm_emul),                  \
+                (&pwm_emul_phase_api), (NULL))
+
+#endif /* PWM_PHASE_H_ */
@@ -0,0 +1,110 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * PWM sequence playback
+ *
+ * Some PWM peripherals can play a buffer of duty values from RAM on their
+ * own, one value every few PWM periods, while the CPU sleeps. The nRF PWM,
+ * for example, fetches a sequence by DMA and repeats each value for a
+ * configurable number of periods. A whole fade is then a single upload
+ * and a single completion interrupt.
+ *
+ * The PWM API has no call for this. Drivers that support it expose a
+ * struct pwm_seq_api, which is looked up at compile time from the
+ * compatible of the controller node, like pwm_multi.h. For controllers
+ * without one, PWM_SEQ_API_GET() gives NULL and the caller steps the
+ * channel itself.
+ */
+
+#ifndef PWM_SEQ_H_
+#define PWM_SEQ_H_
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/pwm.h>
+#include <zephyr/sys/util.h>
+
+/**
+ * @brief Sequence of pulse widths to play on one channel
+ *
+ * The buffer is read by the peripheral while it plays, so it must stay
+ * valid and unchanged until the completion callback has run.
+ */
+struct pwm_seq {
+    uint32_t channel;              /* Channel of the controller */
+    uint32_t period_cycles;        /* PWM period in hardware cycles */
+    pwm_flags_t flags;             /* PWM flags, e.g. polarity */
+    const uint32_t *pulse_cycles;  /* Pulse width of each step, in cycles */
+    size_t len;                    /* Number of steps */
+    uint32_t step_periods;         /* PWM periods each step is held for */
+};
+
+/**
+ * @brief Called once the last step of a sequence has been applied
+ *
+ * May run in interrupt context. The channel keeps the last pulse width of
+ * the sequence.
+ *
+ * @param dev PWM controller
+ * @param channel Channel the sequence played on
+ * @param status 0 if the whole sequence played, negative error code otherwise
+ * @param user_data Pointer given to pwm_seq_play_t
+ */
+typedef void (*pwm_seq_done_t)(const struct device *dev, uint32_t channel,
+                               int status, void *user_data);
+
+/**
+ * @brief Start playing a sequence
+ *
+ * The first step is applied right away, the following ones every
+ * @c step_periods PWM periods, without the CPU.
+ *
+ * @retval 0 Playback started; @p done will be called
+ * @retval -EINVAL Invalid channel or step
+ * @retval -EBUSY A sequence is already playing on the channel
+ */
+typedef int (*pwm_seq_play_t)(const struct device *dev, const struct pwm_seq *seq,
+                              pwm_seq_done_t done, void *user_data);
+
+/**
+ * @brief Stop a sequence where it is
+ *
+ * The channel keeps the pulse width of the step being played, and the
+ * completion callback is not called. May be called from any context; the
+ * fade engine calls it with none of its locks held.
+ *
+ * @param dev PWM controller
+ * @param channel Channel the sequence plays on
+ * @param played Filled with the number of steps applied so far
+ *
+ * @retval 0 The sequence was stopped
+ * @retval -EINVAL Invalid channel
+ * @retval -EALREADY No sequence plays on the channel: it has ended, and
+ *                   its completion callback is called or about to be
+ */
+typedef int (*pwm_seq_stop_t)(const struct device *dev, uint32_t channel, size_t *played);
+
+/**
+ * @brief Sequence playback extension of a PWM driver
+ */
+struct pwm_seq_api {
+    pwm_seq_play_t play;
+    pwm_seq_stop_t stop;  /* NULL if a sequence always plays to its end */
+};
+
+#ifdef CONFIG_APP_PWM_EMUL
+extern const struct pwm_seq_api pwm_emul_seq_api;
+#endif
+
+/**
+ * @brief Sequence playback extension of a PWM controller node, or NULL
+ *
+ * Resolved at compile time from the compatible of @p ctlr_node.
+ */
+#define PWM_SEQ_API_GET(ctlr_node)                                            \
+    COND_CODE_1(DT_NODE_HAS_COMPAT(ctlr_node, vnd_pwm_emul),                  \
+                (&pwm_emul_seq_api), (NULL))
+
+#endif /* PWM_SEQ_H_ */
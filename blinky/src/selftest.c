@@ -0,0 +1,1715 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Self-checks for native_sim
+ *
+ * Each check drives the fade engine against the emulated PWM controller
+ * and compares what reached the "hardware" with what was expected.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/led.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/printk.h>
+
+#include "golden_traces.h"  /* Generated from golden/ at build time */
+#include "led_anim.h"
+#include "led_api.h"
+#include "led_cmd.h"
+#include "led_comp.h"
+#include "led_demo.h"
+#include "led_effects.h"
+#include "led_fade.h"
+#include "led_gamma_table.h"
+#include "led_sched.h"
+#include "led_stream.h"
+#include "pwm_emul.h"
+#include "selftest.h"
+
+/* Most checks use the first LED of the devicetree LED table */
+#define TEST_LED 0
+
+static int failures;  /* Number of failed CHECK()s */
+
+/*
+ * Golden trace comparison
+ * A change may land up to GOLDEN_TIME_TOL_MS after its golden time, and a
+ * duty may differ by GOLDEN_DUTY_TOL_PPM, a bit more than one cycle of the
+ * 16 MHz emulated counter over a 1 ms period.
+ */
+#define GOLDEN_TIME_TOL_MS   1
+#define GOLDEN_DUTY_TOL_PPM  100
+#define CAPTURE_SIZE         256
+
+/* Entries of a sequenced ramp per frame: one per PWM period when dithering */
+#define SEQ_STEPS_PER_FRAME \
+    (IS_ENABLED(CONFIG_APP_FADE_DITHER) ? (FADE_STEP_MS * USEC_PER_MSEC) / PWM_PERIOD_US : 1)
+
+/* Frames of the dithering check, held at its lowest non-zero level */
+#define DITHER_FRAMES        10
+
+/* LEDs looked at by the staggering check */
+#define STAGGER_MAX_LEDS     64
+
+static struct pwm_emul_capture capture[CAPTURE_SIZE];
+static struct golden_point captured[CAPTURE_SIZE];
+
+/*
+ * Artificial CPU load: a thread above the system work queue priority that
+ * hogs the CPU for 2.5 frames out of every 10, delaying the fade steps
+ */
+#define LOAD_STACK_SIZE  1024
+#define LOAD_BURST_US    (FADE_STEP_MS * 2500)
+#define LOAD_PERIOD_MS   (FADE_STEP_MS * 10)
+
+K_THREAD_STACK_DEFINE(load_stack, LOAD_STACK_SIZE);
+static struct k_thread load_thread;
+static int64_t load_until;  /* Uptime in ms at which the load stops */
+
+#define CHECK(cond, fmt, ...)                                                \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            printk("selftest: FAIL %s:%d: " fmt "\n", __func__, __LINE__,   \
+                   ##__VA_ARGS__);                                           \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+/**
+ * @brief Read back the channel of an LED from the emulated controller
+ *
+ * The pulse width is the time the LED is lit: for an LED right-aligned by
+ * CONFIG_APP_PWM_STAGGER, whose polarity is inverted, that is the rest of
+ * the period after the programmed pulse.
+ */
+static struct pwm_emul_channel_state led_state(size_t led)
+{
+    const struct pwm_dt_spec *spec = led_fade_spec(led);
+    struct pwm_emul_channel_state state = {0};
+
+    (void)pwm_emul_get_channel(spec->dev, spec->channel, &state);
+    if ((state.flags & PWM_POLARITY_MASK) != (spec->flags & PWM_POLARITY_MASK)) {
+        state.pulse_cycles = state.period_cycles - state.pulse_cycles;
+    }
+
+    return state;
+}
+
+/**
+ * @brief A fade must not block its caller and must end at full/zero duty
+ */
+static void check_fade_is_nonblocking(void)
+{
+    struct pwm_emul_channel_state state;
+    uint32_t slices = 0;  /* Times this thread ran while the LED faded */
+    int64_t start;
+    int64_t elapsed;
+    int ret;
+
+    start = k_uptime_get();
+    ret = led_fade_start(TEST_LED, true);
+    CHECK(ret == 0, "start returned %d", ret);
+    ret = led_fade_start(TEST_LED, true);
+    CHECK(ret == -EBUSY, "second start returned %d", ret);
+
+    /* The caller keeps running while the work queue steps the LED */
+    while (led_fade_is_active(TEST_LED)) {
+        slices++;
+        k_msleep(FADE_STEP_MS);
+    }
+    elapsed = k_uptime_get() - start;
+
+    ret = led_fade_wait(TEST_LED, K_NO_WAIT);
+    CHECK(ret == 0, "fade in ended with %d", ret);
+    CHECK(slices >= FADE_STEPS / 2, "caller only ran %u times", slices);
+    CHECK(elapsed >= FADE_STEPS * FADE_STEP_MS, "fade took %lld ms", (long long)elapsed);
+
+    state = led_state(TEST_LED);
+    CHECK(state.period_cycles != 0 && state.pulse_cycles == state.period_cycles,
+          "fade in ended at %u/%u", state.pulse_cycles, state.period_cycles);
+
+    ret = led_fade_start(TEST_LED, false);
+    CHECK(ret == 0, "start returned %d", ret);
+    ret = led_fade_wait(TEST_LED, K_MSEC(2 * FADE_STEPS * FADE_STEP_MS));
+    CHECK(ret == 0, "fade out ended with %d", ret);
+
+    state = led_state(TEST_LED);
+    CHECK(state.pulse_cycles == 0, "fade out ended at %u", state.pulse_cycles);
+}
+
+/**
+ * @brief All LEDs fade at once on their own curves, sharing their wakeups
+ */
+static void check_concurrent_fades(void)
+{
+    size_t leds = led_fade_count();
+    uint32_t longest_frames = 0;
+    uint32_t wakeups;
+    int ret;
+
+    wakeups = led_fade_wakeups();
+    for (size_t i = 0; i < leds; i++) {
+        /* Different target and duration on every LED */
+        uint16_t target = FADE_STEPS - (i * FADE_STEPS) / (2 * leds);
+        uint32_t frames = FADE_STEPS / 2 + (i * FADE_STEPS) / leds;
+
+        ret = led_fade_ramp(i, 0, target, frames * FADE_STEP_MS);
+        CHECK(ret == 0, "LED %u: ramp returned %d", (unsigned int)i, ret);
+        longest_frames = MAX(longest_frames, frames);
+    }
+
+    for (size_t i = 0; i < leds; i++) {
+        uint16_t target = FADE_STEPS - (i * FADE_STEPS) / (2 * leds);
+        struct pwm_emul_channel_state state;
+
+        ret = led_fade_wait(i, K_MSEC(4 * longest_frames * FADE_STEP_MS));
+        CHECK(ret == 0, "LED %u: fade ended with %d", (unsigned int)i, ret);
+
+        /* Levels go through the CIE L* table before reaching the PWM */
+        state = led_state(i);
+        CHECK(state.pulse_cycles ==
+              (uint32_t)(((uint64_t)led_gamma_table[target] * state.period_cycles) >> 16),
+              "LED %u: ended at %u/%u, expected level %u", (unsigned int)i,
+              state.pulse_cycles, state.period_cycles, target);
+    }
+
+    /* At most one wakeup per frame of the longest fade, not one per LED per frame */
+    wakeups = led_fade_wakeups() - wakeups;
+    CHECK(wakeups <= longest_frames + 2, "%u wakeups for %u frames",
+          wakeups, longest_frames);
+
+    for (size_t i = 0; i < leds; i++) {
+        (void)led_fade_ramp(i, 0, 0, 0);
+        (void)led_fade_wait(i, K_FOREVER);
+    }
+}
+
+/**
+ * @brief Writes that change nothing must not reach the PWM driver
+ */
+static void check_redundant_writes_skipped(void)
+{
+    struct led_fade_counters before;
+    struct led_fade_counters after;
+    struct pwm_emul_channel_state state;
+    uint32_t hw_writes;
+    int ret;
+
+    ret = led_fade_set_pulse(TEST_LED, PWM_PERIOD_US / 2);
+    CHECK(ret == 0, "set returned %d", ret);
+
+    (void)led_fade_get_counters(TEST_LED, &before);
+    hw_writes = led_state(TEST_LED).writes;
+
+    /* Same value three times: nothing may reach the driver */
+    for (int i = 0; i < 3; i++) {
+        ret = led_fade_set_pulse(TEST_LED, PWM_PERIOD_US / 2);
+        CHECK(ret == 0, "set returned %d", ret);
+    }
+
+    (void)led_fade_get_counters(TEST_LED, &after);
+    state = led_state(TEST_LED);
+    CHECK(state.writes == hw_writes, "%u redundant driver calls",
+          state.writes - hw_writes);
+    CHECK(after.pwm_skipped - before.pwm_skipped == 3, "%u calls skipped",
+          after.pwm_skipped - before.pwm_skipped);
+    CHECK(after.pwm_writes == before.pwm_writes, "writes counted for skipped calls");
+
+    /* A different value goes out */
+    ret = led_fade_set_pulse(TEST_LED, 0);
+    CHECK(ret == 0, "set returned %d", ret);
+    state = led_state(TEST_LED);
+    CHECK(state.writes == hw_writes + 1 && state.pulse_cycles == 0,
+          "turn off not written (%u writes, pulse %u)", state.writes - hw_writes,
+          state.pulse_cycles);
+}
+
+/**
+ * @brief LEDs of one controller must change together, in one commit
+ *
+ * Every LED sharing the controller of TEST_LED fades at once. Each frame
+ * must reach the controller as a single commit covering all of them.
+ */
+static void check_shared_controller_commits(void)
+{
+    const struct device *dev = led_fade_spec(TEST_LED)->dev;
+    uint32_t frames = FADE_STEPS / 2;
+    size_t group[PWM_EMUL_NUM_CHANNELS];
+    size_t members = 0;
+    uint32_t commits;
+    int ret;
+
+    for (size_t i = 0; i < led_fade_count() && members < ARRAY_SIZE(group); i++) {
+        if (led_fade_spec(i)->dev == dev) {
+            group[members++] = i;
+        }
+    }
+    CHECK(members > 1, "only %u LED(s) on the controller", (unsigned int)members);
+
+    /* Start them all on the same frame: keep the scheduler out until done */
+    commits = pwm_emul_get_commits(dev);
+    k_sched_lock();
+    for (size_t k = 0; k < members; k++) {
+        ret = led_fade_ramp(group[k], 0, FADE_STEPS, frames * FADE_STEP_MS);
+        CHECK(ret == 0, "LED %u: ramp returned %d", (unsigned int)group[k], ret);
+    }
+    k_sched_unlock();
+    for (size_t k = 0; k < members; k++) {
+        ret = led_fade_wait(group[k], K_MSEC(4 * frames * FADE_STEP_MS));
+        CHECK(ret == 0, "LED %u: fade ended with %d", (unsigned int)group[k], ret);
+    }
+
+    /* At most one commit per frame (plus the start frame), not one per LED */
+    commits = pwm_emul_get_commits(dev) - commits;
+    CHECK(commits <= frames + 2, "%u commits for %u frames of %u LEDs", commits,
+          frames, (unsigned int)members);
+
+    /* The last frame of every LED landed in the same commit */
+    for (size_t k = 1; k < members; k++) {
+        CHECK(led_state(group[k]).commit == led_state(group[0]).commit,
+              "LED %u: last commit %u, LED %u: %u", (unsigned int)group[k],
+              led_state(group[k]).commit, (unsigned int)group[0],
+              led_state(group[0]).commit);
+    }
+
+    for (size_t k = 0; k < members; k++) {
+        (void)led_fade_ramp(group[k], 0, 0, 0);
+        (void)led_fade_wait(group[k], K_FOREVER);
+    }
+}
+
+/**
+ * @brief A sequenced fade is one upload and no scheduler wakeup
+ *
+ * The emulated controller plays the ramp from its own timer. The fade
+ * engine must not wake up while it plays, the channel must see every
+ * frame, and the last one must land FADE_STEPS frames after the first.
+ */
+static void check_sequenced_fade(void)
+{
+    int64_t frame_ticks = MAX(k_ms_to_ticks_ceil64(FADE_STEP_MS), 1);
+    struct pwm_emul_channel_state before = led_state(TEST_LED);
+    struct pwm_emul_channel_state after;
+    struct led_fade_counters counters_before;
+    struct led_fade_counters counters_after;
+    uint32_t wakeups = led_fade_wakeups();
+    int64_t error;
+    int ret;
+
+    (void)led_fade_get_counters(TEST_LED, &counters_before);
+
+    ret = led_fade_start(TEST_LED, true);
+    CHECK(ret == 0, "start returned %d", ret);
+    ret = led_fade_set_pulse(TEST_LED, 0);
+    CHECK(ret == -EBUSY, "set while playing returned %d", ret);
+
+    ret = led_fade_wait(TEST_LED, K_MSEC(2 * FADE_STEPS * FADE_STEP_MS));
+    CHECK(ret == 0, "fade ended with %d", ret);
+
+    (void)led_fade_get_counters(TEST_LED, &counters_after);
+    after = led_state(TEST_LED);
+    wakeups = led_fade_wakeups() - wakeups;
+    error = after.last_step - (after.seq_start + FADE_STEPS * frame_ticks);
+
+    CHECK(wakeups == 0, "%u scheduler wakeups during a sequenced fade", wakeups);
+    CHECK(counters_after.seq_plays - counters_before.seq_plays == 1,
+          "fade not played as a sequence");
+    CHECK(after.writes - before.writes == 1, "%u driver calls for one fade",
+          after.writes - before.writes);
+    CHECK(after.seq_steps - before.seq_steps == FADE_STEPS * SEQ_STEPS_PER_FRAME + 1,
+          "%u steps played",
+          after.seq_steps - before.seq_steps);
+    CHECK(after.pulse_cycles == after.period_cycles, "fade ended at %u/%u",
+          after.pulse_cycles, after.period_cycles);
+    CHECK(error >= -1 && error <= 1, "sequence ended %lld ticks off its deadline",
+          (long long)error);
+
+    (void)led_fade_ramp(TEST_LED, 0, 0, 0);
+    (void)led_fade_wait(TEST_LED, K_FOREVER);
+}
+
+/**
+ * @brief A dithered sequence must average to the exact duty of its level
+ *
+ * The LED is held at level 1, the lowest one, for a few frames. Each
+ * period gets a whole number of cycles, but their mean has to match the
+ * fractional pulse width of the gamma table to within one cycle over the
+ * number of periods played.
+ */
+static void check_dithering(void)
+{
+    const struct pwm_dt_spec *spec = led_fade_spec(TEST_LED);
+    uint64_t expected_q16;
+    uint64_t sum = 0;
+    uint32_t periods = 0;
+    uint32_t dropped;
+    uint32_t period_cycles = 0;
+    uint32_t min_pulse = UINT32_MAX;
+    uint32_t max_pulse = 0;
+    size_t count;
+    int ret;
+
+    pwm_emul_capture_start(spec->dev, capture, ARRAY_SIZE(capture));
+    ret = led_fade_ramp(TEST_LED, 1, 1, DITHER_FRAMES * FADE_STEP_MS);
+    CHECK(ret == 0, "ramp returned %d", ret);
+    ret = led_fade_wait(TEST_LED, K_MSEC(4 * DITHER_FRAMES * FADE_STEP_MS));
+    CHECK(ret == 0, "ramp ended with %d", ret);
+    count = pwm_emul_capture_stop(spec->dev, &dropped);
+    CHECK(dropped == 0, "%u steps did not fit the capture", dropped);
+
+    /*
+     * The first entries are the initial state of every channel. The last
+     * step of the channel is the plain target, held after the sequence.
+     */
+    for (size_t i = PWM_EMUL_NUM_CHANNELS; i + 1 < count; i++) {
+        if (capture[i].channel != spec->channel) {
+            continue;
+        }
+        period_cycles = capture[i].period_cycles;
+        sum += capture[i].pulse_cycles;
+        min_pulse = MIN(min_pulse, capture[i].pulse_cycles);
+        max_pulse = MAX(max_pulse, capture[i].pulse_cycles);
+        periods++;
+    }
+
+    expected_q16 = (uint64_t)led_gamma_table[1] * period_cycles * periods;
+    CHECK(periods == DITHER_FRAMES * SEQ_STEPS_PER_FRAME, "%u periods played", periods);
+    CHECK(max_pulse - min_pulse <= 1, "pulse went from %u to %u cycles", min_pulse,
+          max_pulse);
+    CHECK((sum << 16) + (1U << 16) > expected_q16 && (sum << 16) < expected_q16 + (1U << 16),
+          "%llu cycles over %u periods, expected %llu/65536", (unsigned long long)sum,
+          periods, (unsigned long long)expected_q16);
+
+    (void)led_fade_ramp(TEST_LED, 0, 0, 0);
+    (void)led_fade_wait(TEST_LED, K_FOREVER);
+}
+
+/**
+ * @brief Staggering must lower the peak number of LEDs lit at once
+ *
+ * Every LED is set to half brightness. Aligned, all of them would be lit
+ * during the first half of the period; staggered, the peak must be lower.
+ */
+static void check_stagger(void)
+{
+    static struct pwm_emul_window windows[STAGGER_MAX_LEDS];
+    static struct pwm_emul_window aligned[STAGGER_MAX_LEDS];
+    size_t leds = MIN(led_fade_count(), ARRAY_SIZE(windows));
+    uint32_t peak_aligned;
+    uint32_t peak;
+    int ret;
+
+    for (size_t i = 0; i < leds; i++) {
+        const struct pwm_dt_spec *spec = led_fade_spec(i);
+
+        ret = led_fade_set_pulse(i, PWM_PERIOD_US / 2);
+        CHECK(ret == 0, "LED %u: set returned %d", (unsigned int)i, ret);
+        (void)pwm_emul_get_on_window(spec->dev, spec->channel, spec->flags, &windows[i]);
+        CHECK(led_state(i).pulse_cycles == led_state(i).period_cycles / 2,
+              "LED %u: lit for %u/%u", (unsigned int)i, led_state(i).pulse_cycles,
+              led_state(i).period_cycles);
+
+        /* The same duty with the rising edge at the start of the period */
+        aligned[i] = (struct pwm_emul_window){ .len_ppm = windows[i].len_ppm };
+    }
+
+    peak = pwm_emul_peak_on(windows, leds);
+    peak_aligned = pwm_emul_peak_on(aligned, leds);
+    printk("selftest: %u LEDs at 50%%: peak %u lit aligned, %u staggered\n",
+           (unsigned int)leds, peak_aligned, peak);
+    CHECK(leds < 2 || peak < peak_aligned, "staggering left the peak at %u", peak);
+
+    for (size_t i = 0; i < leds; i++) {
+        (void)led_fade_set_pulse(i, 0);
+    }
+}
+
+/**
+ * @brief A controller must only run while one of its LEDs is lit
+ */
+static void check_runtime_pm(void)
+{
+    const struct device *dev = led_fade_spec(TEST_LED)->dev;
+    uint32_t suspends;
+    int ret;
+
+    /* Suspending is deferred: give it a moment after the last write */
+    turn_off_all_leds();
+    k_msleep(1);
+    CHECK(pwm_emul_is_suspended(dev), "controller running with every LED dark");
+    suspends = pwm_emul_get_suspends(dev);
+
+    ret = led_fade_start(TEST_LED, true);
+    CHECK(ret == 0, "start returned %d", ret);
+    k_msleep(FADE_STEPS * FADE_STEP_MS / 2);
+    CHECK(!pwm_emul_is_suspended(dev), "controller suspended while fading");
+    ret = led_fade_wait(TEST_LED, K_MSEC(2 * FADE_STEPS * FADE_STEP_MS));
+    CHECK(ret == 0, "fade in ended with %d", ret);
+    k_msleep(1);
+    CHECK(!pwm_emul_is_suspended(dev), "controller suspended with its LED at full");
+
+    ret = led_fade_start(TEST_LED, false);
+    CHECK(ret == 0, "start returned %d", ret);
+    ret = led_fade_wait(TEST_LED, K_MSEC(2 * FADE_STEPS * FADE_STEP_MS));
+    CHECK(ret == 0, "fade out ended with %d", ret);
+    k_msleep(1);
+    CHECK(pwm_emul_is_suspended(dev), "controller still running after the fade out");
+    CHECK(pwm_emul_get_suspends(dev) == suspends + 1, "%u suspends for one fade",
+          pwm_emul_get_suspends(dev) - suspends);
+}
+
+static struct led_notify pm_chain_second;
+static volatile int pm_chain_ret;
+static volatile bool pm_chain_in_isr;
+
+/**
+ * @brief Chain a fade in from the completion of a fade out
+ */
+static void pm_chain_next(struct led_notify *notify, int result)
+{
+    ARG_UNUSED(notify);
+
+    pm_chain_in_isr = k_is_in_isr();
+    pm_chain_ret = (result < 0) ? result :
+        led_fade_submit(TEST_LED, 0, FADE_STEPS, FADE_STEPS * FADE_STEP_MS, &pm_chain_second);
+}
+
+/**
+ * @brief A fade chained from the interrupt ending a sequence must not resume
+ *        its controller from that interrupt
+ *
+ * The fade out leaves the LED dark and gives its controller up, in the
+ * completion interrupt of the sequence; the fade in chained from there
+ * must then run from the scheduler, which resumes the controller from
+ * the system work queue.
+ */
+static void check_runtime_pm_chain(void)
+{
+    const struct device *dev = led_fade_spec(TEST_LED)->dev;
+    struct led_fade_counters before;
+    struct led_fade_counters after;
+    struct led_notify first;
+    struct pwm_emul_channel_state state;
+    int ret;
+
+    ret = led_fade_start(TEST_LED, true);
+    CHECK(ret == 0, "start returned %d", ret);
+    (void)led_fade_wait(TEST_LED, K_MSEC(2 * FADE_STEPS * FADE_STEP_MS));
+    (void)led_fade_get_counters(TEST_LED, &before);
+
+    pm_chain_ret = -EINPROGRESS;
+    pm_chain_in_isr = false;
+    led_notify_init(&pm_chain_second);
+    led_notify_init_callback(&first, pm_chain_next, NULL);
+    ret = led_fade_submit(TEST_LED, FADE_STEPS, 0, FADE_STEPS * FADE_STEP_MS, &first);
+    CHECK(ret == 0, "fade out returned %d", ret);
+
+    k_msleep(3 * FADE_STEPS * FADE_STEP_MS);
+    (void)led_fade_get_counters(TEST_LED, &after);
+    state = led_state(TEST_LED);
+    CHECK(pm_chain_in_isr, "the fade out did not end in an interrupt");
+    CHECK(pm_chain_ret == 0, "chained fade returned %d", pm_chain_ret);
+    CHECK(led_notify_result(&pm_chain_second) == 0, "chained fade ended with %d",
+          led_notify_result(&pm_chain_second));
+    CHECK(after.seq_plays - before.seq_plays == 1, "%u fades sequenced, expected the first only",
+          after.seq_plays - before.seq_plays);
+    CHECK(!pwm_emul_is_suspended(dev) && state.pulse_cycles == state.period_cycles,
+          "chained fade left %u/%u, controller %s", state.pulse_cycles, state.period_cycles,
+          pwm_emul_is_suspended(dev) ? "suspended" : "running");
+
+    ret = led_fade_start(TEST_LED, false);
+    CHECK(ret == 0, "start returned %d", ret);
+    (void)led_fade_wait(TEST_LED, K_MSEC(2 * FADE_STEPS * FADE_STEP_MS));
+}
+
+/**
+ * @brief Duty of a channel at a given time of a trace
+ *
+ * @return Duty in ppm, or -1 if the trace has no point for the channel yet
+ */
+static int64_t trace_duty_at(const struct golden_point *points, size_t count,
+                             uint32_t channel, uint32_t time_ms)
+{
+    int64_t duty = -1;
+
+    for (size_t i = 0; i < count && points[i].time_ms <= time_ms; i++) {
+        if (points[i].channel == channel) {
+            duty = points[i].duty_ppm;
+        }
+    }
+
+    return duty;
+}
+
+/**
+ * @brief Check that both waveforms agree right after every step of @p steps
+ *
+ * Only channels that appear in the golden trace are compared.
+ *
+ * @return Number of mismatching steps
+ */
+static int trace_compare(const struct golden_trace *golden, const struct golden_point *steps,
+                         size_t step_count, size_t capture_count)
+{
+    int mismatches = 0;
+
+    for (size_t i = 0; i < step_count; i++) {
+        uint32_t channel = steps[i].channel;
+        uint32_t time_ms = steps[i].time_ms + GOLDEN_TIME_TOL_MS;
+        int64_t expected;
+        int64_t actual;
+
+        if (trace_duty_at(golden->points, golden->count, channel, UINT32_MAX) < 0) {
+            continue;  /* Channel not covered by the golden trace */
+        }
+
+        expected = trace_duty_at(golden->points, golden->count, channel, time_ms);
+        actual = trace_duty_at(captured, capture_count, channel, time_ms);
+        if (actual < 0 || expected < 0 ||
+            actual - expected > GOLDEN_DUTY_TOL_PPM ||
+            expected - actual > GOLDEN_DUTY_TOL_PPM) {
+            printk("selftest: %s: channel %u at %u ms: %lld ppm, expected %lld\n",
+                   golden->name, channel, time_ms, (long long)actual,
+                   (long long)expected);
+            mismatches++;
+        }
+    }
+
+    return mismatches;
+}
+
+/**
+ * @brief Sleep until a frame of the grid fades share starts
+ *
+ * A fade started in the same tick has its first frame right away and ends
+ * its duration later, rather than waiting for the next frame.
+ */
+static void wait_for_frame(void)
+{
+    int64_t frame_ticks = MAX(k_ms_to_ticks_ceil64(FADE_STEP_MS), 1);
+
+    /* A few tries, in case the wakeup is a tick late */
+    for (int tries = 0; tries < 3; tries++) {
+        int64_t now = k_uptime_ticks();
+
+        if (now % frame_ticks == 0) {
+            return;
+        }
+        (void)k_sleep(K_TIMEOUT_ABS_TICKS(DIV_ROUND_UP(now, frame_ticks) * frame_ticks));
+    }
+}
+
+/**
+ * @brief Replay a demo helper and compare the PWM output with a golden trace
+ *
+ * The controller of TEST_LED is captured while @p run executes. On a
+ * mismatch the captured trace is printed in the golden file format, so it
+ * can be reviewed and recorded as the new golden trace.
+ *
+ * @param golden Expected waveform
+ * @param setup Brings the LEDs to the starting state, before the capture
+ * @param run Replayed helper calls
+ */
+static void check_golden_trace(const struct golden_trace *golden,
+                               void (*setup)(void), void (*run)(void))
+{
+    const struct device *dev = led_fade_spec(TEST_LED)->dev;
+    uint32_t dropped;
+    size_t count;
+    int mismatches;
+
+    if (PWM_PERIOD_US != GOLDEN_PWM_PERIOD_US || FADE_STEP_MS != GOLDEN_FADE_STEP_MS ||
+        FADE_STEPS != GOLDEN_FADE_STEPS) {
+        printk("selftest: %s: skipped, recorded for another configuration\n",
+               golden->name);
+        return;
+    }
+    if (IS_ENABLED(CONFIG_APP_FADE_DITHER)) {
+        /* Sequences change the duty every PWM period: see check_dithering() */
+        printk("selftest: %s: skipped, fades are dithered\n", golden->name);
+        return;
+    }
+    if (IS_ENABLED(CONFIG_APP_PWM_STAGGER_ALTERNATE)) {
+        /* Right-aligned LEDs are programmed with the complement duty */
+        printk("selftest: %s: skipped, LEDs are right-aligned\n", golden->name);
+        return;
+    }
+
+    setup();
+    wait_for_frame();
+    pwm_emul_capture_start(dev, capture, ARRAY_SIZE(capture));
+    run();
+    count = pwm_emul_capture_stop(dev, &dropped);
+    CHECK(dropped == 0, "%s: %u changes did not fit the capture", golden->name, dropped);
+
+    /* Same form as the golden trace: relative ms and duty in ppm */
+    for (size_t i = 0; i < count; i++) {
+        captured[i] = (struct golden_point){
+            .time_ms = (uint32_t)((capture[i].time_us - capture[0].time_us) / USEC_PER_MSEC),
+            .channel = capture[i].channel,
+            .duty_ppm = capture[i].period_cycles == 0 ? 0 :
+                (uint32_t)(((uint64_t)capture[i].pulse_cycles * 1000000U) /
+                           capture[i].period_cycles),
+        };
+    }
+
+    /* Every golden step must be in the capture, and nothing else */
+    mismatches = trace_compare(golden, golden->points, golden->count, count) +
+                 trace_compare(golden, captured, count, count);
+    CHECK(mismatches == 0, "%s: %d mismatches with the golden trace", golden->name,
+          mismatches);
+
+    if (mismatches != 0) {
+        for (size_t i = 0; i < count; i++) {
+            printk("selftest: %s: captured %u,%u,%u\n", golden->name,
+                   captured[i].time_ms, captured[i].channel, captured[i].duty_ppm);
+        }
+    }
+}
+
+static void golden_setup_off(void)
+{
+    turn_off_all_leds();
+}
+
+static void golden_setup_full(void)
+{
+    turn_off_all_leds();
+    set_led_brightness(TEST_LED, 100);
+}
+
+static void golden_setup_half(void)
+{
+    const struct device *dev = led_fade_spec(TEST_LED)->dev;
+
+    /* Every LED sharing the controller of TEST_LED */
+    turn_off_all_leds();
+    for (size_t i = 0; i < led_fade_count(); i++) {
+        if (led_fade_spec(i)->dev == dev) {
+            set_led_brightness(i, 50);
+        }
+    }
+}
+
+static void golden_run_fade_in(void)
+{
+    (void)fade_led(TEST_LED, true);
+}
+
+static void golden_run_fade_out(void)
+{
+    (void)fade_led(TEST_LED, false);
+}
+
+static void golden_run_set_brightness(void)
+{
+    static const uint8_t levels[] = { 25, 50, 75, 100, 0 };
+
+    for (size_t i = 0; i < ARRAY_SIZE(levels); i++) {
+        k_msleep(10);
+        set_led_brightness(TEST_LED, levels[i]);
+    }
+}
+
+static void golden_run_turn_off(void)
+{
+    k_msleep(10);
+    turn_off_all_leds();
+}
+
+/**
+ * @brief The demo helpers must produce their golden waveforms
+ */
+static void check_golden_traces(void)
+{
+    check_golden_trace(&golden_fade_in, golden_setup_off, golden_run_fade_in);
+    check_golden_trace(&golden_fade_out, golden_setup_full, golden_run_fade_out);
+    check_golden_trace(&golden_set_brightness, golden_setup_off, golden_run_set_brightness);
+    check_golden_trace(&golden_turn_off, golden_setup_half, golden_run_turn_off);
+    turn_off_all_leds();
+}
+
+static void cpu_load(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (k_uptime_get() < load_until) {
+        k_busy_wait(LOAD_BURST_US);
+        k_msleep(LOAD_PERIOD_MS - LOAD_BURST_US / 1000);
+    }
+}
+
+/**
+ * @brief The runtime statistics must account for one whole fade
+ */
+static void check_fade_statistics(void)
+{
+    struct led_fade_counters counters;
+    uint32_t hist_steps = 0;
+    int ret;
+
+    (void)led_fade_reset_counters(TEST_LED);
+    ret = led_fade_start(TEST_LED, true);
+    CHECK(ret == 0, "start returned %d", ret);
+    ret = led_fade_wait(TEST_LED, K_MSEC(2 * FADE_STEPS * FADE_STEP_MS));
+    CHECK(ret == 0, "fade ended with %d", ret);
+
+    (void)led_fade_get_counters(TEST_LED, &counters);
+    for (size_t b = 0; b < LED_FADE_LATE_BUCKETS; b++) {
+        hist_steps += counters.late_hist[b];
+    }
+
+    CHECK(counters.fades == 1 && counters.pwm_errors == 0, "%u fades, %u errors",
+          counters.fades, counters.pwm_errors);
+    CHECK(counters.fade_time_ms >= FADE_STEPS * FADE_STEP_MS &&
+          counters.fade_time_ms <= (FADE_STEPS + 2) * FADE_STEP_MS,
+          "fade counted as %u ms", counters.fade_time_ms);
+    CHECK(hist_steps == counters.steps, "%u steps in the histogram, %u counted",
+          hist_steps, counters.steps);
+    /* Sequenced fades are stepped by the controller, not the scheduler */
+    CHECK(counters.steps == (counters.seq_plays ? 0 : FADE_STEPS + 1),
+          "%u steps counted", counters.steps);
+    CHECK(counters.steps == 0 || counters.worst_late_us < FADE_STEP_MS * USEC_PER_MSEC,
+          "worst step %u us late", counters.worst_late_us);
+
+    (void)led_fade_ramp(TEST_LED, 0, 0, 0);
+    (void)led_fade_wait(TEST_LED, K_FOREVER);
+}
+
+/**
+ * @brief A fade must end on its deadline even if frames ran late
+ *
+ * The load runs for the first three quarters of the fade. Late frames are
+ * skipped, not replayed, and the delays must not add up: the last frame
+ * has to land within one kernel tick of its absolute deadline.
+ */
+static void check_fade_ends_on_time_under_load(void)
+{
+    int64_t frame_ticks = MAX(k_ms_to_ticks_ceil64(FADE_STEP_MS), 1);
+    struct pwm_emul_channel_state state;
+    uint32_t late = led_fade_late_frames();
+    int64_t expected_end;
+    int64_t error;
+    int ret;
+
+    /* Started on a frame of the shared grid, the fade starts right away */
+    wait_for_frame();
+    load_until = k_uptime_get() + (3 * FADE_STEPS * FADE_STEP_MS) / 4;
+    expected_end = k_uptime_ticks() + FADE_STEPS * frame_ticks;
+    ret = led_fade_start(TEST_LED, true);
+    CHECK(ret == 0, "start returned %d", ret);
+
+    k_thread_create(&load_thread, load_stack, K_THREAD_STACK_SIZEOF(load_stack),
+                    cpu_load, NULL, NULL, NULL, K_PRIO_COOP(0), 0, K_NO_WAIT);
+
+    ret = led_fade_wait(TEST_LED, K_MSEC(4 * FADE_STEPS * FADE_STEP_MS));
+    CHECK(ret == 0, "fade ended with %d", ret);
+    (void)k_thread_join(&load_thread, K_FOREVER);
+
+    state = led_state(TEST_LED);
+    error = state.last_write - expected_end;
+    CHECK(state.pulse_cycles == state.period_cycles, "fade ended at %u/%u",
+          state.pulse_cycles, state.period_cycles);
+    CHECK(led_fade_late_frames() > late, "the load delayed no frame");
+    CHECK(error >= -1 && error <= 1, "fade ended %lld ticks off its deadline",
+          (long long)error);
+
+    (void)led_fade_ramp(TEST_LED, 0, 0, 0);
+    (void)led_fade_wait(TEST_LED, K_FOREVER);
+}
+
+/**
+ * @brief A slow fade must only wake the CPU up when its brightness changes
+ *
+ * Two brightness steps over FADE_STEPS frames: the LED changes on the
+ * frames where its level rounds to the next step, and the fade ends on its
+ * last frame. Every other frame is slept through.
+ */
+static void check_slow_fade_wakeups(void)
+{
+    uint16_t top = MIN(2, FADE_STEPS);
+    uint32_t wakeups = led_fade_wakeups();
+    int64_t start = k_uptime_get();
+    int64_t elapsed;
+    int ret;
+
+    ret = led_fade_ramp(TEST_LED, 0, top, FADE_STEPS * FADE_STEP_MS);
+    CHECK(ret == 0, "ramp returned %d", ret);
+    ret = led_fade_wait(TEST_LED, K_MSEC(2 * FADE_STEPS * FADE_STEP_MS));
+    CHECK(ret == 0, "fade ended with %d", ret);
+    elapsed = k_uptime_get() - start;
+    wakeups = led_fade_wakeups() - wakeups;
+
+    /* First frame, one per step, last frame */
+    CHECK(wakeups <= top + 2U, "%u wakeups for a fade over %u steps", wakeups, top);
+    /* Up to a frame more, waiting for the next frame of the grid */
+    CHECK(elapsed >= FADE_STEPS * FADE_STEP_MS &&
+          elapsed <= FADE_STEPS * FADE_STEP_MS + 3 * FADE_STEP_MS,
+          "fade of %u ms took %lld ms", FADE_STEPS * FADE_STEP_MS, (long long)elapsed);
+    CHECK(led_state(TEST_LED).pulse_cycles ==
+          (uint32_t)(((uint64_t)led_gamma_table[top] * led_state(TEST_LED).period_cycles) >> 16),
+          "fade ended at %u", led_state(TEST_LED).pulse_cycles);
+
+    (void)led_fade_ramp(TEST_LED, 0, 0, 0);
+    (void)led_fade_wait(TEST_LED, K_FOREVER);
+}
+
+/**
+ * @brief Count the wakeups of two full fades started a quarter frame apart
+ */
+static uint32_t coalescing_wakeups(size_t other, uint32_t window_us)
+{
+    uint32_t wakeups;
+    int ret;
+
+    led_sched_set_window_us(window_us);
+    wait_for_frame();
+    wakeups = led_fade_wakeups();
+    ret = led_fade_start(TEST_LED, true);
+    CHECK(ret == 0, "start returned %d", ret);
+    k_usleep(FADE_STEP_MS * USEC_PER_MSEC / 4);
+    ret = led_fade_start(other, true);
+    CHECK(ret == 0, "start returned %d", ret);
+
+    ret = led_fade_wait(TEST_LED, K_MSEC(4 * FADE_STEPS * FADE_STEP_MS));
+    CHECK(ret == 0, "fade ended with %d", ret);
+    ret = led_fade_wait(other, K_MSEC(4 * FADE_STEPS * FADE_STEP_MS));
+    CHECK(ret == 0, "fade ended with %d", ret);
+    wakeups = led_fade_wakeups() - wakeups;
+
+    (void)led_fade_ramp(TEST_LED, 0, 0, 0);
+    (void)led_fade_ramp(other, 0, 0, 0);
+    (void)led_fade_wait(TEST_LED, K_FOREVER);
+    (void)led_fade_wait(other, K_FOREVER);
+
+    return wakeups;
+}
+
+/**
+ * @brief Fades started apart must share their wakeups
+ *
+ * Two LEDs fade a quarter of a frame apart, stepping on every frame. The
+ * second one waits for the next frame of the grid the first one is on, so
+ * they share one wakeup per frame even without a coalescing window, and
+ * the window adds nothing.
+ */
+static void check_wakeup_coalescing(void)
+{
+    uint32_t separate;
+    uint32_t coalesced;
+
+    if (led_fade_count() < 2 || k_ms_to_ticks_floor32(FADE_STEP_MS) < 4) {
+        printk("selftest: coalescing not checked (one LED or coarse kernel ticks)\n");
+        return;
+    }
+
+    separate = coalescing_wakeups(TEST_LED + 1, 0);
+    coalesced = coalescing_wakeups(TEST_LED + 1, FADE_STEP_MS * USEC_PER_MSEC / 2);
+    led_sched_set_window_us(CONFIG_APP_LED_SCHED_WINDOW_US);
+
+    CHECK(separate <= FADE_STEPS + 3, "%u wakeups for two fades of %u frames "
+          "without coalescing", separate, FADE_STEPS);
+    CHECK(coalesced <= FADE_STEPS + 3, "%u wakeups for two fades of %u frames "
+          "with coalescing", coalesced, FADE_STEPS);
+}
+
+/**
+ * @brief Program timing, final levels and loop counts must follow the bytecode
+ *
+ * Every SET is one zero-length fade, so a loop of two SETs repeated three
+ * times must end exactly six fades.
+ */
+static void check_animation(void)
+{
+    static const uint8_t hold[] = {
+        LED_ANIM_SET(LED_ANIM_LEVEL_MAX),
+        LED_ANIM_HOLD(10 * FADE_STEP_MS),
+        LED_ANIM_SET(0),
+        LED_ANIM_END(),
+    };
+    static const uint8_t ramp[] = {
+        LED_ANIM_RAMP(LED_ANIM_LEVEL_MAX, 8 * FADE_STEP_MS, LED_ANIM_CURVE_EASE_IN_OUT),
+        LED_ANIM_END(),
+    };
+    static const uint8_t loop[] = {
+        LED_ANIM_LOOP(3),
+            LED_ANIM_SET(LED_ANIM_LEVEL_MAX),
+            LED_ANIM_HOLD(FADE_STEP_MS),
+            LED_ANIM_SET(0),
+        LED_ANIM_END_LOOP(),
+        LED_ANIM_END(),
+    };
+    struct led_fade_counters counters;
+    int64_t start = k_uptime_get();
+    int64_t elapsed;
+    int ret;
+
+    ret = led_anim_start(TEST_LED, hold, sizeof(hold));
+    CHECK(ret == 0, "start returned %d", ret);
+    ret = led_anim_start(TEST_LED, hold, sizeof(hold));
+    CHECK(ret == -EBUSY, "second start returned %d", ret);
+    ret = led_anim_wait(TEST_LED, K_MSEC(20 * FADE_STEP_MS));
+    CHECK(ret == 0, "program ended with %d", ret);
+    elapsed = k_uptime_get() - start;
+    CHECK(elapsed >= 10 * FADE_STEP_MS && elapsed <= 13 * FADE_STEP_MS,
+          "hold of %u ms took %lld ms", 10 * FADE_STEP_MS, (long long)elapsed);
+    CHECK(led_state(TEST_LED).pulse_cycles == 0, "ended at %u",
+          led_state(TEST_LED).pulse_cycles);
+
+    /* Four segments, each rounded down to whole frames and started late */
+    start = k_uptime_get();
+    ret = led_anim_start(TEST_LED, ramp, sizeof(ramp));
+    CHECK(ret == 0, "start returned %d", ret);
+    ret = led_anim_wait(TEST_LED, K_MSEC(20 * FADE_STEP_MS));
+    CHECK(ret == 0, "program ended with %d", ret);
+    elapsed = k_uptime_get() - start;
+    CHECK(elapsed >= 4 * FADE_STEP_MS && elapsed <= 16 * FADE_STEP_MS,
+          "ramp of %u ms took %lld ms", 8 * FADE_STEP_MS, (long long)elapsed);
+    CHECK(led_state(TEST_LED).pulse_cycles ==
+          (uint32_t)(((uint64_t)led_gamma_table[FADE_STEPS] *
+                      led_state(TEST_LED).period_cycles) >> 16),
+          "ramp ended at %u", led_state(TEST_LED).pulse_cycles);
+
+    (void)led_fade_reset_counters(TEST_LED);
+    ret = led_anim_start(TEST_LED, loop, sizeof(loop));
+    CHECK(ret == 0, "start returned %d", ret);
+    ret = led_anim_wait(TEST_LED, K_MSEC(30 * FADE_STEP_MS));
+    CHECK(ret == 0, "program ended with %d", ret);
+    (void)led_fade_get_counters(TEST_LED, &counters);
+    CHECK(counters.fades == 6, "%u fades for 3 iterations of 2 SETs", counters.fades);
+    CHECK(!led_anim_is_running(TEST_LED), "program still running");
+}
+
+/**
+ * @brief Programs must wait for each other at a SYNC, and stop on request
+ */
+static void check_animation_sync_and_stop(void)
+{
+    static const uint8_t late[] = {
+        LED_ANIM_HOLD(5 * FADE_STEP_MS),
+        LED_ANIM_SYNC(7),
+        LED_ANIM_SET(LED_ANIM_LEVEL_MAX),
+        LED_ANIM_END(),
+    };
+    static const uint8_t early[] = {
+        LED_ANIM_SYNC(7),
+        LED_ANIM_SET(LED_ANIM_LEVEL_MAX),
+        LED_ANIM_END(),
+    };
+    static const uint8_t slow[] = {
+        LED_ANIM_RAMP(LED_ANIM_LEVEL_MAX, FADE_STEPS * FADE_STEP_MS, LED_ANIM_CURVE_LINEAR),
+        LED_ANIM_END(),
+    };
+    static const uint8_t off[] = {
+        LED_ANIM_SET(0),
+        LED_ANIM_END(),
+    };
+    const struct led_effect *blink = led_effect_find("blink");
+    size_t other = TEST_LED + 1;
+    int ret;
+
+    if (led_fade_count() < 2) {
+        printk("selftest: animation sync not checked (one LED)\n");
+        return;
+    }
+
+    ret = led_anim_start(TEST_LED, late, sizeof(late));
+    CHECK(ret == 0, "start returned %d", ret);
+    ret = led_anim_start(other, early, sizeof(early));
+    CHECK(ret == 0, "start returned %d", ret);
+
+    /* Held at the barrier while the other one holds */
+    k_msleep(2 * FADE_STEP_MS);
+    CHECK(led_anim_is_running(other) && led_state(other).pulse_cycles == 0,
+          "program went past SYNC alone");
+
+    ret = led_anim_wait(other, K_MSEC(20 * FADE_STEP_MS));
+    CHECK(ret == 0, "program ended with %d", ret);
+    /* Released together: the first one ends within a frame of the other */
+    ret = led_anim_wait(TEST_LED, K_MSEC(2 * FADE_STEP_MS));
+    CHECK(ret == 0, "program ended with %d", ret);
+
+    CHECK(blink != NULL, "no blink effect");
+    if (blink != NULL) {
+        ret = led_anim_start(other, blink->program, blink->len);
+        CHECK(ret == 0, "start returned %d", ret);
+        k_msleep(FADE_STEP_MS);
+        ret = led_anim_stop(other);
+        CHECK(ret == 0, "stop returned %d", ret);
+        ret = led_anim_wait(other, K_MSEC(FADE_STEP_MS));
+        CHECK(ret == -ECANCELED, "stopped program ended with %d", ret);
+        ret = led_anim_stop(other);
+        CHECK(ret == -EALREADY, "second stop returned %d", ret);
+    }
+
+    /* A program started while the ramp of a stopped one runs takes it over */
+    ret = led_anim_start(other, slow, sizeof(slow));
+    CHECK(ret == 0, "start returned %d", ret);
+    k_msleep(2 * FADE_STEP_MS);
+    (void)led_anim_stop(other);
+    ret = led_anim_start(other, off, sizeof(off));
+    CHECK(ret == 0, "start after stop returned %d", ret);
+    ret = led_anim_wait(other, K_MSEC(4 * FADE_STEP_MS));
+    CHECK(ret == 0, "program after stop ended with %d", ret);
+    CHECK(led_state(other).pulse_cycles == 0, "program after stop ended at %u",
+          led_state(other).pulse_cycles);
+
+    (void)led_fade_wait(TEST_LED, K_FOREVER);
+    (void)led_fade_wait(other, K_FOREVER);
+    (void)led_fade_ramp(TEST_LED, 0, 0, 0);
+    (void)led_fade_ramp(other, 0, 0, 0);
+    (void)led_fade_wait(TEST_LED, K_FOREVER);
+    (void)led_fade_wait(other, K_FOREVER);
+}
+
+/**
+ * @brief A cross-fade must take over from a ramp in flight, without a jump
+ */
+static void check_animation_crossfade(void)
+{
+    static const uint8_t rise[] = {
+        LED_ANIM_RAMP(LED_ANIM_LEVEL_MAX, FADE_STEPS * FADE_STEP_MS, LED_ANIM_CURVE_LINEAR),
+        LED_ANIM_END(),
+    };
+    static const uint8_t dark[] = {
+        LED_ANIM_SET(0),
+        LED_ANIM_END(),
+    };
+    uint32_t taken_over;
+    uint32_t pulse;
+    int ret;
+
+    ret = led_anim_start(TEST_LED, rise, sizeof(rise));
+    CHECK(ret == 0, "start returned %d", ret);
+    k_msleep(FADE_STEPS * FADE_STEP_MS / 2);
+
+    taken_over = led_state(TEST_LED).pulse_cycles;
+    ret = led_anim_crossfade(TEST_LED, dark, sizeof(dark), 10 * FADE_STEP_MS);
+    CHECK(ret == 0, "cross-fade returned %d", ret);
+
+    /* Halfway through: on its way down from where the ramp was */
+    k_msleep(5 * FADE_STEP_MS);
+    pulse = led_state(TEST_LED).pulse_cycles;
+    CHECK(pulse > 0 && pulse < taken_over, "at %u halfway down from %u", pulse, taken_over);
+
+    ret = led_anim_wait(TEST_LED, K_MSEC(20 * FADE_STEP_MS));
+    CHECK(ret == 0, "program ended with %d", ret);
+    CHECK(led_state(TEST_LED).pulse_cycles == 0, "cross-fade ended at %u",
+          led_state(TEST_LED).pulse_cycles);
+}
+
+/**
+ * @brief Malformed programs must be refused, and runaway ones stopped
+ */
+static void check_animation_validation(void)
+{
+    static const uint8_t no_end[] = { LED_ANIM_SET(LED_ANIM_LEVEL_MAX) };
+    static const uint8_t bad_opcode[] = { 0xff, LED_ANIM_END() };
+    static const uint8_t truncated[] = { LED_ANIM_OP_HOLD, 0x10 };
+    static const uint8_t mid_jump[] = { LED_ANIM_JUMP(1), LED_ANIM_END() };
+    static const uint8_t unbalanced[] = { LED_ANIM_END_LOOP(), LED_ANIM_END() };
+    static const uint8_t bad_curve[] = { LED_ANIM_RAMP(0, 0, 9), LED_ANIM_END() };
+    static const uint8_t runaway[] = { LED_ANIM_JUMP(0) };
+    const struct {
+        const uint8_t *program;
+        size_t len;
+    } bad[] = {
+        { no_end, sizeof(no_end) },
+        { bad_opcode, sizeof(bad_opcode) },
+        { truncated, sizeof(truncated) },
+        { mid_jump, sizeof(mid_jump) },
+        { unbalanced, sizeof(unbalanced) },
+        { bad_curve, sizeof(bad_curve) },
+    };
+    int ret;
+
+    for (size_t i = 0; i < ARRAY_SIZE(bad); i++) {
+        ret = led_anim_start(TEST_LED, bad[i].program, bad[i].len);
+        CHECK(ret == -EINVAL, "malformed program %u started: %d", (unsigned int)i, ret);
+    }
+    for (size_t i = 0; i < led_effects_count; i++) {
+        ret = led_anim_validate(led_effects[i].program, led_effects[i].len);
+        CHECK(ret == 0, "effect %s refused: %d", led_effects[i].name, ret);
+    }
+
+    ret = led_anim_start(TEST_LED, runaway, sizeof(runaway));
+    CHECK(ret == 0, "start returned %d", ret);
+    ret = led_anim_wait(TEST_LED, K_MSEC(FADE_STEP_MS));
+    CHECK(ret == -ELOOP, "runaway program ended with %d", ret);
+}
+
+/**
+ * @brief Layers must blend as documented, and an alert must not clobber the base
+ */
+static void check_compositor(void)
+{
+    struct led_comp *comp = led_comp_leds();
+    uint16_t quarter = FADE_STEPS / 4;
+    struct pwm_emul_channel_state state;
+    size_t changed;
+
+    /* Ambient level, and an effect adding to it */
+    (void)led_comp_set(comp, LED_COMP_LAYER_BASE, TEST_LED, quarter, LED_COMP_BLEND_MAX, 0);
+    (void)led_comp_set(comp, LED_COMP_LAYER_EFFECT, TEST_LED, quarter, LED_COMP_BLEND_ADD, 0);
+    changed = led_comp_commit(comp);
+    CHECK(changed == 1, "%u channels changed", (unsigned int)changed);
+    CHECK(led_comp_level(comp, TEST_LED) == 2 * quarter, "base + effect at %u",
+          led_comp_level(comp, TEST_LED));
+
+    /* An opaque alert hides them, a half transparent one dims them */
+    (void)led_comp_set(comp, LED_COMP_LAYER_ALERT, TEST_LED, FADE_STEPS,
+                       LED_COMP_BLEND_ALPHA, 255);
+    (void)led_comp_commit(comp);
+    CHECK(led_comp_level(comp, TEST_LED) == FADE_STEPS, "opaque alert at %u",
+          led_comp_level(comp, TEST_LED));
+    (void)led_comp_set(comp, LED_COMP_LAYER_ALERT, TEST_LED, 0, LED_COMP_BLEND_ALPHA, 127);
+    (void)led_comp_commit(comp);
+    CHECK(led_comp_level(comp, TEST_LED) == (2 * quarter * 129 + 128) >> 8,
+          "half transparent alert at %u", led_comp_level(comp, TEST_LED));
+
+    /* Once the alert is gone, the LED shows the layers below exactly as before */
+    (void)led_comp_clear_layer(comp, LED_COMP_LAYER_ALERT);
+    (void)led_comp_commit(comp);
+    k_msleep(FADE_STEP_MS);
+    state = led_state(TEST_LED);
+    CHECK(state.pulse_cycles ==
+          (uint32_t)(((uint64_t)led_gamma_table[2 * quarter] * state.period_cycles) >> 16),
+          "after the alert: %u/%u, expected level %u", state.pulse_cycles,
+          state.period_cycles, 2 * quarter);
+
+    /* Written but not changed: nothing must be passed on */
+    (void)led_comp_set(comp, LED_COMP_LAYER_EFFECT, TEST_LED, quarter / 2,
+                       LED_COMP_BLEND_MAX, 0);
+    changed = led_comp_commit(comp);
+    CHECK(changed == 1 && led_comp_level(comp, TEST_LED) == quarter,
+          "max under the base: %u changed, at %u", (unsigned int)changed,
+          led_comp_level(comp, TEST_LED));
+    (void)led_comp_set(comp, LED_COMP_LAYER_EFFECT, TEST_LED, quarter, LED_COMP_BLEND_MAX, 0);
+    (void)led_comp_set(comp, LED_COMP_LAYER_BASE, TEST_LED, quarter, LED_COMP_BLEND_MAX, 0);
+    changed = led_comp_commit(comp);
+    CHECK(changed == 0, "%u channels changed without a visible change",
+          (unsigned int)changed);
+
+    /* A fade running outside of the compositor is stopped at its level */
+    CHECK(led_fade_ramp(TEST_LED, 0, FADE_STEPS, 100 * FADE_STEP_MS) == 0,
+          "fade under the compositor refused");
+    (void)led_comp_set(comp, LED_COMP_LAYER_BASE, TEST_LED, 2 * quarter, LED_COMP_BLEND_MAX, 0);
+    (void)led_comp_commit(comp);
+    k_msleep(2 * FADE_STEP_MS);
+    state = led_state(TEST_LED);
+    CHECK(!led_fade_is_active(TEST_LED), "fade survived the compositor");
+    CHECK(state.pulse_cycles ==
+          (uint32_t)(((uint64_t)led_gamma_table[2 * quarter] * state.period_cycles) >> 16),
+          "over a fade: %u/%u, expected level %u", state.pulse_cycles, state.period_cycles,
+          2 * quarter);
+
+    (void)led_comp_clear_layer(comp, LED_COMP_LAYER_EFFECT);
+    (void)led_comp_clear_layer(comp, LED_COMP_LAYER_BASE);
+    (void)led_comp_commit(comp);
+    k_msleep(FADE_STEP_MS);
+    CHECK(led_state(TEST_LED).pulse_cycles == 0, "LED left at %u",
+          led_state(TEST_LED).pulse_cycles);
+}
+
+/* Frames of the ramp a fade is redirected to by check_fade_retarget() */
+#define RETARGET_FRAMES (FADE_STEPS / 2)
+
+static volatile int retarget_ret;
+
+static void retarget_from_isr(struct k_timer *timer)
+{
+    ARG_UNUSED(timer);
+
+    retarget_ret = led_fade_retarget(TEST_LED, 0, RETARGET_FRAMES * FADE_STEP_MS);
+}
+
+static K_TIMER_DEFINE(retarget_timer, retarget_from_isr, NULL);
+
+/**
+ * @brief A fade redirected halfway, from an interrupt, must turn back without a jump
+ *
+ * Whether the controller plays the fade or the scheduler steps it, the LED
+ * must turn around at about half brightness, never move by more than one
+ * step a frame, and end dark after the new duration, as one fade.
+ */
+static void check_fade_retarget(void)
+{
+    const struct pwm_dt_spec *spec = led_fade_spec(TEST_LED);
+    uint32_t full_ms = FADE_STEPS * FADE_STEP_MS;
+    struct led_fade_counters before;
+    struct led_fade_counters after;
+    uint32_t max_step_q16 = 0;
+    uint32_t period_cycles = 0;
+    uint32_t peak = 0;
+    uint32_t max_change = 0;
+    uint32_t dropped;
+    size_t count;
+    int64_t start;
+    int64_t elapsed;
+    int ret;
+
+    (void)led_fade_get_counters(TEST_LED, &before);
+    retarget_ret = -EINPROGRESS;
+    pwm_emul_capture_start(spec->dev, capture, ARRAY_SIZE(capture));
+    start = k_uptime_get();
+    ret = led_fade_start(TEST_LED, true);
+    CHECK(ret == 0, "fade in returned %d", ret);
+    k_timer_start(&retarget_timer, K_MSEC(full_ms / 2), K_NO_WAIT);
+
+    ret = led_fade_wait(TEST_LED, K_MSEC(2 * full_ms));
+    elapsed = k_uptime_get() - start;
+    count = pwm_emul_capture_stop(spec->dev, &dropped);
+    CHECK(ret == 0 && retarget_ret == 0, "fade ended with %d, retarget returned %d", ret,
+          retarget_ret);
+    CHECK(elapsed >= full_ms / 2 + (RETARGET_FRAMES - 1) * FADE_STEP_MS &&
+          elapsed <= full_ms / 2 + (RETARGET_FRAMES + 2) * FADE_STEP_MS,
+          "redirected fade took %lld ms", (long long)elapsed);
+    CHECK(led_state(TEST_LED).pulse_cycles == 0, "fade ended at %u",
+          led_state(TEST_LED).pulse_cycles);
+    (void)led_fade_get_counters(TEST_LED, &after);
+    CHECK(after.fades - before.fades == 1, "%u fades counted", after.fades - before.fades);
+
+    /* Dithered sequences record every PWM period: more than the capture holds */
+    if (dropped != 0) {
+        return;
+    }
+    for (size_t k = 0; k < FADE_STEPS; k++) {
+        max_step_q16 = MAX(max_step_q16, led_gamma_table[k + 1] - led_gamma_table[k]);
+    }
+    for (size_t i = PWM_EMUL_NUM_CHANNELS, prev = SIZE_MAX; i < count; i++) {
+        if (capture[i].channel != spec->channel) {
+            continue;
+        }
+        period_cycles = capture[i].period_cycles;
+        peak = MAX(peak, capture[i].pulse_cycles);
+        if (prev != SIZE_MAX) {
+            uint32_t a = capture[prev].pulse_cycles;
+            uint32_t b = capture[i].pulse_cycles;
+
+            max_change = MAX(max_change, (a > b) ? a - b : b - a);
+        }
+        prev = i;
+    }
+    CHECK(peak <= (uint32_t)(((uint64_t)led_gamma_table[FADE_STEPS / 2 + 2] *
+                              period_cycles) >> 16),
+          "turned around at %u/%u", peak, period_cycles);
+    CHECK(max_change <= (uint32_t)(((uint64_t)max_step_q16 * period_cycles) >> 16) + 1,
+          "jumped by %u cycles", max_change);
+}
+
+/* Frames of the fades of check_async_completion() */
+#define ASYNC_FRAMES 10
+
+static volatile int async_calls;  /* Completions seen by async_chain() */
+
+/**
+ * @brief Completion callback fading the LED back out, once
+ */
+static void async_chain(struct led_notify *notify, int result)
+{
+    size_t led = (size_t)(uintptr_t)notify->user_data;
+
+    async_calls++;
+    if (result == 0 && async_calls == 1) {
+        (void)led_fade_submit(led, FADE_STEPS, 0, ASYNC_FRAMES * FADE_STEP_MS, notify);
+    }
+}
+
+/**
+ * @brief One thread must follow fades and programs of several LEDs with k_poll()
+ *
+ * A fade is followed with a callback that chains a second fade from the
+ * completion itself, one with a poll signal and one with a semaphore,
+ * and a program with a semaphore that must report its cancellation.
+ */
+static void check_async_completion(void)
+{
+    static const uint8_t hold[] = {
+        LED_ANIM_SET(LED_ANIM_LEVEL_MAX),
+        LED_ANIM_HOLD(10 * ASYNC_FRAMES * FADE_STEP_MS),
+        LED_ANIM_END(),
+    };
+    struct led_notify by_callback;
+    struct led_notify by_signal;
+    struct led_notify by_sem;
+    struct led_notify program;
+    struct k_poll_signal signal;
+    struct k_sem sem;
+    struct k_poll_event events[] = {
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &signal),
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SEM_AVAILABLE, K_POLL_MODE_NOTIFY_ONLY, &sem),
+    };
+    bool signal_seen = false;
+    bool sem_seen = false;
+    unsigned int signaled = 0;
+    int signal_result = -EINPROGRESS;
+    int ret;
+
+    if (led_fade_count() < 3) {
+        printk("selftest: async completion not checked (fewer than 3 LEDs)\n");
+        return;
+    }
+
+    k_poll_signal_init(&signal);
+    k_sem_init(&sem, 0, 2);
+    async_calls = 0;
+    led_notify_init_callback(&by_callback, async_chain, (void *)(uintptr_t)TEST_LED);
+    led_notify_init_signal(&by_signal, &signal);
+    led_notify_init_sem(&by_sem, &sem);
+
+    ret = led_fade_submit(TEST_LED, 0, FADE_STEPS, ASYNC_FRAMES * FADE_STEP_MS, &by_callback);
+    CHECK(ret == 0, "submit returned %d", ret);
+    ret = led_fade_submit(TEST_LED + 1, 0, FADE_STEPS, 2 * ASYNC_FRAMES * FADE_STEP_MS,
+                          &by_signal);
+    CHECK(ret == 0, "submit returned %d", ret);
+    ret = led_fade_submit(TEST_LED + 2, 0, FADE_STEPS, 3 * ASYNC_FRAMES * FADE_STEP_MS,
+                          &by_sem);
+    CHECK(ret == 0, "submit returned %d", ret);
+    CHECK(led_notify_result(&by_sem) == -EINPROGRESS, "running fade reads %d",
+          led_notify_result(&by_sem));
+
+    /* A rejected submission leaves the handle alone */
+    ret = led_fade_submit(TEST_LED + 2, 0, FADE_STEPS, 0, &by_signal);
+    CHECK(ret == -EBUSY && led_notify_result(&by_signal) == -EINPROGRESS,
+          "second submit returned %d, handle reads %d", ret, led_notify_result(&by_signal));
+
+    /* Both from one wait, whichever ends first */
+    for (int waits = 0; waits < 2 && !(signal_seen && sem_seen); waits++) {
+        ret = k_poll(events, ARRAY_SIZE(events), K_MSEC(8 * ASYNC_FRAMES * FADE_STEP_MS));
+        CHECK(ret == 0, "k_poll returned %d", ret);
+        if (events[0].state == K_POLL_STATE_SIGNALED) {
+            k_poll_signal_check(&signal, &signaled, &signal_result);
+            k_poll_signal_reset(&signal);
+            signal_seen = true;
+        }
+        if (events[1].state == K_POLL_STATE_SEM_AVAILABLE && k_sem_take(&sem, K_NO_WAIT) == 0) {
+            sem_seen = true;
+        }
+        events[0].state = K_POLL_STATE_NOT_READY;
+        events[1].state = K_POLL_STATE_NOT_READY;
+    }
+    CHECK(signal_seen && signaled && signal_result == 0, "signal %u raised with %d", signaled,
+          signal_result);
+    CHECK(sem_seen && led_notify_result(&by_sem) == 0, "semaphore handle reads %d",
+          led_notify_result(&by_sem));
+
+    /* The callback chained a fade out, which has ended by now too */
+    CHECK(async_calls == 2 && led_notify_result(&by_callback) == 0,
+          "callback ran %d times, handle reads %d", async_calls,
+          led_notify_result(&by_callback));
+    CHECK(led_state(TEST_LED).pulse_cycles == 0, "chained fade ended at %u",
+          led_state(TEST_LED).pulse_cycles);
+
+    led_notify_init_sem(&program, &sem);
+    ret = led_anim_submit(TEST_LED + 1, hold, sizeof(hold), &program);
+    CHECK(ret == 0, "program submit returned %d", ret);
+    k_msleep(2 * FADE_STEP_MS);
+    CHECK(led_notify_result(&program) == -EINPROGRESS, "held program reads %d",
+          led_notify_result(&program));
+    (void)led_anim_stop(TEST_LED + 1);
+    ret = k_sem_take(&sem, K_MSEC(FADE_STEP_MS));
+    CHECK(ret == 0 && led_notify_result(&program) == -ECANCELED,
+          "stopped program: %d, handle reads %d", ret, led_notify_result(&program));
+
+    for (size_t led = TEST_LED; led <= TEST_LED + 2; led++) {
+        (void)led_fade_ramp(led, 0, 0, 0);
+        (void)led_fade_wait(led, K_MSEC(2 * FADE_STEP_MS));
+    }
+}
+
+static volatile int cmd_ret;
+
+static void cmd_from_isr(struct k_timer *timer)
+{
+    ARG_UNUSED(timer);
+
+    cmd_ret = led_cmd_set(TEST_LED, FADE_STEPS);
+}
+
+static K_TIMER_DEFINE(cmd_timer, cmd_from_isr, NULL);
+
+/**
+ * @brief Queued commands must be applied in order, in one batch per frame
+ *
+ * A queue full of commands is applied at the next frame, the last one
+ * winning; one more is refused rather than overwriting any. A command
+ * queued from an interrupt is applied like any other.
+ */
+static void check_command_queue(void)
+{
+    struct led_cmd_stats before;
+    struct led_cmd_stats after;
+    struct pwm_emul_channel_state state;
+    int ret;
+
+    ret = led_cmd_set(led_fade_count(), 0);
+    CHECK(ret == -EINVAL, "command for a missing LED queued: %d", ret);
+    ret = led_cmd_ramp(TEST_LED, FADE_STEPS + 1, FADE_STEP_MS);
+    CHECK(ret == -EINVAL, "command past full level queued: %d", ret);
+
+    led_cmd_get_stats(&before);
+    for (size_t i = 0; i < CONFIG_APP_LED_CMD_QUEUE_SIZE; i++) {
+        /* Ends on 0, since the size is even */
+        ret = led_cmd_set(TEST_LED, (i % 2 == 0) ? FADE_STEPS : 0);
+        CHECK(ret == 0, "command %u refused: %d", (unsigned int)i, ret);
+    }
+    ret = led_cmd_set(TEST_LED, FADE_STEPS);
+    CHECK(ret == -ENOBUFS, "command past a full queue returned %d", ret);
+
+    k_msleep(3 * FADE_STEP_MS);
+    led_cmd_get_stats(&after);
+    CHECK(after.applied - before.applied == CONFIG_APP_LED_CMD_QUEUE_SIZE &&
+          after.errors == before.errors, "%u applied, %u refused",
+          after.applied - before.applied, after.errors - before.errors);
+    CHECK(after.batches - before.batches == 1, "applied in %u batches",
+          after.batches - before.batches);
+    CHECK(after.dropped - before.dropped == 1, "%u dropped", after.dropped - before.dropped);
+    CHECK(led_state(TEST_LED).pulse_cycles == 0, "last command left %u",
+          led_state(TEST_LED).pulse_cycles);
+
+    cmd_ret = -EINPROGRESS;
+    k_timer_start(&cmd_timer, K_MSEC(FADE_STEP_MS), K_NO_WAIT);
+    k_msleep(4 * FADE_STEP_MS);
+    state = led_state(TEST_LED);
+    CHECK(cmd_ret == 0, "command from an interrupt returned %d", cmd_ret);
+    CHECK(state.pulse_cycles == state.period_cycles, "command from an interrupt left %u/%u",
+          state.pulse_cycles, state.period_cycles);
+
+    (void)led_cmd_set(TEST_LED, 0);
+    k_msleep(3 * FADE_STEP_MS);
+}
+
+/* LED API device of TEST_LED, which is its first child, TEST_LED + 1 the second */
+#define TEST_LED_DEV DEVICE_DT_GET(DT_PARENT(DT_ALIAS(pwm_led0)))
+
+/**
+ * @brief Whether an LED is lit, sampled at a number of frames after @p start
+ */
+static bool led_lit_at(size_t led, int64_t start, uint32_t frame)
+{
+    (void)k_sleep(K_TIMEOUT_ABS_MS(start + frame * FADE_STEP_MS));
+
+    return led_state(led).pulse_cycles != 0;
+}
+
+/**
+ * @brief The LED API must drive the LEDs, and blink them without a thread
+ *
+ * Two LEDs blink with different periods off the single scheduler entry of
+ * the driver, and are sampled in the middle of their phases. led_off()
+ * stops a blink for good.
+ */
+static void check_led_api(void)
+{
+    static const struct {
+        uint32_t frame;
+        bool lit[2];
+    } samples[] = {
+        /* TEST_LED: 4 frames on, 4 off; TEST_LED + 1: 2 on, 6 off */
+        { 1, { true, true } },
+        { 3, { true, false } },
+        { 5, { false, false } },
+        { 9, { true, true } },
+        { 11, { true, false } },
+    };
+    const struct device *dev = TEST_LED_DEV;
+    struct pwm_emul_channel_state state;
+    int64_t start;
+    int ret;
+
+    if (!device_is_ready(dev)) {
+        CHECK(false, "LED API device %s is not ready", dev->name);
+        return;
+    }
+
+    ret = led_on(dev, led_fade_count());
+    CHECK(ret == -EINVAL, "missing LED turned on: %d", ret);
+    ret = led_set_brightness(dev, 0, LED_BRIGHTNESS_MAX + 1);
+    CHECK(ret == -EINVAL, "brightness past full accepted: %d", ret);
+
+    ret = led_on(dev, 0);
+    k_msleep(2 * FADE_STEP_MS);
+    state = led_state(TEST_LED);
+    CHECK(ret == 0 && state.pulse_cycles == state.period_cycles, "led_on: %d, left %u/%u",
+          ret, state.pulse_cycles, state.period_cycles);
+
+    ret = led_set_brightness(dev, 0, LED_BRIGHTNESS_MAX / 2);
+    k_msleep(2 * FADE_STEP_MS);
+    state = led_state(TEST_LED);
+    CHECK(ret == 0 && state.pulse_cycles != 0 && state.pulse_cycles < state.period_cycles,
+          "led_set_brightness: %d, left %u/%u", ret, state.pulse_cycles, state.period_cycles);
+
+    ret = led_off(dev, 0);
+    k_msleep(2 * FADE_STEP_MS);
+    CHECK(ret == 0 && led_state(TEST_LED).pulse_cycles == 0, "led_off: %d, left %u", ret,
+          led_state(TEST_LED).pulse_cycles);
+
+    start = k_uptime_get();
+    ret = led_blink(dev, 0, 4 * FADE_STEP_MS, 4 * FADE_STEP_MS);
+    CHECK(ret == 0, "blink of LED 0 refused: %d", ret);
+    ret = led_blink(dev, 1, 2 * FADE_STEP_MS, 6 * FADE_STEP_MS);
+    CHECK(ret == 0, "blink of LED 1 refused: %d", ret);
+
+    for (size_t i = 0; i < ARRAY_SIZE(samples); i++) {
+        for (size_t k = 0; k < ARRAY_SIZE(samples[i].lit); k++) {
+            bool lit = led_lit_at(TEST_LED + k, start, samples[i].frame);
+
+            CHECK(lit == samples[i].lit[k], "LED %u %s at frame %u", (unsigned int)k,
+                  lit ? "lit" : "dark", samples[i].frame);
+        }
+    }
+
+    /* A fade started on a blinking LED is cut short by its next edge */
+    ret = led_fade_ramp(TEST_LED, 0, FADE_STEPS / 2, 100 * FADE_STEP_MS);
+    CHECK(ret == 0, "fade on a blinking LED refused: %d", ret);
+    k_msleep(5 * FADE_STEP_MS);
+    CHECK(!led_fade_is_active(TEST_LED), "fade survived the blink");
+
+    (void)led_off(dev, 0);
+    (void)led_off(dev, 1);
+    k_msleep(10 * FADE_STEP_MS);
+    CHECK(led_state(TEST_LED).pulse_cycles == 0 && led_state(TEST_LED + 1).pulse_cycles == 0,
+          "blink went on after led_off: %u, %u", led_state(TEST_LED).pulse_cycles,
+          led_state(TEST_LED + 1).pulse_cycles);
+}
+
+/**
+ * @brief Build a stream frame setting the first LEDs to the same level
+ *
+ * @return Size of the frame
+ */
+static size_t stream_frame(uint8_t *frame, uint8_t seq, uint8_t leds, uint16_t level)
+{
+    size_t len = 0;
+
+    frame[len++] = LED_STREAM_SYNC;
+    frame[len++] = seq;
+    frame[len++] = leds;
+    for (size_t i = 0; i < leds; i++) {
+        frame[len++] = level & 0xff;
+        frame[len++] = level >> 8;
+    }
+    frame[len] = crc8_ccitt(0xff, &frame[1], len - 1);
+
+    return len + 1;
+}
+
+/**
+ * @brief Streamed frames must reach the LEDs whole, and corrupt ones never
+ *
+ * Frames are fed to the decoder directly, split where a receive buffer
+ * could end, without going through the UART.
+ */
+static void check_stream_decoder(void)
+{
+    uint8_t leds = MIN(led_fade_count(), 4);
+    uint8_t frame[3 + 2 * 4 + 1];
+    struct led_stream_stats before;
+    struct led_stream_stats after;
+    size_t len;
+
+    led_stream_get_stats(&before);
+
+    len = stream_frame(frame, 0, leds, UINT16_MAX);
+    led_stream_feed(frame, 4);
+    led_stream_feed(&frame[4], len - 4);
+    k_msleep(FADE_STEP_MS);
+    for (size_t i = 0; i < leds; i++) {
+        CHECK(led_state(i).pulse_cycles == led_state(i).period_cycles,
+              "LED %u at %u/%u after a full frame", (unsigned int)i,
+              led_state(i).pulse_cycles, led_state(i).period_cycles);
+    }
+
+    /* Corrupt level: dropped, the LEDs keep the last frame */
+    len = stream_frame(frame, 1, leds, 0);
+    frame[3] ^= 0x01;
+    led_stream_feed(frame, len);
+    k_msleep(FADE_STEP_MS);
+    CHECK(led_state(TEST_LED).pulse_cycles == led_state(TEST_LED).period_cycles,
+          "corrupt frame applied");
+
+    /* Frames 1 to 4 missing, garbage before the sync byte */
+    len = stream_frame(frame, 5, leds, 0);
+    led_stream_feed((const uint8_t *)"\x00\x17", 2);
+    led_stream_feed(frame, len);
+    k_msleep(FADE_STEP_MS);
+    for (size_t i = 0; i < leds; i++) {
+        CHECK(led_state(i).pulse_cycles == 0, "LED %u at %u after a dark frame",
+              (unsigned int)i, led_state(i).pulse_cycles);
+    }
+
+    /* A fading LED is stopped at the level of the frame */
+    CHECK(led_fade_ramp(TEST_LED, 0, FADE_STEPS / 2, 100 * FADE_STEP_MS) == 0,
+          "fade under the stream refused");
+    len = stream_frame(frame, 6, leds, UINT16_MAX);
+    led_stream_feed(frame, len);
+    k_msleep(2 * FADE_STEP_MS);
+    CHECK(!led_fade_is_active(TEST_LED), "fade survived a frame");
+    CHECK(led_state(TEST_LED).pulse_cycles == led_state(TEST_LED).period_cycles,
+          "fading LED at %u/%u after a full frame", led_state(TEST_LED).pulse_cycles,
+          led_state(TEST_LED).period_cycles);
+
+    led_stream_get_stats(&after);
+    CHECK(after.frames - before.frames == 3, "%u frames applied",
+          after.frames - before.frames);
+    CHECK(after.crc_errors - before.crc_errors == 1, "%u frames dropped",
+          after.crc_errors - before.crc_errors);
+    CHECK(after.rejected == before.rejected, "%u frames rejected",
+          after.rejected - before.rejected);
+    CHECK(after.lost - before.lost == 4, "%u frames counted lost", after.lost - before.lost);
+}
+
+int app_selftest(void)
+{
+    printk("selftest: start\n");
+
+    check_fade_is_nonblocking();
+    check_concurrent_fades();
+    check_redundant_writes_skipped();
+    check_golden_traces();
+    check_fade_statistics();
+    check_animation();
+    check_animation_sync_and_stop();
+    check_animation_validation();
+    check_fade_retarget();
+    check_animation_crossfade();
+    check_compositor();
+    check_command_queue();
+    check_async_completion();
+    if (IS_ENABLED(CONFIG_APP_LED_API)) {
+        check_led_api();
+    }
+    if (IS_ENABLED(CONFIG_APP_LED_STREAM)) {
+        check_stream_decoder();
+    }
+    if (IS_ENABLED(CONFIG_APP_PWM_STAGGER)) {
+        check_stagger();
+    }
+    if (IS_ENABLED(CONFIG_APP_PWM_PM)) {
+        check_runtime_pm();
+        if (IS_ENABLED(CONFIG_APP_FADE_HW_SEQ)) {
+            check_runtime_pm_chain();
+        }
+    }
+
+    if (IS_ENABLED(CONFIG_APP_FADE_HW_SEQ)) {
+        check_sequenced_fade();
+        if (IS_ENABLED(CONFIG_APP_FADE_DITHER)) {
+            check_dithering();
+        }
+    } else {
+        /* These look at how the scheduler steps and commits the frames */
+        check_shared_controller_commits();
+        check_fade_ends_on_time_under_load();
+        check_slow_fade_wakeups();
+        check_wakeup_coalescing();
+    }
+
+    printk("selftest: %s (%d failures)\n", failures ? "FAIL" : "PASS", failures);
+
+    return failures ? -1 : 0;
+}
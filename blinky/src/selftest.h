@@ -0,0 +1,21 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Self-checks run instead of the demo loop when CONFIG_APP_SELFTEST is set.
+ * They exercise the fade engine against the emulated PWM controller on
+ * native_sim and report "selftest: PASS" or "selftest: FAIL" on the console.
+ */
+
+#ifndef SELFTEST_H_
+#define SELFTEST_H_
+
+/**
+ * @brief Run all self-checks
+ *
+ * @return 0 if every check passed, -1 otherwise
+ */
+int app_selftest(void);
+
+#endif /* SELFTEST_H_ */